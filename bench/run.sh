@@ -0,0 +1,77 @@
+#!/bin/sh
+#
+# Runs the pljs benchmarks with pgbench against the database that the usual
+# libpq environment variables point to, and writes one CSV line per
+# benchmark to standard output:
+#
+#   benchmark,clients,duration_s,transactions,tps,latency_ms
+#
+# Every transaction of most benchmarks makes a thousand calls, so the tps of
+# a benchmark is comparable to its own baseline rather than to others.
+#
+# BENCH_TIME     seconds to run every benchmark for, 10 by default
+# BENCH_CLIENTS  number of pgbench clients, 1 by default
+# BENCH_FILTER   only run the benchmarks whose names match this pattern
+# BENCH_BASELINE CSV of an earlier run, adds the change in tps to the output
+# PG_CONFIG      pg_config of the postgres to find psql and pgbench with
+
+set -e
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+BENCH_TIME=${BENCH_TIME:-10}
+BENCH_CLIENTS=${BENCH_CLIENTS:-1}
+BENCH_FILTER=${BENCH_FILTER:-.}
+PG_CONFIG=${PG_CONFIG:-pg_config}
+
+BINDIR=$("$PG_CONFIG" --bindir)
+PSQL="$BINDIR/psql"
+PGBENCH="$BINDIR/pgbench"
+
+"$PSQL" -X -q -v ON_ERROR_STOP=1 -f "$BENCH_DIR/setup.sql" >&2
+
+results=$(mktemp)
+trap 'rm -f "$results"' EXIT
+
+echo "benchmark,clients,duration_s,transactions,tps,latency_ms" > "$results"
+
+for script in "$BENCH_DIR"/scripts/*.sql; do
+  name=$(basename "$script" .sql)
+
+  if ! echo "$name" | grep -q -e "$BENCH_FILTER"; then
+    continue
+  fi
+
+  echo "running $name" >&2
+
+  "$PGBENCH" -n -f "$script" -c "$BENCH_CLIENTS" -T "$BENCH_TIME" 2>&1 |
+    awk -v name="$name" -v clients="$BENCH_CLIENTS" \
+      -v duration="$BENCH_TIME" '
+      /^number of transactions actually processed:/ {
+        split($6, processed, "/"); transactions = processed[1]
+      }
+      /^latency average/ { latency = $4 }
+      /^tps/ { tps = $3 }
+      END {
+        if (tps == "") {
+          print "pgbench failed for " name > "/dev/stderr"
+          exit 1
+        }
+        printf "%s,%s,%s,%s,%s,%s\n", name, clients, duration, transactions,
+          tps, latency
+      }' >> "$results"
+done
+
+if [ -n "$BENCH_BASELINE" ]; then
+  # Join on the benchmark name, adding the tps of the baseline and the change
+  # from it in percent.
+  awk -F, -v OFS=, '
+    NR == FNR { if (FNR > 1) baseline[$1] = $5; next }
+    FNR == 1 { print $0, "baseline_tps", "change_pct"; next }
+    $1 in baseline && baseline[$1] > 0 {
+      print $0, baseline[$1], sprintf("%.1f", ($5 / baseline[$1] - 1) * 100)
+      next
+    }
+    { print $0, "", "" }' "$BENCH_BASELINE" "$results"
+else
+  cat "$results"
+fi
@@ -0,0 +1 @@
+SELECT count(pljs_bench.array_in(a)) FROM pljs_bench.bench_values;
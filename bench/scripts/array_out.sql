@@ -0,0 +1 @@
+SELECT count(pljs_bench.array_out(i)) FROM pljs_bench.bench_values;
@@ -0,0 +1 @@
+SELECT count(pljs_bench.empty()) FROM generate_series(1, 1000);
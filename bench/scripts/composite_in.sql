@@ -0,0 +1 @@
+SELECT count(pljs_bench.composite_in(c)) FROM pljs_bench.bench_values;
@@ -0,0 +1 @@
+SELECT count(pljs_bench.composite_out(i)) FROM pljs_bench.bench_values;
@@ -0,0 +1 @@
+SELECT pljs_bench.cursor_scan();
@@ -0,0 +1 @@
+SELECT count(pljs_bench.int_in(i)) FROM pljs_bench.bench_values;
@@ -0,0 +1 @@
+SELECT count(pljs_bench.int_out(i)) FROM pljs_bench.bench_values;
@@ -0,0 +1 @@
+SELECT count(pljs_bench.jsonb_in(j)) FROM pljs_bench.bench_values;
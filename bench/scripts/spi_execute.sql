@@ -0,0 +1 @@
+SELECT pljs_bench.execute_loop(100);
@@ -0,0 +1 @@
+SELECT pljs_bench.plan_loop(100);
@@ -0,0 +1 @@
+SELECT count(pljs_bench.text_in(t)) FROM pljs_bench.bench_values;
@@ -0,0 +1 @@
+UPDATE pljs_bench.wide SET c1 = c1 + 1;
@@ -0,0 +1,94 @@
+-- Objects used by the benchmarks, recreated by every run of `make bench`.
+CREATE EXTENSION IF NOT EXISTS pljs;
+
+DROP SCHEMA IF EXISTS pljs_bench CASCADE;
+CREATE SCHEMA pljs_bench;
+SET search_path = pljs_bench;
+
+CREATE TYPE point3 AS (x integer, y integer, label text);
+
+CREATE TABLE bench_values AS
+  SELECT i,
+      'value ' || i AS t,
+      jsonb_build_object('i', i, 'tags', jsonb_build_array('a', 'b', i)) AS j,
+      ARRAY[i, i + 1, i + 2, i + 3, i + 4] AS a,
+      ROW(i, -i, 'point ' || i)::point3 AS c
+    FROM generate_series(1, 1000) AS i;
+ANALYZE bench_values;
+
+-- call overhead
+CREATE FUNCTION empty() RETURNS void AS $$ $$ LANGUAGE pljs;
+
+-- conversions from postgres to javascript
+CREATE FUNCTION int_in(v integer) RETURNS void AS $$ $$ LANGUAGE pljs;
+CREATE FUNCTION text_in(v text) RETURNS void AS $$ $$ LANGUAGE pljs;
+CREATE FUNCTION jsonb_in(v jsonb) RETURNS void AS $$ $$ LANGUAGE pljs;
+CREATE FUNCTION array_in(v integer[]) RETURNS void AS $$ $$ LANGUAGE pljs;
+CREATE FUNCTION composite_in(v point3) RETURNS void AS $$ $$ LANGUAGE pljs;
+
+-- conversions from javascript to postgres
+CREATE FUNCTION int_out(i integer) RETURNS integer AS
+$$ return i * 7; $$ LANGUAGE pljs;
+CREATE FUNCTION text_out(i integer) RETURNS text AS
+$$ return "value " + i; $$ LANGUAGE pljs;
+CREATE FUNCTION jsonb_out(i integer) RETURNS jsonb AS
+$$ return { i: i, tags: ["a", "b", i] }; $$ LANGUAGE pljs;
+CREATE FUNCTION array_out(i integer) RETURNS integer[] AS
+$$ return [i, i + 1, i + 2, i + 3, i + 4]; $$ LANGUAGE pljs;
+CREATE FUNCTION composite_out(i integer) RETURNS point3 AS
+$$ return { x: i, y: -i, label: "point " + i }; $$ LANGUAGE pljs;
+
+-- statements run through the SPI
+CREATE FUNCTION execute_loop(n integer) RETURNS integer AS
+$$
+  let total = 0;
+  for (let i = 0; i < n; i++) {
+    total += pljs.execute("SELECT $1::integer AS v", [i])[0].v;
+  }
+  return total;
+$$ LANGUAGE pljs;
+
+CREATE FUNCTION plan_loop(n integer) RETURNS integer AS
+$$
+  const plan = pljs.prepare("SELECT $1::integer AS v", ["integer"]);
+  let total = 0;
+  for (let i = 0; i < n; i++) {
+    total += plan.execute([i])[0].v;
+  }
+  plan.free();
+  return total;
+$$ LANGUAGE pljs;
+
+CREATE FUNCTION cursor_scan() RETURNS integer AS
+$$
+  const plan = pljs.prepare("SELECT i, t, j FROM pljs_bench.bench_values");
+  const cursor = plan.cursor();
+  let count = 0;
+  for (const row of cursor) {
+    count++;
+  }
+  cursor.close();
+  plan.free();
+  return count;
+$$ LANGUAGE pljs;
+
+-- row triggers on a wide table
+DO $$
+BEGIN
+  EXECUTE 'CREATE TABLE wide (id integer PRIMARY KEY, ' ||
+    (SELECT string_agg(format('c%s integer', n), ', ')
+       FROM generate_series(1, 50) AS n) || ')';
+  EXECUTE 'INSERT INTO wide SELECT id, ' ||
+    (SELECT string_agg('id', ', ') FROM generate_series(1, 50)) ||
+    ' FROM generate_series(1, 100) AS id';
+END
+$$;
+
+CREATE FUNCTION wide_trigger() RETURNS trigger AS
+$$
+  NEW.c50 = NEW.c1 + NEW.c2;
+  return NEW;
+$$ LANGUAGE pljs;
+
+CREATE TRIGGER wide_trigger BEFORE UPDATE ON wide
+  FOR EACH ROW EXECUTE FUNCTION wide_trigger();
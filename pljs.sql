@@ -11,3 +11,40 @@ CREATE OR REPLACE TRUSTED LANGUAGE pljs
  HANDLER pljs_call_handler
  INLINE pljs_inline_handler
  VALIDATOR pljs_call_validator;
+
+CREATE OR REPLACE FUNCTION pljs_shared_cache_stats(OUT hits bigint,
+  OUT misses bigint, OUT entries bigint, OUT bytes bigint) RETURNS record
+  AS 'MODULE_PATHNAME' LANGUAGE C STRICT;
+
+CREATE OR REPLACE FUNCTION pljs_stat_functions(OUT funcid oid,
+  OUT calls bigint, OUT total_ms float8, OUT compile_ms float8,
+  OUT args_conv_ms float8, OUT js_ms float8, OUT spi_ms float8,
+  OUT result_conv_ms float8, OUT peak_js_bytes bigint) RETURNS SETOF record
+  AS 'MODULE_PATHNAME' LANGUAGE C STRICT;
+
+CREATE OR REPLACE FUNCTION pljs_stat_functions_reset() RETURNS void
+  AS 'MODULE_PATHNAME' LANGUAGE C STRICT;
+
+REVOKE ALL ON FUNCTION pljs_stat_functions_reset() FROM PUBLIC;
+
+CREATE OR REPLACE VIEW pljs_stat_functions AS
+  SELECT s.funcid, n.nspname AS schemaname, p.proname AS funcname, s.calls,
+    s.total_ms, s.compile_ms, s.args_conv_ms, s.js_ms, s.spi_ms,
+    s.result_conv_ms, s.peak_js_bytes
+  FROM pljs_stat_functions() s
+  JOIN pg_proc p ON p.oid = s.funcid
+  JOIN pg_namespace n ON n.oid = p.pronamespace;
+
+CREATE OR REPLACE FUNCTION pljs_memory_usage(OUT user_ids oid[],
+  OUT contexts integer, OUT functions bigint, OUT malloc_bytes bigint,
+  OUT malloc_count bigint, OUT used_bytes bigint, OUT objects bigint,
+  OUT object_bytes bigint, OUT strings bigint, OUT string_bytes bigint,
+  OUT atoms bigint, OUT atom_bytes bigint, OUT js_functions bigint,
+  OUT bytecode_bytes bigint, OUT malloc_limit bigint) RETURNS SETOF record
+  AS 'MODULE_PATHNAME' LANGUAGE C STRICT;
+
+CREATE OR REPLACE FUNCTION pljs_gc() RETURNS bigint
+  AS 'MODULE_PATHNAME' LANGUAGE C STRICT;
+
+CREATE OR REPLACE FUNCTION pljs_preload() RETURNS bigint
+  AS 'MODULE_PATHNAME' LANGUAGE C STRICT;
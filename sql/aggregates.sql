@@ -0,0 +1,51 @@
+-- aggregates keep an internal state as a javascript value between rows
+CREATE FUNCTION js_collect_step(state internal, value text) RETURNS internal AS
+$$
+  if (state === null) {
+    state = { count: 0, seen: {} };
+  }
+  state.count++;
+  state.seen[value] = (state.seen[value] || 0) + 1;
+  return state;
+$$ LANGUAGE pljs;
+
+CREATE FUNCTION js_collect_final(state internal) RETURNS jsonb AS
+$$
+  return state;
+$$ LANGUAGE pljs;
+
+CREATE AGGREGATE js_collect(text) (
+  SFUNC = js_collect_step,
+  STYPE = internal,
+  FINALFUNC = js_collect_final
+);
+
+SELECT js_collect(v) FROM unnest(ARRAY['a', 'b', 'a', 'c', 'a']) AS v;
+
+SELECT g, js_collect(v::text)
+  FROM generate_series(1, 6) AS v, LATERAL (SELECT v % 2 AS g) AS groups
+  GROUP BY g ORDER BY g;
+
+-- no rows leaves the state null
+SELECT js_collect(v) FROM unnest(ARRAY[]::text[]) AS v;
+
+-- the context of a running aggregate is not evicted by a function of another
+-- role called between its transitions
+CREATE ROLE pljs_aggregate_role;
+CREATE FUNCTION js_aggregate_definer(value text) RETURNS text AS
+$$
+  return value;
+$$ LANGUAGE pljs SECURITY DEFINER;
+ALTER FUNCTION js_aggregate_definer(text) OWNER TO pljs_aggregate_role;
+
+SET pljs.max_cached_contexts = 1;
+SELECT js_collect(js_aggregate_definer(v))
+  FROM unnest(ARRAY['a', 'b', 'a']) AS v;
+RESET pljs.max_cached_contexts;
+
+DROP FUNCTION js_aggregate_definer(text);
+DROP ROLE pljs_aggregate_role;
+
+DROP AGGREGATE js_collect(text);
+DROP FUNCTION js_collect_final(internal);
+DROP FUNCTION js_collect_step(internal, text);
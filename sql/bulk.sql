@@ -0,0 +1,70 @@
+CREATE TABLE bulk_tbl (i integer NOT NULL, s text, d float8 DEFAULT 1.5);
+
+CREATE FUNCTION bulk_load() RETURNS text AS
+$$
+  let plan = pljs.prepare('INSERT INTO bulk_tbl (i, s) VALUES ($1, $2)', ['int', 'text']);
+  let rows = [];
+  for (let i = 0; i < 100; i++) {
+    rows.push([i, 'row ' + i]);
+  }
+  let inserted = plan.executeMany(rows);
+  plan.free();
+
+  let copied = pljs.copyFrom('bulk_tbl', ['i', 's'],
+                             [[100, 'copied'], { i: 101, s: null }, { i: 102 }]);
+  return inserted + ' ' + copied;
+$$ LANGUAGE pljs;
+
+SELECT bulk_load();
+SELECT count(*), sum(i), count(s), min(d), max(d) FROM bulk_tbl;
+
+-- a failing row rolls back the whole batch
+CREATE FUNCTION bulk_fail() RETURNS text AS
+$$
+  let plan = pljs.prepare('INSERT INTO bulk_tbl (i) VALUES ($1)', ['int']);
+  let result = [];
+  try {
+    plan.executeMany([[200], [null]]);
+  } catch (e) {
+    result.push(e.message);
+  }
+  try {
+    pljs.copyFrom('bulk_tbl', ['i'], [[201], [null]]);
+  } catch (e) {
+    result.push(e.message);
+  }
+  try {
+    pljs.copyFrom('bulk_tbl', ['nope'], [[1]]);
+  } catch (e) {
+    result.push(e.message);
+  }
+  plan.free();
+  return result.join('; ');
+$$ LANGUAGE pljs;
+
+SELECT bulk_fail();
+SELECT count(*) FROM bulk_tbl WHERE i >= 200;
+
+-- without columns every column is filled, and checked for privileges
+CREATE ROLE bulk_role;
+GRANT INSERT (i) ON bulk_tbl TO bulk_role;
+CREATE FUNCTION bulk_copy_all() RETURNS text AS
+$$
+  try {
+    return String(pljs.copyFrom('bulk_tbl', [], [[300, 'all', 2.5]]));
+  } catch (e) {
+    return e.message;
+  }
+$$ LANGUAGE pljs;
+
+SELECT bulk_copy_all();
+SET ROLE bulk_role;
+SELECT bulk_copy_all();
+RESET ROLE;
+SELECT i, s, d FROM bulk_tbl WHERE i >= 300;
+
+DROP FUNCTION bulk_load();
+DROP FUNCTION bulk_fail();
+DROP FUNCTION bulk_copy_all();
+DROP TABLE bulk_tbl;
+DROP ROLE bulk_role;
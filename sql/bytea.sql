@@ -74,7 +74,8 @@ DO $$
   const res = pljs.execute(`select $1::bytea`, [test]);
   const result = res[0].bytea;
 
-  if (result === test) {
+  if (result instanceof Uint8Array &&
+      String.fromCharCode.apply(null, result) === test) {
     pljs.elog(INFO, 'OK');
   } else {
     pljs.elog(WARNING, 'FAIL');
@@ -0,0 +1,31 @@
+-- functions can be loaded from stored bytecode by a new backend
+SET pljs.bytecode_cache = on;
+CREATE FUNCTION bytecode_add(a integer, b integer) RETURNS integer AS
+$$
+  return a + b;
+$$ LANGUAGE pljs;
+
+SELECT bytecode_add(1, 2);
+
+\c
+SET pljs.bytecode_cache = on;
+SELECT bytecode_add(3, 4);
+
+-- a changed function does not use the stale bytecode
+CREATE OR REPLACE FUNCTION bytecode_add(a integer, b integer) RETURNS integer AS
+$$
+  return a * b;
+$$ LANGUAGE pljs;
+
+SELECT bytecode_add(3, 4);
+
+-- the bytecode of a dropped function is removed
+SELECT 'bytecode_add'::regproc::oid AS fn_oid \gset
+SELECT count(*) FROM pg_ls_dir('pljs_bytecode') AS f
+  WHERE f = (SELECT oid FROM pg_database WHERE datname = current_database())
+    || '_' || :fn_oid || '.bc';
+
+DROP FUNCTION bytecode_add(integer, integer);
+SELECT count(*) FROM pg_ls_dir('pljs_bytecode') AS f
+  WHERE f = (SELECT oid FROM pg_database WHERE datname = current_database())
+    || '_' || :fn_oid || '.bc';
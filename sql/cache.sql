@@ -0,0 +1,31 @@
+-- replacing a function only evicts that function, the context stays warm
+CREATE FUNCTION cache_set(v text) RETURNS void AS
+$$
+  pljs.data = { value: v };
+$$ LANGUAGE pljs;
+
+CREATE FUNCTION cache_version() RETURNS integer AS
+$$
+  return 1;
+$$ LANGUAGE pljs;
+
+SELECT cache_set('warm');
+SELECT cache_version();
+
+CREATE OR REPLACE FUNCTION cache_version() RETURNS integer AS
+$$
+  return 2;
+$$ LANGUAGE pljs;
+
+SELECT cache_version();
+
+CREATE FUNCTION cache_get() RETURNS text AS
+$$
+  return pljs.data.value;
+$$ LANGUAGE pljs;
+
+SELECT cache_get();
+
+DROP FUNCTION cache_set(text);
+DROP FUNCTION cache_version();
+DROP FUNCTION cache_get();
@@ -0,0 +1,37 @@
+CREATE FUNCTION cache_limits_a() RETURNS integer AS $$ return 1; $$ LANGUAGE pljs;
+CREATE FUNCTION cache_limits_b() RETURNS integer AS $$ return 2; $$ LANGUAGE pljs;
+CREATE FUNCTION cache_limits_c() RETURNS integer AS $$ return 3; $$ LANGUAGE pljs;
+CREATE FUNCTION cache_limits_counter() RETURNS integer AS
+$$
+  globalThis.counter = (globalThis.counter || 0) + 1;
+  return globalThis.counter;
+$$ LANGUAGE pljs;
+
+-- the least recently used functions are evicted
+SET pljs.max_cached_functions = 2;
+SELECT cache_limits_a(), cache_limits_b(), cache_limits_c();
+SELECT functions FROM pljs_memory_usage();
+SELECT cache_limits_a();
+SELECT functions FROM pljs_memory_usage();
+RESET pljs.max_cached_functions;
+
+-- the least recently used contexts are evicted, along with their globals
+CREATE ROLE pljs_cache_role;
+SET pljs.max_cached_contexts = 1;
+SELECT cache_limits_counter();
+SELECT cache_limits_counter();
+SET ROLE pljs_cache_role;
+SELECT cache_limits_counter();
+RESET ROLE;
+SELECT user_ids = ARRAY['pljs_cache_role'::regrole::oid] AS role_context
+  FROM pljs_memory_usage();
+SELECT cache_limits_counter();
+SELECT user_ids = ARRAY[current_user::regrole::oid] AS own_context
+  FROM pljs_memory_usage();
+RESET pljs.max_cached_contexts;
+
+DROP ROLE pljs_cache_role;
+DROP FUNCTION cache_limits_a();
+DROP FUNCTION cache_limits_b();
+DROP FUNCTION cache_limits_c();
+DROP FUNCTION cache_limits_counter();
@@ -4,3 +4,33 @@ DO LANGUAGE pljs $$
   pljs.elog(NOTICE,JSON.stringify(jres));
 $$;
 DROP TYPE acomp;
+
+-- row types that change are converted with their new columns
+CREATE TYPE shaped AS (a int, b text);
+CREATE FUNCTION shaped_json(s shaped) RETURNS text AS
+$$
+  return JSON.stringify(s);
+$$ LANGUAGE pljs;
+SELECT shaped_json(ROW(1, 'one')::shaped);
+ALTER TYPE shaped ADD ATTRIBUTE c int;
+SELECT shaped_json(ROW(2, 'two', 3)::shaped);
+ALTER TYPE shaped DROP ATTRIBUTE b;
+SELECT shaped_json(ROW(4, 5)::shaped);
+DROP FUNCTION shaped_json(shaped);
+DROP TYPE shaped;
+
+-- arrays of composites with nulls and varlena columns before later columns
+CREATE TYPE wide AS (a text, b int, c text, d int);
+CREATE FUNCTION wide_json(w wide[]) RETURNS text AS
+$$
+  return JSON.stringify(w);
+$$ LANGUAGE pljs;
+SELECT wide_json(ARRAY[ROW('x', NULL, 'yy', 1), ROW(NULL, 2, NULL, 3)]::wide[]);
+SET pljs.lazy_rows = on;
+DO $$
+  const rows = pljs.execute("SELECT 'x' AS a, NULL::int AS b, 'yy' AS c, 4 AS d");
+  pljs.elog(NOTICE, rows[0].d, rows[0].a, rows[0].b);
+$$ LANGUAGE pljs;
+RESET pljs.lazy_rows;
+DROP FUNCTION wide_json(wide[]);
+DROP TYPE wide;
@@ -0,0 +1,85 @@
+SET timezone = 'UTC';
+SET datestyle = 'ISO, YMD';
+
+-- timestamps are converted to and from Date
+CREATE FUNCTION timestamp_iso(t timestamptz) RETURNS text AS
+$$
+  return t.toISOString();
+$$ LANGUAGE pljs;
+SELECT timestamp_iso('2024-01-02 03:04:05.678+00');
+SELECT timestamp_iso('1969-12-31 23:59:59.999+00');
+CREATE FUNCTION timestamp_later(t timestamp) RETURNS timestamp AS
+$$
+  return new Date(t.getTime() + 1000);
+$$ LANGUAGE pljs;
+SELECT timestamp_later('2024-01-02 03:04:05.678');
+CREATE FUNCTION timestamp_echo(t timestamptz) RETURNS timestamptz AS
+$$
+  return t;
+$$ LANGUAGE pljs;
+SELECT timestamp_echo('infinity');
+SELECT timestamp_echo('-infinity');
+CREATE FUNCTION timestamp_from(v text) RETURNS timestamptz AS
+$$
+  return v === 'epoch' ? 0 : v;
+$$ LANGUAGE pljs;
+SELECT timestamp_from('2024-05-06 07:08:09+02');
+SELECT timestamp_from('epoch');
+
+-- dates are converted to Date at midnight UTC
+CREATE FUNCTION date_next(d date) RETURNS date AS
+$$
+  return new Date(d.getTime() + 86400000);
+$$ LANGUAGE pljs;
+SELECT date_next('2024-02-28');
+SELECT date_next('2024-02-29');
+CREATE FUNCTION date_iso(d date) RETURNS text AS
+$$
+  return d.toISOString();
+$$ LANGUAGE pljs;
+SELECT date_iso('1900-01-01');
+
+-- uuids are converted to and from strings
+CREATE FUNCTION uuid_describe(u uuid) RETURNS text AS
+$$
+  return typeof u + ' ' + u;
+$$ LANGUAGE pljs;
+SELECT uuid_describe('A0EEBC99-9C0B-4EF8-BB6D-6BB9BD380A11');
+CREATE FUNCTION uuid_echo(u uuid) RETURNS uuid AS
+$$
+  return u.toUpperCase();
+$$ LANGUAGE pljs;
+SELECT uuid_echo('a0eebc99-9c0b-4ef8-bb6d-6bb9bd380a11');
+
+-- numerics follow pljs.numeric_conversion
+CREATE FUNCTION numeric_describe(n numeric) RETURNS text AS
+$$
+  return typeof n + ' ' + n;
+$$ LANGUAGE pljs;
+CREATE FUNCTION numeric_echo(n numeric) RETURNS numeric AS
+$$
+  return n;
+$$ LANGUAGE pljs;
+SELECT numeric_describe(12345678901234567890123);
+SET pljs.numeric_conversion = 'bigint';
+SELECT numeric_describe(12345678901234567890123);
+SELECT numeric_describe(-42.000);
+SELECT numeric_describe(1.5);
+SELECT numeric_echo(12345678901234567890123);
+SET pljs.numeric_conversion = 'string';
+SELECT numeric_describe(0.1000000000000000000001);
+SELECT numeric_echo(123456789.123456789123456789);
+RESET pljs.numeric_conversion;
+
+DROP FUNCTION timestamp_iso(timestamptz);
+DROP FUNCTION timestamp_later(timestamp);
+DROP FUNCTION timestamp_echo(timestamptz);
+DROP FUNCTION timestamp_from(text);
+DROP FUNCTION date_next(date);
+DROP FUNCTION date_iso(date);
+DROP FUNCTION uuid_describe(uuid);
+DROP FUNCTION uuid_echo(uuid);
+DROP FUNCTION numeric_describe(numeric);
+DROP FUNCTION numeric_echo(numeric);
+RESET datestyle;
+RESET timezone;
@@ -79,3 +79,89 @@ CREATE FUNCTION prep1() RETURNS void AS $$
   }
 $$ LANGUAGE pljs STRICT;
 SELECT prep1();
+
+-- iterating over cursors, prefetching a few rows at a time
+CREATE FUNCTION cursor_iterate() RETURNS text AS $$
+  let plan = pljs.prepare("SELECT i FROM generate_series(1, 10) AS t(i)");
+  let seen = [];
+
+  for (const row of plan.cursor()) {
+    seen.push(row.i);
+  }
+
+  let cursor = plan.cursor();
+  let first = cursor.fetch();
+  let rest = cursor.fetch(2);
+  let next = cursor.fetch();
+  cursor.close();
+  plan.free();
+
+  return [seen.join(','), first.i, rest.map(r => r.i).join(','), next.i].join(' ');
+$$ LANGUAGE pljs;
+SET pljs.cursor_batch_size = 3;
+SELECT cursor_iterate();
+RESET pljs.cursor_batch_size;
+DROP FUNCTION cursor_iterate();
+
+-- plans that can only scan forward mix fetching one row and several rows
+CREATE FUNCTION cursor_forward_only() RETURNS text AS $$
+  let plan = pljs.prepare("SELECT (row_number() OVER (ORDER BY i))::int AS i " +
+                          "FROM generate_series(1, 10) AS t(i)");
+  let cursor = plan.cursor();
+  let result = [];
+
+  result.push(cursor.fetch().i);
+  result.push(cursor.fetch(4).map(r => r.i).join(','));
+  cursor.move(2);
+  result.push(cursor.fetch().i);
+  cursor.move(1);
+  result.push(cursor.fetch(5).map(r => r.i).join(','));
+  result.push(cursor.fetch() === undefined);
+
+  try {
+    cursor.fetch(-1);
+  } catch (e) {
+    result.push(e.message);
+  }
+
+  cursor.close();
+  plan.free();
+
+  return result.join(' ');
+$$ LANGUAGE pljs;
+SET pljs.cursor_batch_size = 3;
+SELECT cursor_forward_only();
+RESET pljs.cursor_batch_size;
+DROP FUNCTION cursor_forward_only();
+
+-- fetching never runs in a subtransaction, errors of rows cannot be caught
+CREATE FUNCTION cursor_error() RETURNS text AS $$
+  let plan = pljs.prepare("SELECT 10 / (i - 3) AS i FROM generate_series(1, 5) AS t(i)");
+  let cursor = plan.cursor();
+  try {
+    cursor.fetch(5);
+  } catch (e) {
+    return 'caught: ' + e.message;
+  }
+  return 'done';
+$$ LANGUAGE pljs;
+SELECT cursor_error();
+DROP FUNCTION cursor_error();
+
+-- cursors let go of portals closed by statements
+CREATE FUNCTION cursor_closed() RETURNS text AS $$
+  let plan = pljs.prepare("SELECT i FROM generate_series(1, 5) AS t(i)");
+  let cursor = plan.cursor();
+  cursor.fetch(1);
+  pljs.execute('CLOSE "' + cursor.name + '"');
+  try {
+    cursor.fetch(1);
+  } catch (e) {
+    return 'caught: ' + e.message;
+  } finally {
+    plan.free();
+  }
+  return 'done';
+$$ LANGUAGE pljs;
+SELECT cursor_closed();
+DROP FUNCTION cursor_closed();
@@ -0,0 +1,41 @@
+CREATE FUNCTION gc_garbage(n integer) RETURNS integer AS
+$$
+  let garbage = [];
+  for (let i = 0; i < n; i++) {
+    let a = { i: i, s: 'garbage ' + i };
+    a.self = a;
+    garbage.push(a);
+  }
+  return garbage.length;
+$$ LANGUAGE pljs;
+
+SHOW pljs.gc_threshold;
+
+-- without a threshold, garbage is only collected when asked to
+SET pljs.gc_threshold = 0;
+SHOW pljs.gc_threshold;
+SELECT gc_garbage(10000);
+SELECT pljs_gc() > 0 AS freed;
+
+-- collected once the transaction ends
+SET pljs.gc_at_transaction_end = on;
+SELECT gc_garbage(10000);
+SELECT pljs_gc() AS freed;
+
+BEGIN;
+SELECT gc_garbage(10000);
+ROLLBACK;
+SELECT pljs_gc() AS freed;
+
+RESET pljs.gc_at_transaction_end;
+RESET pljs.gc_threshold;
+SHOW pljs.gc_threshold;
+
+-- only superusers can change it, it applies to the runtimes of every role
+CREATE ROLE gc_role;
+SET ROLE gc_role;
+SET pljs.gc_threshold = 0;
+RESET ROLE;
+DROP ROLE gc_role;
+
+DROP FUNCTION gc_garbage(integer);
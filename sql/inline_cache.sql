@@ -0,0 +1,16 @@
+-- a cached block still runs every time
+DO $$ globalThis.runs = (globalThis.runs || 0) + 1; pljs.elog(NOTICE, 'run', globalThis.runs); $$ LANGUAGE pljs;
+DO $$ globalThis.runs = (globalThis.runs || 0) + 1; pljs.elog(NOTICE, 'run', globalThis.runs); $$ LANGUAGE pljs;
+DO $$ pljs.elog(NOTICE, 'another block', globalThis.runs); $$ LANGUAGE pljs;
+
+-- blocks are evicted once the cache is full
+SET pljs.inline_cache_size = 1;
+DO $$ pljs.elog(NOTICE, 'first'); $$ LANGUAGE pljs;
+DO $$ pljs.elog(NOTICE, 'second'); $$ LANGUAGE pljs;
+DO $$ pljs.elog(NOTICE, 'first'); $$ LANGUAGE pljs;
+
+-- and not cached at all without a cache
+SET pljs.inline_cache_size = 0;
+DO $$ pljs.elog(NOTICE, 'uncached'); $$ LANGUAGE pljs;
+DO $$ pljs.elog(NOTICE, 'uncached'); $$ LANGUAGE pljs;
+RESET pljs.inline_cache_size;
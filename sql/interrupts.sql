@@ -0,0 +1,24 @@
+-- pljs.execution_timeout interrupts long running javascript
+SET pljs.execution_timeout = '1s';
+CREATE FUNCTION spin() RETURNS integer AS
+$$
+  for (;;) {}
+$$ LANGUAGE pljs;
+SELECT spin();
+
+-- catching the interrupt does not keep javascript running
+DO $$
+  for (;;) {
+    try {
+      for (;;) {}
+    } catch (e) {}
+  }
+$$ LANGUAGE pljs;
+RESET pljs.execution_timeout;
+
+-- statement_timeout cancels javascript through postgres
+SET statement_timeout = '100ms';
+SELECT spin();
+RESET statement_timeout;
+
+DROP FUNCTION spin();
@@ -18,3 +18,27 @@ COPY jsonbonly (data) FROM stdin;
 -- Call twice to test the function cache.
 SELECT get_key('ok', data) FROM jsonbonly;
 SELECT get_key('ok', data) FROM jsonbonly;
+
+CREATE FUNCTION jsonb_roundtrip(data jsonb) RETURNS jsonb
+LANGUAGE pljs IMMUTABLE STRICT
+AS $$
+  return data;
+$$;
+
+SELECT jsonb_roundtrip('{"a": [1, 2.5, "three", null, true], "b": {"c": {}}, "d": []}');
+SELECT jsonb_roundtrip('"scalar"');
+SELECT jsonb_roundtrip('42');
+
+CREATE FUNCTION jsonb_build() RETURNS jsonb
+LANGUAGE pljs IMMUTABLE
+AS $$
+  return {
+    n: 0.1 + 0.2,
+    big: 10n,
+    skip: undefined,
+    list: [undefined, NaN],
+    date: new Date(0)
+  };
+$$;
+
+SELECT jsonb_build();
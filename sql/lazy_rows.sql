@@ -0,0 +1,69 @@
+SET pljs.lazy_rows = on;
+
+CREATE TABLE lazy_tbl (i integer, d integer, s text);
+ALTER TABLE lazy_tbl DROP COLUMN d;
+INSERT INTO lazy_tbl VALUES (1, 'one'), (2, 'two');
+
+CREATE FUNCTION lazy_trigger() RETURNS trigger AS
+$$
+  pljs.elog(NOTICE, JSON.stringify(NEW));
+  pljs.elog(NOTICE, Object.keys(NEW).join(','));
+  NEW.s = NEW.s.toUpperCase();
+  return NEW;
+$$ LANGUAGE pljs;
+
+CREATE TRIGGER lazy_trigger BEFORE INSERT OR UPDATE ON lazy_tbl
+  FOR EACH ROW EXECUTE PROCEDURE lazy_trigger();
+
+INSERT INTO lazy_tbl VALUES (3, 'three');
+UPDATE lazy_tbl SET i = 20 WHERE i = 2;
+SELECT * FROM lazy_tbl ORDER BY i;
+
+CREATE FUNCTION lazy_select() RETURNS text AS
+$$
+  var rows = pljs.execute('SELECT i, s FROM lazy_tbl ORDER BY i');
+  var before = JSON.stringify(rows);
+  var row = rows[0];
+  row.extra = true;
+  delete row.s;
+  return [before, 's' in row, row.i, row.extra, row.hasOwnProperty('i')].join(' ');
+$$ LANGUAGE pljs;
+
+SELECT lazy_select();
+
+DROP TABLE lazy_tbl;
+DROP FUNCTION lazy_trigger();
+DROP FUNCTION lazy_select();
+
+-- triggers returning NEW only convert back the columns they may have changed
+CREATE TABLE lazy_modify (i integer, j jsonb, s text, t text);
+
+CREATE FUNCTION lazy_modify_trigger() RETURNS trigger AS
+$$
+  switch (NEW.s) {
+  case 'assign':
+    NEW.t = 'assigned';
+    break;
+  case 'in place':
+    NEW.j.changed = true;
+    break;
+  case 'delete':
+    delete NEW.t;
+    break;
+  }
+  return NEW;
+$$ LANGUAGE pljs;
+
+CREATE TRIGGER lazy_modify_trigger BEFORE INSERT OR UPDATE ON lazy_modify
+  FOR EACH ROW EXECUTE PROCEDURE lazy_modify_trigger();
+
+INSERT INTO lazy_modify VALUES
+  (1, '{"a": 1}', 'untouched', 'kept'),
+  (2, '{"a": 2}', 'assign', 'replaced'),
+  (3, '{"a": 3}', 'in place', 'kept'),
+  (4, '{"a": 4}', 'delete', 'removed');
+UPDATE lazy_modify SET i = i * 10 WHERE i <= 2;
+SELECT * FROM lazy_modify ORDER BY i;
+
+DROP TABLE lazy_modify;
+DROP FUNCTION lazy_modify_trigger();
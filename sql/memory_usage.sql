@@ -0,0 +1,39 @@
+CREATE FUNCTION memory_garbage(n integer) RETURNS integer AS
+$$
+  let garbage = [];
+  for (let i = 0; i < n; i++) {
+    let a = { i: i, s: 'garbage ' + i };
+    let b = { a: a };
+    a.b = b;
+    garbage.push(a);
+  }
+  return garbage.length;
+$$ LANGUAGE pljs;
+
+SELECT memory_garbage(10000);
+
+SELECT cardinality(user_ids) > 0 AS has_roles, contexts > 0 AS has_contexts,
+  functions > 0 AS has_functions, malloc_bytes > 0 AS malloc,
+  used_bytes > 0 AS used, objects > 0 AS objects, strings > 0 AS strings,
+  atoms > 0 AS atoms, js_functions > 0 AS js_functions,
+  bytecode_bytes > 0 AS bytecode,
+  malloc_limit = current_setting('pljs.memory_limit')::bigint * 1024 * 1024
+    AS memory_limit
+  FROM pljs_memory_usage();
+
+-- the cycles left behind are only freed by the garbage collector
+SELECT pljs_gc() > 0 AS freed;
+SELECT pljs_gc() >= 0 AS freed;
+
+-- roles without pg_read_all_stats only see their own context
+CREATE ROLE memory_role;
+SET ROLE memory_role;
+SELECT count(*) FROM pljs_memory_usage();
+SELECT memory_garbage(10);
+SELECT user_ids = ARRAY['memory_role'::regrole]::oid[] AS own_role, contexts,
+  functions
+  FROM pljs_memory_usage();
+RESET ROLE;
+DROP ROLE memory_role;
+
+DROP FUNCTION memory_garbage(integer);
@@ -0,0 +1,50 @@
+-- pljs functions can run in parallel workers
+CREATE TABLE parallel_tbl AS SELECT i FROM generate_series(1, 10000) AS i;
+ANALYZE parallel_tbl;
+
+CREATE FUNCTION js_parallel_filter(i integer) RETURNS boolean AS
+$$
+  return i % 1000 === 0;
+$$ LANGUAGE pljs PARALLEL SAFE;
+
+-- statements run without subtransactions in parallel workers
+CREATE FUNCTION js_parallel_lookup(i integer) RETURNS integer AS
+$$
+  return pljs.execute("SELECT $1::integer * 2 AS doubled", [i])[0].doubled;
+$$ LANGUAGE pljs PARALLEL SAFE;
+
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+
+EXPLAIN (COSTS OFF)
+  SELECT count(*) FROM parallel_tbl WHERE js_parallel_filter(i);
+SELECT count(*) FROM parallel_tbl WHERE js_parallel_filter(i);
+SELECT sum(js_parallel_lookup(i)) FROM parallel_tbl WHERE js_parallel_filter(i);
+
+-- without a subtransaction, a failing statement cannot be caught, and the
+-- error comes from whichever process ran into it first
+CREATE FUNCTION js_parallel_fail(i integer) RETURNS boolean AS
+$$
+  try {
+    pljs.execute("SELECT 1 / ($1::integer % 1000) AS x", [i]);
+  } catch (e) {
+    return false;
+  }
+  return true;
+$$ LANGUAGE pljs PARALLEL SAFE;
+
+\set VERBOSITY terse
+SELECT count(*) FROM parallel_tbl WHERE js_parallel_fail(i);
+\set VERBOSITY default
+
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+
+DROP TABLE parallel_tbl;
+DROP FUNCTION js_parallel_filter(integer);
+DROP FUNCTION js_parallel_lookup(integer);
+DROP FUNCTION js_parallel_fail(integer);
@@ -0,0 +1,25 @@
+CREATE TABLE plan_tbl (i integer, s text);
+
+CREATE FUNCTION plan_insert(n integer) RETURNS integer AS
+$$
+  for (var i = 0; i < n; i++) {
+    pljs.execute('INSERT INTO plan_tbl VALUES ($1, $2)',
+                 [i, i % 2 ? null : 'even']);
+  }
+  return pljs.execute('SELECT count(*)::int AS c FROM plan_tbl WHERE s IS NULL AND i >= $1',
+                      [0])[0].c;
+$$ LANGUAGE pljs;
+
+SELECT plan_insert(10);
+
+-- plans are prepared again once the table changes
+ALTER TABLE plan_tbl ALTER COLUMN i TYPE text;
+SELECT plan_insert(4);
+SELECT i, s FROM plan_tbl WHERE i = '3';
+
+-- caching can be turned off
+SET pljs.plan_cache_size = 0;
+SELECT plan_insert(2);
+
+DROP FUNCTION plan_insert(integer);
+DROP TABLE plan_tbl;
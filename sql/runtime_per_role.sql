@@ -0,0 +1,26 @@
+CREATE ROLE pljs_runtime_role;
+CREATE FUNCTION runtime_answer() RETURNS integer AS
+$$
+  return 42;
+$$ LANGUAGE pljs;
+
+-- the context of the current role shares the runtime of the backend
+SELECT runtime_answer();
+
+-- a role with a runtime of its own, and a memory limit of its own
+SET pljs.runtime_per_role = on;
+SET pljs.memory_limit = 512;
+SET ROLE pljs_runtime_role;
+SELECT runtime_answer();
+RESET ROLE;
+RESET pljs.memory_limit;
+RESET pljs.runtime_per_role;
+
+SELECT cardinality(user_ids) AS contexts, functions,
+  malloc_limit / (1024 * 1024) AS memory_limit
+  FROM pljs_memory_usage() ORDER BY memory_limit;
+
+SELECT pljs_gc() >= 0 AS collected;
+
+DROP FUNCTION runtime_answer();
+DROP ROLE pljs_runtime_role;
@@ -0,0 +1,54 @@
+-- the shared bytecode cache makes room for new functions by evicting the
+-- least recently used ones, this needs a server started with
+-- shared_preload_libraries = 'pljs' and pljs.shared_cache_size = 1, without
+-- it the cache stays empty, see expected/shared_cache_1.out
+SET client_min_messages = warning;
+CREATE EXTENSION IF NOT EXISTS pljs;
+RESET client_min_messages;
+
+-- the bytecode of each of these functions takes up about 300kB
+DO $$
+BEGIN
+  FOR i IN 1..5 LOOP
+    EXECUTE format('CREATE FUNCTION shared_big_%s() RETURNS integer AS %L '
+                   'LANGUAGE pljs', i,
+                   format('return %s + "%s".length;', i, repeat('x', 300000)));
+  END LOOP;
+END
+$$;
+
+SELECT shared_big_1(), shared_big_2(), shared_big_3(), shared_big_4(),
+  shared_big_5();
+
+SELECT entries, bytes <= 1024 * 1024 AS within_budget
+  FROM pljs_shared_cache_stats();
+
+-- a new backend finds the functions used last, and not the evicted ones
+\c
+CREATE TEMP TABLE shared_before AS
+  SELECT hits, misses FROM pljs_shared_cache_stats();
+
+SELECT shared_big_5();
+SELECT shared_big_1();
+
+SELECT s.hits - b.hits AS hits, s.misses - b.misses AS misses
+  FROM pljs_shared_cache_stats() s, shared_before b;
+
+-- the bytecode of an older version of a function is dropped when it is
+-- looked up
+CREATE OR REPLACE FUNCTION shared_big_5() RETURNS integer AS
+$$
+  return 5;
+$$ LANGUAGE pljs;
+
+SELECT shared_big_5();
+
+SELECT s.hits - b.hits AS hits, s.misses - b.misses AS misses, s.entries,
+  s.bytes <= 1024 * 1024 AS within_budget
+  FROM pljs_shared_cache_stats() s, shared_before b;
+
+DROP FUNCTION shared_big_1();
+DROP FUNCTION shared_big_2();
+DROP FUNCTION shared_big_3();
+DROP FUNCTION shared_big_4();
+DROP FUNCTION shared_big_5();
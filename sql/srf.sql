@@ -0,0 +1,77 @@
+CREATE FUNCTION srf_yield(n integer) RETURNS SETOF integer AS
+$$
+  for (let i = 1; i <= n; i++) {
+    yield i;
+  }
+$$ LANGUAGE pljs;
+
+SELECT * FROM srf_yield(3);
+
+CREATE FUNCTION srf_array() RETURNS SETOF text AS
+$$
+  return ['a', 'b', null];
+$$ LANGUAGE pljs;
+
+SELECT * FROM srf_array();
+
+CREATE FUNCTION srf_return_next(n integer)
+RETURNS TABLE (i integer, s text) AS
+$$
+  for (let c = 1; c <= n; c++) {
+    pljs.return_next({ i: c, s: 'row ' + c });
+  }
+$$ LANGUAGE pljs;
+
+SELECT * FROM srf_return_next(2);
+
+CREATE TYPE srf_pair AS (a integer, b integer);
+
+CREATE FUNCTION srf_composite() RETURNS SETOF srf_pair AS
+$$
+  yield { a: 1, b: 2 };
+  pljs.return_next({ a: 3, b: 4 });
+  return [{ a: 5, b: 6 }];
+$$ LANGUAGE pljs;
+
+SELECT * FROM srf_composite();
+
+CREATE FUNCTION srf_not_set() RETURNS integer AS
+$$
+  pljs.return_next(1);
+  return 1;
+$$ LANGUAGE pljs;
+
+SELECT srf_not_set();
+
+-- functions called by a set returning function cannot add rows to its result
+CREATE FUNCTION srf_inner_return_next() RETURNS text AS
+$$
+  try {
+    pljs.return_next(99);
+  } catch (e) {
+    return e.message;
+  }
+  return 'stored';
+$$ LANGUAGE pljs;
+
+CREATE FUNCTION srf_outer() RETURNS SETOF integer AS
+$$
+  pljs.return_next(1);
+  pljs.elog(NOTICE, pljs.execute('SELECT srf_inner_return_next() AS r')[0].r);
+  pljs.return_next(2);
+$$ LANGUAGE pljs;
+
+SELECT * FROM srf_outer();
+
+-- rows that do not convert fail the statement, their errors cannot be caught
+CREATE FUNCTION srf_bad_row() RETURNS SETOF date AS
+$$
+  try {
+    pljs.return_next('not a date');
+  } catch (e) {
+    pljs.elog(NOTICE, 'caught: ' + e.message);
+  }
+  pljs.return_next('2024-01-02');
+$$ LANGUAGE pljs;
+
+SELECT * FROM srf_bad_row();
@@ -0,0 +1,40 @@
+CREATE FUNCTION start_setup() RETURNS void AS
+$$
+  globalThis.greeting = 'hello';
+$$ LANGUAGE pljs;
+CREATE FUNCTION start_greet() RETURNS text AS
+$$
+  return globalThis.greeting;
+$$ LANGUAGE pljs;
+CREATE FUNCTION start_add(a integer, b integer) RETURNS integer AS
+$$
+  return a + b;
+$$ LANGUAGE pljs;
+CREATE FUNCTION start_fail() RETURNS void AS
+$$
+  throw 'not started';
+$$ LANGUAGE pljs;
+
+-- the context is created ahead of the first call
+SET pljs.start_proc = 'start_setup';
+SET pljs.preload_functions = 'start_add, start_missing';
+SELECT pljs_preload();
+SELECT start_greet();
+SELECT start_add(1, 2);
+SELECT pljs_preload();
+RESET pljs.preload_functions;
+
+-- a context failing to start is not kept
+CREATE ROLE pljs_start_role;
+SET ROLE pljs_start_role;
+SET pljs.start_proc = 'start_fail';
+SELECT start_greet();
+RESET pljs.start_proc;
+SELECT start_greet() IS NULL AS not_started;
+RESET ROLE;
+
+DROP ROLE pljs_start_role;
+DROP FUNCTION start_setup();
+DROP FUNCTION start_greet();
+DROP FUNCTION start_add(integer, integer);
+DROP FUNCTION start_fail();
@@ -0,0 +1,39 @@
+CREATE FUNCTION stat_add(a integer, b integer) RETURNS integer AS
+$$
+  return a + b;
+$$ LANGUAGE pljs;
+
+CREATE FUNCTION stat_query() RETURNS integer AS
+$$
+  return pljs.execute('SELECT count(*)::int AS c FROM generate_series(1, 10)')[0].c;
+$$ LANGUAGE pljs;
+
+CREATE FUNCTION stat_rows(n integer) RETURNS SETOF integer AS
+$$
+  for (let i = 1; i <= n; i++) {
+    yield i;
+  }
+$$ LANGUAGE pljs;
+
+-- calls are only counted while tracking is on
+SELECT stat_add(1, 2);
+SELECT count(*) FROM pljs_stat_functions WHERE funcname LIKE 'stat\_%';
+
+SET pljs.track_functions = on;
+SELECT stat_add(i, i) FROM generate_series(1, 3) AS t(i);
+SELECT stat_query();
+SELECT * FROM stat_rows(3);
+
+SELECT funcname, calls, total_ms >= js_ms AS total, compile_ms >= 0 AS compile,
+  args_conv_ms >= 0 AS args, spi_ms > 0 AS spi, result_conv_ms >= 0 AS result,
+  peak_js_bytes >= 0 AS peak
+  FROM pljs_stat_functions WHERE funcname LIKE 'stat\_%' ORDER BY funcname;
+
+SELECT pljs_stat_functions_reset();
+SELECT count(*) FROM pljs_stat_functions WHERE funcname LIKE 'stat\_%';
+
+RESET pljs.track_functions;
+
+DROP FUNCTION stat_add(integer, integer);
+DROP FUNCTION stat_query();
+DROP FUNCTION stat_rows(integer);
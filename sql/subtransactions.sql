@@ -0,0 +1,74 @@
+CREATE TABLE subxact_tbl (i integer NOT NULL);
+
+CREATE FUNCTION subxact_insert(n integer) RETURNS integer AS
+$$
+  for (let i = 0; i < n; i++) {
+    pljs.execute('INSERT INTO subxact_tbl VALUES ($1)', [i]);
+  }
+  return pljs.execute('SELECT count(*)::int AS c FROM subxact_tbl')[0].c;
+$$ LANGUAGE pljs;
+
+CREATE FUNCTION subxact_catch(sql text) RETURNS text AS
+$$
+  try {
+    pljs.execute(sql);
+  } catch (e) {
+    return 'caught: ' + e.message;
+  }
+  return 'done';
+$$ LANGUAGE pljs;
+
+CREATE FUNCTION subxact_catch_plan(sql text, arg integer) RETURNS text AS
+$$
+  let plan = pljs.prepare(sql, ['int']);
+  try {
+    plan.execute([arg]);
+  } catch (e) {
+    return 'caught: ' + e.message;
+  } finally {
+    plan.free();
+  }
+  return 'done';
+$$ LANGUAGE pljs;
+
+-- every statement gets its own subtransaction by default
+SHOW pljs.execute_subtransactions;
+SELECT subxact_catch('SELECT 1 / 0');
+SELECT subxact_catch_plan('SELECT 1 / $1', 0);
+SELECT subxact_catch_plan('INSERT INTO subxact_tbl VALUES (NULLIF($1, 0))', 0);
+
+-- only statements that write get one
+SET pljs.execute_subtransactions = writes;
+SELECT subxact_catch_plan('INSERT INTO subxact_tbl VALUES (NULLIF($1, 0))', 0);
+SELECT subxact_catch_plan('SELECT 1 / $1', 0);
+SELECT subxact_catch_plan('SELECT 1 / $1', 1);
+-- whatever the number of their parameters
+SELECT subxact_catch('INSERT INTO subxact_tbl VALUES (NULL)');
+SELECT subxact_catch('SELECT 1 / 0');
+
+-- no statement gets one, errors abort the function and cannot be caught
+SET pljs.execute_subtransactions = off;
+SELECT subxact_insert(5);
+SELECT subxact_catch('SELECT 1 / 0');
+SELECT subxact_catch_plan('INSERT INTO subxact_tbl VALUES (NULLIF($1, 0))', 0);
+
+-- errors cannot be caught, no more javascript runs after a failed statement
+DO $$
+  try {
+    pljs.execute('SELECT 1 / 0');
+  } catch (e) {
+    pljs.elog(NOTICE, 'caught: ' + e.message);
+  } finally {
+    pljs.elog(NOTICE, 'finally');
+  }
+  pljs.elog(NOTICE, 'still running');
+  pljs.execute('INSERT INTO subxact_tbl VALUES (100)');
+$$ LANGUAGE pljs;
+SELECT count(*) FROM subxact_tbl;
+
+RESET pljs.execute_subtransactions;
+
+DROP FUNCTION subxact_insert(integer);
+DROP FUNCTION subxact_catch(text);
+DROP FUNCTION subxact_catch_plan(text, integer);
+DROP TABLE subxact_tbl;
@@ -0,0 +1,62 @@
+-- statement level triggers get their transition tables as NEW and OLD
+CREATE TABLE transition_tbl (i integer, s text);
+INSERT INTO transition_tbl SELECT g, 'row ' || g FROM generate_series(1, 5) g;
+
+CREATE FUNCTION transition_trigger() RETURNS trigger AS
+$$
+  let total = 0;
+  for (const row of NEW) {
+    total += row.i;
+  }
+  pljs.elog(NOTICE, TG_LEVEL, TG_OP, "rows:", NEW.length, "new total:", total);
+
+  const batch = OLD.fetch(2);
+  pljs.elog(NOTICE, "first batch:", JSON.stringify(batch));
+  pljs.elog(NOTICE, "second batch:", OLD.fetch(2).length);
+  pljs.elog(NOTICE, "next:", JSON.stringify(OLD.next()));
+  pljs.elog(NOTICE, "done:", OLD.next().done);
+
+  OLD.rewind();
+  pljs.elog(NOTICE, "rewound:", JSON.stringify(OLD.next().value));
+
+  // the transition tables can be queried by name as well
+  const changed = pljs.execute(
+    "SELECT count(*)::int AS n FROM new_rows n JOIN old_rows o USING (i) WHERE n.s <> o.s");
+  pljs.elog(NOTICE, "changed:", changed[0].n);
+
+  globalThis.saved_table = NEW;
+$$ LANGUAGE pljs;
+
+CREATE TRIGGER transition_trigger
+  AFTER UPDATE ON transition_tbl
+  REFERENCING NEW TABLE AS new_rows OLD TABLE AS old_rows
+  FOR EACH STATEMENT
+  EXECUTE FUNCTION transition_trigger();
+
+UPDATE transition_tbl SET s = upper(s) WHERE i > 1;
+
+-- a transition table can not be read once its trigger has returned
+DO $$
+  try {
+    saved_table.next();
+  } catch (e) {
+    pljs.elog(NOTICE, e.message);
+  }
+$$ LANGUAGE pljs;
+
+-- statement level triggers without transition tables still get undefined
+CREATE FUNCTION statement_trigger() RETURNS trigger AS
+$$
+  pljs.elog(NOTICE, TG_LEVEL, TG_OP, typeof NEW, typeof OLD);
+$$ LANGUAGE pljs;
+
+CREATE TRIGGER statement_trigger
+  AFTER DELETE ON transition_tbl
+  FOR EACH STATEMENT
+  EXECUTE FUNCTION statement_trigger();
+
+DELETE FROM transition_tbl WHERE i = 1;
+
+DROP TABLE transition_tbl;
+DROP FUNCTION transition_trigger();
+DROP FUNCTION statement_trigger();
@@ -0,0 +1,136 @@
+-- numeric arrays are plain arrays unless pljs.typed_arrays is on
+CREATE FUNCTION array_kind(a anyarray) RETURNS text AS
+$$
+  return [a.constructor.name, a.length, a[0]].join(' ');
+$$ LANGUAGE pljs;
+
+SELECT array_kind(ARRAY[1, 2, 3]::int4[]);
+
+CREATE FUNCTION array_methods(a int4[]) RETURNS text AS
+$$
+  a.push(4);
+  return Array.isArray(a) + ' ' + a.concat([5]).join(',');
+$$ LANGUAGE pljs;
+
+SELECT array_methods(ARRAY[1, 2, 3]);
+
+CREATE FUNCTION array_jsonb(a float8[]) RETURNS jsonb AS
+$$
+  return a;
+$$ LANGUAGE pljs;
+
+SELECT array_jsonb(ARRAY[1.5, 2.5]);
+
+CREATE FUNCTION array_json(a int4[]) RETURNS json AS
+$$
+  return { a: a };
+$$ LANGUAGE pljs;
+
+SELECT array_json(ARRAY[1, 2, 3]);
+
+CREATE FUNCTION array_record(a int4[], OUT j jsonb, OUT b int4[]) AS
+$$
+  return { j: a, b: a };
+$$ LANGUAGE pljs;
+
+SELECT * FROM array_record(ARRAY[1, 2]);
+
+SET pljs.typed_arrays = on;
+
+SELECT array_kind(ARRAY[1.5, 2.5]::float8[]);
+SELECT array_kind(ARRAY[1.5, 2.5]::float4[]);
+SELECT array_kind(ARRAY[1, 2, 3]::int4[]);
+SELECT array_kind(ARRAY[1, 2]::int2[]);
+SELECT array_kind(ARRAY[1, 2]::int8[]);
+SELECT array_kind(ARRAY[1, NULL]::int4[]);
+SELECT array_kind(ARRAY['a', 'b']::text[]);
+
+CREATE FUNCTION scale_float8(a float8[], f float8) RETURNS float8[] AS
+$$
+  for (var i = 0; i < a.length; i++) {
+    a[i] *= f;
+  }
+  return a;
+$$ LANGUAGE pljs;
+
+SELECT scale_float8(ARRAY[1, 2.5, 3], 2);
+
+CREATE FUNCTION int32_to_float8() RETURNS float8[] AS
+$$
+  return new Int32Array([1, 2, 3]);
+$$ LANGUAGE pljs;
+
+SELECT int32_to_float8();
+
+CREATE FUNCTION empty_int4() RETURNS int4[] AS
+$$
+  return new Int32Array(0);
+$$ LANGUAGE pljs;
+
+SELECT empty_int4();
+
+CREATE FUNCTION bytea_kind(b bytea) RETURNS text AS
+$$
+  return b.constructor.name + ' ' + Array.from(b).join(',');
+$$ LANGUAGE pljs;
+
+SELECT bytea_kind('\x00ff10'::bytea);
+
+CREATE FUNCTION bytea_echo(b bytea) RETURNS bytea AS
+$$
+  return b;
+$$ LANGUAGE pljs;
+
+SELECT bytea_echo('\xdeadbeef'::bytea);
+
+CREATE FUNCTION float64_bytea() RETURNS bytea AS
+$$
+  return new Float64Array([1, 2]);
+$$ LANGUAGE pljs;
+
+SELECT length(float64_bytea());
+
+-- typed arrays are still written to json and jsonb as arrays
+SELECT array_jsonb(ARRAY[1.5, 2.5]);
+SELECT array_json(ARRAY[1, 2, 3]);
+SELECT * FROM array_record(ARRAY[1, 2]);
+
+-- arguments are converted with the intrinsic constructors
+CREATE FUNCTION replace_constructors() RETURNS void AS
+$$
+  globalThis.saved = [Date, Float64Array];
+  Date = function () { return 'replaced'; };
+  Float64Array = function () { return 'replaced'; };
+$$ LANGUAGE pljs;
+
+CREATE FUNCTION restore_constructors() RETURNS void AS
+$$
+  Date = saved[0];
+  Float64Array = saved[1];
+$$ LANGUAGE pljs;
+
+CREATE FUNCTION intrinsic_kind(d date, a float8[]) RETURNS text AS
+$$
+  return (d instanceof saved[0]) + ' ' + (a instanceof saved[1]);
+$$ LANGUAGE pljs;
+
+SELECT replace_constructors();
+SELECT intrinsic_kind('2020-01-01', ARRAY[1.5]);
+SELECT restore_constructors();
+
+RESET pljs.typed_arrays;
+
+DROP FUNCTION array_kind(anyarray);
+DROP FUNCTION scale_float8(float8[], float8);
+DROP FUNCTION int32_to_float8();
+DROP FUNCTION empty_int4();
+DROP FUNCTION bytea_kind(bytea);
+DROP FUNCTION bytea_echo(bytea);
+DROP FUNCTION float64_bytea();
+DROP FUNCTION array_methods(int4[]);
+DROP FUNCTION array_jsonb(float8[]);
+DROP FUNCTION array_json(int4[]);
+DROP FUNCTION array_record(int4[]);
+DROP FUNCTION replace_constructors();
+DROP FUNCTION restore_constructors();
+DROP FUNCTION intrinsic_kind(date, float8[]);
@@ -0,0 +1,107 @@
+-- window functions read their arguments through pljs.window
+CREATE TABLE window_tbl (id integer, grp text, v integer);
+INSERT INTO window_tbl VALUES
+  (1, 'a', 10), (2, 'a', 20), (3, 'a', NULL), (4, 'b', 5), (5, 'b', 7);
+
+-- the partition local value is kept from one row to the next
+CREATE FUNCTION js_running_sum(v integer) RETURNS bigint AS
+$$
+  let state = pljs.window.getPartitionLocal();
+  if (state === undefined) {
+    state = { sum: 0 };
+    pljs.window.setPartitionLocal(state);
+  }
+  state.sum += pljs.window.getArgCurrent(0) || 0;
+  return state.sum;
+$$ LANGUAGE pljs WINDOW;
+
+-- rows outside of the partition are undefined
+CREATE FUNCTION js_lag(v integer) RETURNS integer AS
+$$
+  const previous = pljs.window.getArgInPartition(0, -1,
+    pljs.window.SEEK_CURRENT, false);
+  return previous === undefined ? -1 : previous;
+$$ LANGUAGE pljs WINDOW;
+
+CREATE FUNCTION js_frame_ends(v integer) RETURNS text AS
+$$
+  const w = pljs.window;
+  return w.getArgInFrame(0, 0, w.SEEK_HEAD) + ".." +
+    w.getArgInFrame(0, 0, w.SEEK_TAIL);
+$$ LANGUAGE pljs WINDOW;
+
+CREATE FUNCTION js_position() RETURNS text AS
+$$
+  const w = pljs.window;
+  return (w.getCurrentPosition() + 1) + "/" + w.getPartitionRowCount();
+$$ LANGUAGE pljs WINDOW;
+
+SELECT id, grp, v,
+    js_running_sum(v) OVER w AS sum,
+    js_lag(v) OVER w AS lag,
+    js_frame_ends(v) OVER w AS frame,
+    js_position() OVER w AS position
+  FROM window_tbl
+  WINDOW w AS (PARTITION BY grp ORDER BY id)
+  ORDER BY id;
+
+-- arguments are checked
+CREATE FUNCTION js_bad_argument(v integer) RETURNS text AS
+$$
+  try {
+    pljs.window.getArgCurrent(1);
+  } catch (e) {
+    return e.message;
+  }
+$$ LANGUAGE pljs WINDOW;
+
+SELECT js_bad_argument(v) OVER () FROM window_tbl WHERE id = 1;
+
+-- pljs.window is only available in window functions
+DO $$
+  try {
+    pljs.window.getCurrentPosition();
+  } catch (e) {
+    pljs.elog(NOTICE, e.message);
+  }
+$$ LANGUAGE pljs;
+
+-- errors raised by the window cannot be caught, nothing has cleaned up after
+-- them, so the statement fails
+CREATE FUNCTION js_mark_back(v integer) RETURNS text AS
+$$
+  const w = pljs.window;
+  const position = w.getCurrentPosition();
+  w.setMarkPosition(position);
+  try {
+    w.setMarkPosition(position - 1);
+  } catch (e) {
+    return e.message;
+  }
+  return "moved";
+$$ LANGUAGE pljs WINDOW;
+
+SELECT id, js_mark_back(v) OVER (ORDER BY id) FROM window_tbl WHERE id <= 2 ORDER BY id;
+
+-- including errors of the argument expressions, evaluated as they are read
+CREATE FUNCTION js_catch_argument(v integer) RETURNS text AS
+$$
+  try {
+    pljs.window.getArgCurrent(0);
+  } catch (e) {
+    return "caught";
+  }
+  return "read";
+$$ LANGUAGE pljs WINDOW;
+
+SELECT id, js_catch_argument(10 / (v - v)) OVER (ORDER BY id)
+  FROM window_tbl WHERE id <= 2 ORDER BY id;
+
+DROP TABLE window_tbl;
+DROP FUNCTION js_running_sum(integer);
+DROP FUNCTION js_lag(integer);
+DROP FUNCTION js_frame_ends(integer);
+DROP FUNCTION js_position();
+DROP FUNCTION js_bad_argument(integer);
+DROP FUNCTION js_mark_back(integer);
+DROP FUNCTION js_catch_argument(integer);
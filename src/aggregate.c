@@ -0,0 +1,123 @@
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "utils/memutils.h"
+
+#include "deps/quickjs/quickjs.h"
+
+#include "pljs.h"
+
+/**
+ * @brief Marks a #pljs_aggregate_state, `internal` values of other languages
+ * are something else entirely.
+ */
+#define AGGREGATE_STATE_MAGIC 0x706c6a73
+
+/**
+ * @brief State of an aggregate kept as a javascript value.
+ *
+ * Passed around as an `internal` datum, and lives in the memory context of
+ * the aggregate, which releases the value once the aggregate is done with
+ * it.  The state pins its context, so that the context is neither evicted
+ * nor freed between transitions.
+ */
+typedef struct pljs_aggregate_state {
+  uint32 magic;   // #AGGREGATE_STATE_MAGIC
+  JSContext *ctx; // the context the value belongs to
+  JSValue value;
+  MemoryContextCallback callback;
+} pljs_aggregate_state;
+
+/**
+ * @brief Releases the value of a state once its aggregate context goes away.
+ */
+static void aggregate_state_release(void *arg) {
+  pljs_aggregate_state *state = (pljs_aggregate_state *)arg;
+
+  JS_FreeValue(state->ctx, state->value);
+  state->value = JS_UNDEFINED;
+
+  pljs_context_unpin(state->ctx);
+}
+
+/**
+ * @brief Converts an `internal` argument holding an aggregate state.
+ *
+ * The state is handed to javascript as the value it holds, without any
+ * conversion.
+ * @param ctx #JSContext - the context of the function being called
+ * @param datum #Datum - the argument, a #pljs_aggregate_state
+ * @returns #JSValue of the state.
+ */
+JSValue pljs_aggregate_state_get(JSContext *ctx, Datum datum) {
+  pljs_aggregate_state *state = (pljs_aggregate_state *)DatumGetPointer(datum);
+
+  if (state->magic != AGGREGATE_STATE_MAGIC) {
+    ereport(ERROR, errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+            errmsg("internal value was not created by pljs"));
+  }
+
+  // Another role calling the same aggregate has a context of its own.
+  if (state->ctx != ctx) {
+    ereport(ERROR, errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+            errmsg("aggregate state belongs to another javascript context"));
+  }
+
+  return JS_DupValue(ctx, state->value);
+}
+
+/**
+ * @brief Converts a value returned as `internal` to an aggregate state.
+ *
+ * Only aggregates have a memory context for their state to live in, so an
+ * `internal` value can only be returned by their transition functions.  The
+ * state passed in is updated in place when there is one, so that a state is
+ * only allocated once for every group.
+ * @param fcinfo #FunctionCallInfo - the call of the transition function
+ * @param ctx #JSContext - the context of the function being called
+ * @param previous #Datum - the state passed in, 0 if there was none
+ * @param value #JSValueConst - the value returned
+ * @param is_null @c bool * - set when the value is `null` or `undefined`
+ * @returns #Datum of the #pljs_aggregate_state.
+ */
+Datum pljs_aggregate_state_set(FunctionCallInfo fcinfo, JSContext *ctx,
+                               Datum previous, JSValueConst value,
+                               bool *is_null) {
+  MemoryContext aggregate_context;
+
+  if (!AggCheckCallContext(fcinfo, &aggregate_context)) {
+    ereport(ERROR, errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+            errmsg("internal values can only be returned by aggregate "
+                   "transition functions"));
+  }
+
+  if (JS_IsNull(value) || JS_IsUndefined(value)) {
+    *is_null = true;
+
+    return (Datum)0;
+  }
+
+  pljs_aggregate_state *state =
+      (pljs_aggregate_state *)DatumGetPointer(previous);
+
+  if (state != NULL && state->magic == AGGREGATE_STATE_MAGIC &&
+      state->ctx == ctx) {
+    JS_FreeValue(ctx, state->value);
+    state->value = JS_DupValue(ctx, value);
+
+    return PointerGetDatum(state);
+  }
+
+  state = MemoryContextAlloc(aggregate_context, sizeof(pljs_aggregate_state));
+
+  state->magic = AGGREGATE_STATE_MAGIC;
+  state->ctx = ctx;
+  state->value = JS_DupValue(ctx, value);
+  state->callback.func = aggregate_state_release;
+  state->callback.arg = state;
+
+  MemoryContextRegisterResetCallback(aggregate_context, &state->callback);
+  pljs_context_pin(ctx);
+
+  return PointerGetDatum(state);
+}
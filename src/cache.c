@@ -1,6 +1,11 @@
 #include "postgres.h"
 
+#include "catalog/pg_proc.h"
+#include "common/hashfn.h"
+#include "miscadmin.h"
 #include "utils/memutils.h"
+#include "utils/plancache.h"
+#include "utils/syscache.h"
 
 #include "pljs.h"
 
@@ -19,6 +24,30 @@ HTAB *pljs_context_HashTable = NULL;
  */
 MemoryContext cache_memory_context = NULL;
 
+/**
+ * @brief Generation of the cache.
+ *
+ * Incremented whenever anything is removed from the cache, which lets any
+ * #pljs_call_state that has been resolved against the cache know that it
+ * needs to be resolved again.
+ */
+uint64 pljs_cache_generation = 0;
+
+/**
+ * @brief Cached contexts, most recently used first.
+ */
+static dlist_head context_lru = DLIST_STATIC_INIT(context_lru);
+
+/**
+ * @brief Cached functions of every context, most recently used first.
+ */
+static dlist_head function_lru = DLIST_STATIC_INIT(function_lru);
+
+/**
+ * @brief Number of functions in #function_lru.
+ */
+static int cached_functions = 0;
+
 /**
  * @brief Initializes the cache #HTAB along with the #MemoryContext
  * where cached memory is allocated.
@@ -48,10 +77,27 @@ void pljs_cache_init(void) {
                   &context_ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
 }
 
+static void plan_cache_destroy(pljs_context_cache_value *ctx_hvalue);
+static void inline_cache_destroy(pljs_context_cache_value *ctx_hvalue);
+
 /**
  * @brief Clears all caches and recreates them.
  */
 void pljs_cache_reset(void) {
+  HASH_SEQ_STATUS status;
+  pljs_context_cache_value *ctx_hvalue;
+
+  pljs_cache_generation++;
+
+  // Saved plans and javascript contexts live outside of the cache memory
+  // context.
+  hash_seq_init(&status, pljs_context_HashTable);
+
+  while ((ctx_hvalue = (pljs_context_cache_value *)hash_seq_search(
+              &status)) != NULL) {
+    pljs_cache_context_remove(ctx_hvalue->user_id);
+  }
+
   hash_destroy(pljs_context_HashTable);
   MemoryContextDelete(cache_memory_context);
   pljs_cache_init();
@@ -101,24 +147,80 @@ void pljs_cache_context_add(Oid user_id, JSContext *ctx) {
       hash_create("PLJS Function Cache",
                   128, // Arbitrary guess at functions per user.
                   &function_ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+  // The plan cache is created when the first plan is cached.
+  hvalue->plan_hash_table = NULL;
+  dlist_init(&hvalue->plan_lru);
+
+  // So is the inline cache, when the first `DO` block is cached.
+  hvalue->inline_hash_table = NULL;
+  dlist_init(&hvalue->inline_lru);
+
+  dlist_push_head(&context_lru, &hvalue->lru_node);
+}
+
+/**
+ * @brief Removes a function from the cache, releasing the javascript
+ * function.
+ */
+static void function_cache_remove(pljs_context_cache_value *ctx_hvalue,
+                                  pljs_function_cache_value *value) {
+  Oid fn_oid = value->fn_oid;
+
+  JS_FreeValue(value->ctx, value->fn);
+
+  if (value->prosrc) {
+    pfree(value->prosrc);
+  }
+
+  dlist_delete(&value->lru_node);
+  cached_functions--;
+
+  hash_search(ctx_hvalue->function_hash_table, &fn_oid, HASH_REMOVE, NULL);
 }
 
 /**
  * @brief Removes a #pljs_context_cache_value for a `user_id`.
  *
- * Removes a cache entry from the cache by `user_id`.
+ * Removes a cache entry from the cache by `user_id`, and frees its functions,
+ * plans and javascript context.  Must not be called while the context is
+ * running.
  * @param user_id #Oid
  */
 void pljs_cache_context_remove(Oid user_id) {
-  bool found;
+  HASH_SEQ_STATUS status;
+  pljs_function_cache_value *value;
 
   pljs_context_cache_value *hvalue = (pljs_context_cache_value *)hash_search(
-      pljs_context_HashTable, (void *)&user_id, HASH_REMOVE, &found);
+      pljs_context_HashTable, (void *)&user_id, HASH_FIND, NULL);
 
-  if (hvalue) {
-    // Destroys the cache and its #MemoryContext in the process.
-    hash_destroy(hvalue->function_hash_table);
+  if (hvalue == NULL) {
+    return;
   }
+
+  JSContext *ctx = hvalue->ctx;
+
+  pljs_cache_generation++;
+
+  plan_cache_destroy(hvalue);
+  inline_cache_destroy(hvalue);
+
+  hash_seq_init(&status, hvalue->function_hash_table);
+
+  while ((value = (pljs_function_cache_value *)hash_seq_search(&status)) !=
+         NULL) {
+    function_cache_remove(hvalue, value);
+  }
+
+  // Destroying the hash table leaves the memory context it was created in.
+  hash_destroy(hvalue->function_hash_table);
+  MemoryContextDelete(hvalue->function_memory_context);
+
+  dlist_delete(&hvalue->lru_node);
+
+  hash_search(pljs_context_HashTable, (void *)&user_id, HASH_REMOVE, NULL);
+
+  pljs_context_free(ctx);
 }
 
 /**
@@ -131,6 +233,10 @@ pljs_context_cache_value *pljs_cache_context_find(Oid user_id) {
   pljs_context_cache_value *value = (pljs_context_cache_value *)hash_search(
       pljs_context_HashTable, (void *)&user_id, HASH_FIND, NULL);
 
+  if (value) {
+    dlist_move_head(&context_lru, &value->lru_node);
+  }
+
   return value;
 }
 
@@ -140,8 +246,9 @@ pljs_context_cache_value *pljs_cache_context_find(Oid user_id) {
  * Adds a function by creating a #pljs_function_cache_value and populating
  * it from a #pljs_context.
  * @param context Pointer to #pljs_context
+ * @returns #pljs_function_cache_value of the new entry.
  */
-void pljs_cache_function_add(pljs_context *context) {
+pljs_function_cache_value *pljs_cache_function_add(pljs_context *context) {
   bool found;
 
   pljs_context_cache_value *ctx_hvalue =
@@ -179,6 +286,12 @@ void pljs_cache_function_add(pljs_context *context) {
 
   // Switch back to the calling memory context.
   MemoryContextSwitchTo(old_memory_context);
+
+  hvalue->context_entry = ctx_hvalue;
+  dlist_push_head(&function_lru, &hvalue->lru_node);
+  cached_functions++;
+
+  return hvalue;
 }
 
 /**
@@ -205,9 +318,184 @@ pljs_function_cache_value *pljs_cache_function_find(Oid user_id, Oid fn_oid) {
   pljs_function_cache_value *value = (pljs_function_cache_value *)hash_search(
       ctx_hvalue->function_hash_table, &fn_oid, HASH_FIND, &found);
 
+  if (value) {
+    pljs_cache_function_touch(value);
+  }
+
   return value;
 }
 
+/**
+ * @brief Marks a cached function, and its context, as the most recently used.
+ *
+ * @param value #pljs_function_cache_value - the function being called
+ */
+void pljs_cache_function_touch(pljs_function_cache_value *value) {
+  dlist_move_head(&function_lru, &value->lru_node);
+  dlist_move_head(&context_lru, &value->context_entry->lru_node);
+}
+
+/**
+ * @brief Finds the least recently used context that can be evicted.
+ *
+ * Contexts pinned by aggregate states or partition locals of window functions
+ * are kept, as the next call of the aggregate or window function needs them.
+ * @returns #pljs_context_cache_value of the context, or `NULL` if every
+ * context is pinned.
+ */
+static pljs_context_cache_value *context_evictable(void) {
+  dlist_iter iter;
+
+  dlist_reverse_foreach(iter, &context_lru) {
+    pljs_context_cache_value *ctx_hvalue =
+        dlist_container(pljs_context_cache_value, lru_node, iter.cur);
+
+    if (!pljs_context_pinned(ctx_hvalue->ctx)) {
+      return ctx_hvalue;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Evicts the least recently used contexts and functions over the
+ * limits.
+ *
+ * Keeps no more than `pljs.max_cached_contexts` contexts and
+ * `pljs.max_cached_functions` functions cached, a limit of 0 meaning no
+ * limit.  Pinned contexts are not evicted, and can leave more contexts
+ * cached than the limit.  Must only be called when no javascript is running,
+ * as evicting a context frees it.
+ */
+void pljs_cache_evict(void) {
+  if (configuration.max_cached_contexts > 0) {
+    pljs_context_cache_value *ctx_hvalue;
+
+    while (hash_get_num_entries(pljs_context_HashTable) >
+               configuration.max_cached_contexts &&
+           (ctx_hvalue = context_evictable()) != NULL) {
+      pljs_cache_context_remove(ctx_hvalue->user_id);
+    }
+  }
+
+  if (configuration.max_cached_functions > 0) {
+    while (cached_functions > configuration.max_cached_functions) {
+      pljs_function_cache_value *value = dlist_tail_element(
+          pljs_function_cache_value, lru_node, &function_lru);
+
+      pljs_cache_generation++;
+      function_cache_remove(value->context_entry, value);
+    }
+  }
+}
+
+/**
+ * @brief Finds a #pljs_function_cache_value that is still current.
+ *
+ * Finds the function for a `user_id` and checks it against the function's
+ * `pg_proc` tuple.  If the function has been changed since it was cached,
+ * the stale entry is removed from the cache and `NULL` is returned.
+ * @param user_id #Oid
+ * @param proctuple #HeapTuple - the `pg_proc` tuple of the function
+ * @returns #pljs_function_cache_value that is found, or `NULL` if not found.
+ */
+pljs_function_cache_value *
+pljs_cache_function_find_current(Oid user_id, HeapTuple proctuple) {
+  Oid fn_oid = ((Form_pg_proc)GETSTRUCT(proctuple))->oid;
+
+  pljs_function_cache_value *value = pljs_cache_function_find(user_id, fn_oid);
+
+  if (value == NULL) {
+    return NULL;
+  }
+
+  if (value->fn_xmin == HeapTupleHeaderGetRawXmin(proctuple->t_data) &&
+      ItemPointerEquals(&value->fn_tid, &proctuple->t_self)) {
+    return value;
+  }
+
+  // The function has been replaced, so evict only this function.
+  pljs_cache_function_remove(user_id, fn_oid);
+
+  return NULL;
+}
+
+/**
+ * @brief Removes a #pljs_function_cache_value for a `user_id` and `fn_oid`.
+ *
+ * Releases the javascript function and removes the entry from the cache,
+ * leaving the javascript context and all other functions in place.
+ * @param user_id #Oid
+ * @param fn_oid #Oid
+ */
+void pljs_cache_function_remove(Oid user_id, Oid fn_oid) {
+  pljs_context_cache_value *ctx_hvalue = pljs_cache_context_find(user_id);
+
+  if (ctx_hvalue == NULL) {
+    return;
+  }
+
+  pljs_function_cache_value *value = (pljs_function_cache_value *)hash_search(
+      ctx_hvalue->function_hash_table, &fn_oid, HASH_FIND, NULL);
+
+  if (value == NULL) {
+    return;
+  }
+
+  function_cache_remove(ctx_hvalue, value);
+
+  pljs_cache_generation++;
+}
+
+/**
+ * @brief Syscache callback for `pg_proc` invalidations.
+ *
+ * Called when a `pg_proc` entry is invalidated.  Cached functions are only
+ * evicted when they are next looked up and found to be stale, but any call
+ * site that has been resolved against a function that matches the
+ * invalidation needs to be resolved again, so the cache generation is bumped.
+ * The stored bytecode of a changed or dropped function is removed, as it
+ * would never be read again.
+ */
+void pljs_cache_function_invalidate(Datum arg, int cacheid, uint32 hashvalue) {
+  HASH_SEQ_STATUS context_status;
+  pljs_context_cache_value *ctx_hvalue;
+  bool matched = false;
+
+  if (pljs_context_HashTable == NULL) {
+    return;
+  }
+
+  hash_seq_init(&context_status, pljs_context_HashTable);
+
+  while ((ctx_hvalue = (pljs_context_cache_value *)hash_seq_search(
+              &context_status)) != NULL) {
+    HASH_SEQ_STATUS function_status;
+    pljs_function_cache_value *value;
+
+    hash_seq_init(&function_status, ctx_hvalue->function_hash_table);
+
+    while ((value = (pljs_function_cache_value *)hash_seq_search(
+                &function_status)) != NULL) {
+      // A hash value of 0 means that every entry has been invalidated.
+      if (hashvalue == 0 || value->hashvalue == hashvalue) {
+        matched = true;
+      }
+
+      // Resetting every entry does not mean that any of them changed.
+      if (hashvalue != 0 && value->hashvalue == hashvalue &&
+          configuration.bytecode_cache) {
+        pljs_storage_remove(value->fn_oid);
+      }
+    }
+  }
+
+  if (matched) {
+    pljs_cache_generation++;
+  }
+}
+
 /**
  * @brief Fills a #pljs_context from a #pljs_function_cache_value.
  *
@@ -223,6 +511,8 @@ void pljs_function_cache_to_context(pljs_context *context,
 
   context->function = (pljs_func *)palloc(sizeof(pljs_func));
   context->function->fn_oid = function_entry->fn_oid;
+  context->function->fn_xmin = function_entry->fn_xmin;
+  context->function->fn_tid = function_entry->fn_tid;
   context->function->user_id = function_entry->user_id;
   context->function->trigger = function_entry->trigger;
   context->js_function = function_entry->fn;
@@ -235,8 +525,7 @@ void pljs_function_cache_to_context(pljs_context *context,
 
   memcpy(context->function->proname, function_entry->proname, NAMEDATALEN);
 
-  context->function->prosrc = (char *)palloc(NAMEDATALEN);
-  memcpy(context->function->prosrc, function_entry->prosrc, NAMEDATALEN);
+  context->function->prosrc = pstrdup(function_entry->prosrc);
 }
 
 /**
@@ -253,6 +542,10 @@ void pljs_context_to_function_cache(pljs_function_cache_value *function_entry,
   function_entry->ctx = context->ctx;
 
   function_entry->fn_oid = context->function->fn_oid;
+  function_entry->fn_xmin = context->function->fn_xmin;
+  function_entry->fn_tid = context->function->fn_tid;
+  function_entry->hashvalue = GetSysCacheHashValue1(
+      PROCOID, ObjectIdGetDatum(context->function->fn_oid));
   function_entry->user_id = context->function->user_id;
   function_entry->trigger = context->function->trigger;
   function_entry->fn = context->js_function;
@@ -264,10 +557,368 @@ void pljs_context_to_function_cache(pljs_function_cache_value *function_entry,
 
   memcpy(function_entry->proname, context->function->proname, NAMEDATALEN);
 
-  function_entry->prosrc =
-      (char *)palloc(strlen(context->function->prosrc) + 1);
-  memcpy(function_entry->prosrc, context->function->prosrc,
-         strlen(context->function->prosrc));
+  function_entry->prosrc = pstrdup(context->function->prosrc);
 
   MemoryContextSwitchTo(old_context);
 }
+
+/**
+ * @brief Hashes the text of a query for the plan cache.
+ */
+static uint32 plan_cache_hash(const void *key, Size keysize) {
+  const char *sql = *(const char *const *)key;
+
+  return hash_bytes((const unsigned char *)sql, strlen(sql));
+}
+
+/**
+ * @brief Compares the text of two queries for the plan cache.
+ */
+static int plan_cache_compare(const void *key1, const void *key2,
+                              Size keysize) {
+  return strcmp(*(const char *const *)key1, *(const char *const *)key2);
+}
+
+/**
+ * @brief Frees a cached plan and removes it from the plan cache.
+ */
+static void plan_cache_remove(pljs_context_cache_value *ctx_hvalue,
+                              pljs_plan_cache_value *entry) {
+  char *sql = (char *)entry->sql;
+  pljs_param_state *parstate = entry->parstate;
+
+  SPI_freeplan(entry->plan);
+
+  if (parstate->param_types) {
+    pfree(parstate->param_types);
+  }
+
+  pfree(parstate);
+
+  dlist_delete(&entry->lru_node);
+
+  hash_search(ctx_hvalue->plan_hash_table, &sql, HASH_REMOVE, NULL);
+
+  pfree(sql);
+}
+
+/**
+ * @brief Frees every cached plan of a context, along with the plan cache.
+ */
+static void plan_cache_destroy(pljs_context_cache_value *ctx_hvalue) {
+  if (ctx_hvalue->plan_hash_table == NULL) {
+    return;
+  }
+
+  while (!dlist_is_empty(&ctx_hvalue->plan_lru)) {
+    pljs_plan_cache_value *entry = dlist_head_element(
+        pljs_plan_cache_value, lru_node, &ctx_hvalue->plan_lru);
+
+    plan_cache_remove(ctx_hvalue, entry);
+  }
+
+  hash_destroy(ctx_hvalue->plan_hash_table);
+  ctx_hvalue->plan_hash_table = NULL;
+}
+
+/**
+ * @brief Evicts the least recently used plan that is not being executed.
+ *
+ * @returns @c bool of whether a plan was evicted.
+ */
+static bool plan_cache_evict(pljs_context_cache_value *ctx_hvalue) {
+  dlist_reverse_iter iter;
+
+  dlist_reverse_foreach(iter, &ctx_hvalue->plan_lru) {
+    pljs_plan_cache_value *entry =
+        dlist_container(pljs_plan_cache_value, lru_node, iter.cur);
+
+    if (entry->refcount == 0) {
+      plan_cache_remove(ctx_hvalue, entry);
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Finds or prepares a saved plan for a query.
+ *
+ * Plans are cached per javascript context by the text of the query, along
+ * with the parameter types inferred when the query was prepared.  The least
+ * recently used plan is evicted once `pljs.plan_cache_size` plans are
+ * cached.  The plan is held until #pljs_cache_plan_release is called.
+ * @param ctx #JSContext - the context executing the query
+ * @param sql @c char * - the text of the query
+ * @returns #pljs_plan_cache_value of the plan, or `NULL` if plans can not be
+ * cached.
+ */
+pljs_plan_cache_value *pljs_cache_plan_acquire(JSContext *ctx,
+                                               const char *sql) {
+  if (configuration.plan_cache_size <= 0) {
+    return NULL;
+  }
+
+  pljs_context_cache_value *ctx_hvalue = pljs_cache_context_find(GetUserId());
+
+  if (ctx_hvalue == NULL || ctx_hvalue->ctx != ctx) {
+    return NULL;
+  }
+
+  if (ctx_hvalue->plan_hash_table == NULL) {
+    HASHCTL plan_ctl = {0};
+
+    plan_ctl.keysize = sizeof(char *);
+    plan_ctl.entrysize = sizeof(pljs_plan_cache_value);
+    plan_ctl.hash = plan_cache_hash;
+    plan_ctl.match = plan_cache_compare;
+    plan_ctl.hcxt = ctx_hvalue->function_memory_context;
+
+    ctx_hvalue->plan_hash_table = hash_create(
+        "PLJS Plan Cache", configuration.plan_cache_size, &plan_ctl,
+        HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+  }
+
+  pljs_plan_cache_value *entry = (pljs_plan_cache_value *)hash_search(
+      ctx_hvalue->plan_hash_table, &sql, HASH_FIND, NULL);
+
+  // Plans whose relations have changed are prepared again, so that the
+  // parameter types are inferred again.
+  if (entry && entry->stale && entry->refcount == 0) {
+    plan_cache_remove(ctx_hvalue, entry);
+    entry = NULL;
+  }
+
+  if (entry) {
+    dlist_move_head(&ctx_hvalue->plan_lru, &entry->lru_node);
+    entry->refcount++;
+
+    return entry;
+  }
+
+  while (hash_get_num_entries(ctx_hvalue->plan_hash_table) >=
+         configuration.plan_cache_size) {
+    // Every cached plan is being executed, so do not cache this one.
+    if (!plan_cache_evict(ctx_hvalue)) {
+      return NULL;
+    }
+  }
+
+  // The parameter state is used again whenever the plan is revalidated, so
+  // it lives as long as the plan does.
+  pljs_param_state *parstate = MemoryContextAllocZero(
+      ctx_hvalue->function_memory_context, sizeof(pljs_param_state));
+  parstate->memory_context = ctx_hvalue->function_memory_context;
+
+  SPIPlanPtr plan;
+
+  PG_TRY();
+  {
+    plan = SPI_prepare_params(sql, pljs_variable_param_setup, parstate, 0);
+
+    if (plan == NULL) {
+      elog(ERROR, "SPI_prepare_params failed: %s",
+           SPI_result_code_string(SPI_result));
+    }
+
+    SPI_keepplan(plan);
+  }
+  PG_CATCH();
+  {
+    if (parstate->param_types) {
+      pfree(parstate->param_types);
+    }
+
+    pfree(parstate);
+
+    PG_RE_THROW();
+  }
+  PG_END_TRY();
+
+  entry = (pljs_plan_cache_value *)hash_search(ctx_hvalue->plan_hash_table,
+                                               &sql, HASH_ENTER, NULL);
+
+  // The key points at the caller's copy of the query until it is replaced.
+  entry->sql =
+      MemoryContextStrdup(ctx_hvalue->function_memory_context, sql);
+  entry->plan = plan;
+  entry->parstate = parstate;
+  entry->refcount = 1;
+  entry->stale = false;
+
+  dlist_push_head(&ctx_hvalue->plan_lru, &entry->lru_node);
+
+  return entry;
+}
+
+/**
+ * @brief Releases a plan held by #pljs_cache_plan_acquire.
+ */
+void pljs_cache_plan_release(pljs_plan_cache_value *entry) {
+  if (entry->refcount > 0) {
+    entry->refcount--;
+  }
+}
+
+/**
+ * @brief Relcache callback for relation invalidations.
+ *
+ * Saved plans are replanned by postgres when a relation changes, but the
+ * parameter types inferred for them are not, so any cached plan depending
+ * on the relation is marked stale, and prepared again when next used.
+ */
+void pljs_cache_plan_invalidate(Datum arg, Oid relid) {
+  HASH_SEQ_STATUS context_status;
+  pljs_context_cache_value *ctx_hvalue;
+
+  if (pljs_context_HashTable == NULL) {
+    return;
+  }
+
+  hash_seq_init(&context_status, pljs_context_HashTable);
+
+  while ((ctx_hvalue = (pljs_context_cache_value *)hash_seq_search(
+              &context_status)) != NULL) {
+    dlist_iter iter;
+
+    dlist_foreach(iter, &ctx_hvalue->plan_lru) {
+      pljs_plan_cache_value *entry =
+          dlist_container(pljs_plan_cache_value, lru_node, iter.cur);
+      ListCell *lc;
+
+      // An invalid relid means that every relation has been invalidated.
+      if (!OidIsValid(relid)) {
+        entry->stale = true;
+        continue;
+      }
+
+      foreach (lc, SPI_plan_get_plan_sources(entry->plan)) {
+        CachedPlanSource *plansource = (CachedPlanSource *)lfirst(lc);
+
+        if (list_member_oid(plansource->relationOids, relid)) {
+          entry->stale = true;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief Frees a compiled `DO` block and removes it from the inline cache.
+ */
+static void inline_cache_remove(pljs_context_cache_value *ctx_hvalue,
+                                pljs_inline_cache_value *entry) {
+  JS_FreeValue(ctx_hvalue->ctx, entry->bytecode);
+
+  dlist_delete(&entry->lru_node);
+
+  hash_search(ctx_hvalue->inline_hash_table, entry->hash, HASH_REMOVE, NULL);
+}
+
+/**
+ * @brief Frees every compiled `DO` block of a context, along with the inline
+ * cache.
+ */
+static void inline_cache_destroy(pljs_context_cache_value *ctx_hvalue) {
+  if (ctx_hvalue->inline_hash_table == NULL) {
+    return;
+  }
+
+  while (!dlist_is_empty(&ctx_hvalue->inline_lru)) {
+    pljs_inline_cache_value *entry = dlist_head_element(
+        pljs_inline_cache_value, lru_node, &ctx_hvalue->inline_lru);
+
+    inline_cache_remove(ctx_hvalue, entry);
+  }
+
+  hash_destroy(ctx_hvalue->inline_hash_table);
+  ctx_hvalue->inline_hash_table = NULL;
+}
+
+/**
+ * @brief Finds a compiled `DO` block by the hash of its source.
+ *
+ * @param ctx #JSContext - the context running the block
+ * @param hash @c uint8 * - hash of the source of the block
+ * @returns #JSValue of the compiled block, with a reference held by the
+ * caller, or `JS_UNDEFINED` if it is not cached.
+ */
+JSValue pljs_cache_inline_find(JSContext *ctx, const uint8 *hash) {
+  pljs_context_cache_value *ctx_hvalue = pljs_cache_context_find(GetUserId());
+
+  if (ctx_hvalue == NULL || ctx_hvalue->ctx != ctx ||
+      ctx_hvalue->inline_hash_table == NULL) {
+    return JS_UNDEFINED;
+  }
+
+  pljs_inline_cache_value *entry = (pljs_inline_cache_value *)hash_search(
+      ctx_hvalue->inline_hash_table, hash, HASH_FIND, NULL);
+
+  if (entry == NULL) {
+    return JS_UNDEFINED;
+  }
+
+  dlist_move_head(&ctx_hvalue->inline_lru, &entry->lru_node);
+
+  return JS_DupValue(ctx, entry->bytecode);
+}
+
+/**
+ * @brief Caches a compiled `DO` block.
+ *
+ * Blocks are cached per javascript context by the hash of their source, the
+ * least recently used block is evicted once `pljs.inline_cache_size` blocks
+ * are cached.  Blocks being run hold their own reference, so evicting them
+ * is safe.
+ * @param ctx #JSContext - the context the block was compiled in
+ * @param hash @c uint8 * - hash of the source of the block
+ * @param bytecode #JSValue - the compiled block, a reference is taken
+ */
+void pljs_cache_inline_add(JSContext *ctx, const uint8 *hash,
+                           JSValue bytecode) {
+  if (configuration.inline_cache_size <= 0) {
+    return;
+  }
+
+  pljs_context_cache_value *ctx_hvalue = pljs_cache_context_find(GetUserId());
+
+  if (ctx_hvalue == NULL || ctx_hvalue->ctx != ctx) {
+    return;
+  }
+
+  if (ctx_hvalue->inline_hash_table == NULL) {
+    HASHCTL inline_ctl = {0};
+
+    inline_ctl.keysize = STORAGE_HASH_LEN;
+    inline_ctl.entrysize = sizeof(pljs_inline_cache_value);
+    inline_ctl.hcxt = ctx_hvalue->function_memory_context;
+
+    ctx_hvalue->inline_hash_table =
+        hash_create("PLJS Inline Cache", configuration.inline_cache_size,
+                    &inline_ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+  }
+
+  bool found;
+  pljs_inline_cache_value *entry = (pljs_inline_cache_value *)hash_search(
+      ctx_hvalue->inline_hash_table, hash, HASH_FIND, &found);
+
+  if (found) {
+    return;
+  }
+
+  while (hash_get_num_entries(ctx_hvalue->inline_hash_table) >=
+         configuration.inline_cache_size) {
+    entry = dlist_tail_element(pljs_inline_cache_value, lru_node,
+                               &ctx_hvalue->inline_lru);
+
+    inline_cache_remove(ctx_hvalue, entry);
+  }
+
+  entry = (pljs_inline_cache_value *)hash_search(
+      ctx_hvalue->inline_hash_table, hash, HASH_ENTER, NULL);
+
+  entry->bytecode = JS_DupValue(ctx, bytecode);
+  dlist_push_head(&ctx_hvalue->inline_lru, &entry->lru_node);
+}
@@ -0,0 +1,294 @@
+#include "postgres.h"
+
+#include "access/table.h"
+#include "catalog/namespace.h"
+#include "commands/copy.h"
+#include "libpq/pqformat.h"
+#include "miscadmin.h"
+#include "nodes/makefuncs.h"
+#include "parser/parse_node.h"
+#include "utils/acl.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/rls.h"
+#include "utils/varlena.h"
+
+#include "deps/quickjs/quickjs.h"
+
+#include "pljs.h"
+
+/**
+ * @brief Signature starting binary `COPY` data, the terminating zero of the
+ * literal is part of it.
+ */
+static const char copy_signature[] = "PGCOPY\n\377\r\n";
+
+/**
+ * @brief State of a #pljs_copy_from in progress.
+ *
+ * Rows are encoded as binary `COPY` data only as `COPY` asks for more, so
+ * that no more than a few rows are ever held encoded at once.
+ */
+typedef struct pljs_copy_state {
+  JSContext *ctx;
+  JSValueConst rows;
+  uint32_t nrows;
+  uint32_t current; // next row to encode
+  int ncolumns;
+  JSAtom *atoms;    // column names, for rows given as objects
+  pljs_type *types; // column types
+  FmgrInfo *send;   // binary output function of every column
+  StringInfoData buffer;
+  int offset;    // position in the buffer of the data not yet read
+  bool finished; // whether the end of the data has been added
+  MemoryContext row_context;
+} pljs_copy_state;
+
+/**
+ * @brief The copy in progress, data source callbacks get no state of their
+ * own.
+ */
+static pljs_copy_state *current_copy = NULL;
+
+/**
+ * @brief Encodes the next row as binary `COPY` data.
+ *
+ * A row is either an array of values in the order of the columns, or an
+ * object with the columns as properties.
+ */
+static void copy_encode_row(pljs_copy_state *state) {
+  JSContext *ctx = state->ctx;
+  uint32_t r = state->current++;
+  JSValue row = JS_GetPropertyUint32(ctx, state->rows, r);
+  bool is_array = JS_IsArray(ctx, row);
+
+  if (!is_array && !JS_IsObject(row)) {
+    JS_FreeValue(ctx, row);
+
+    ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("row %u is neither an array nor an object", r));
+  }
+
+  MemoryContext old_context = MemoryContextSwitchTo(state->row_context);
+
+  pq_sendint16(&state->buffer, state->ncolumns);
+
+  for (int i = 0; i < state->ncolumns; i++) {
+    JSValue value = is_array ? JS_GetPropertyUint32(ctx, row, i)
+                             : JS_GetProperty(ctx, row, state->atoms[i]);
+    bool is_null = JS_IsNull(value) || JS_IsUndefined(value);
+    Datum datum = 0;
+
+    if (!is_null) {
+      datum = pljs_jsvalue_to_datum_typed(value, &state->types[i], ctx, NULL,
+                                          &is_null);
+    }
+
+    JS_FreeValue(ctx, value);
+
+    if (is_null) {
+      pq_sendint32(&state->buffer, -1);
+    } else {
+      bytea *bytes = SendFunctionCall(&state->send[i], datum);
+
+      pq_sendint32(&state->buffer, VARSIZE(bytes) - VARHDRSZ);
+      appendBinaryStringInfo(&state->buffer, VARDATA(bytes),
+                             VARSIZE(bytes) - VARHDRSZ);
+    }
+  }
+
+  MemoryContextSwitchTo(old_context);
+  MemoryContextReset(state->row_context);
+
+  JS_FreeValue(ctx, row);
+}
+
+/**
+ * @brief Data source of `COPY`, encoding rows as they are read.
+ *
+ * Returns at least `minread` bytes unless the data has ended.
+ */
+static int copy_read_data(void *outbuf, int minread, int maxread) {
+  pljs_copy_state *state = current_copy;
+
+  while (state->buffer.len - state->offset < minread && !state->finished) {
+    // Throw away what has already been read before adding more.
+    if (state->offset > 0) {
+      memmove(state->buffer.data, state->buffer.data + state->offset,
+              state->buffer.len - state->offset);
+      state->buffer.len -= state->offset;
+      state->offset = 0;
+    }
+
+    if (state->current < state->nrows) {
+      copy_encode_row(state);
+    } else {
+      pq_sendint16(&state->buffer, -1);
+      state->finished = true;
+    }
+  }
+
+  int length = Min(state->buffer.len - state->offset, maxread);
+
+  memcpy(outbuf, state->buffer.data + state->offset, length);
+  state->offset += length;
+
+  return length;
+}
+
+/**
+ * @brief Inserts rows into a table through `COPY`.
+ *
+ * The rows go through the same path as `COPY FROM`, which buffers them and
+ * inserts them in batches, while still firing triggers, checking
+ * constraints and updating indexes.  Values are converted to the types of
+ * their columns, and passed on in the binary format.
+ * @param ctx #JSContext - the context of the rows
+ * @param table @c char * - the name of the table, optionally qualified
+ * @param columns #JSValueConst - array of the names of the columns to fill,
+ * every column that `COPY` fills when empty
+ * @param rows #JSValueConst - array of rows, each either an array of values
+ * in the order of `columns`, or an object with the columns as properties
+ * @returns @c uint64 of the number of rows inserted.
+ */
+uint64 pljs_copy_from(JSContext *ctx, const char *table, JSValueConst columns,
+                      JSValueConst rows) {
+  pljs_copy_state state = {0};
+  pljs_copy_state *previous_copy = current_copy;
+  List *attnamelist = NIL;
+  List *columnnames = NIL;
+  ListCell *lc;
+  uint64 processed = 0;
+
+#if PG_VERSION_NUM >= 160000
+  List *names = stringToQualifiedNameList(table, NULL);
+#else
+  List *names = stringToQualifiedNameList(table);
+#endif
+
+  Relation rel =
+      table_openrv(makeRangeVarFromNameList(names), RowExclusiveLock);
+  Oid relid = RelationGetRelid(rel);
+  bool table_insert =
+      pg_class_aclcheck(relid, GetUserId(), ACL_INSERT) == ACLCHECK_OK;
+
+  // Row level security is not applied by COPY FROM.
+  if (check_enable_rls(relid, InvalidOid, false) == RLS_ENABLED) {
+    ereport(ERROR, errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+            errmsg("copyFrom is not supported for tables with row level "
+                   "security"));
+  }
+
+  uint32_t ncolumns = js_array_length(ctx, columns);
+
+  for (uint32_t i = 0; i < ncolumns; i++) {
+    JSValue column = JS_GetPropertyUint32(ctx, columns, i);
+    const char *name = JS_ToCString(ctx, column);
+
+    columnnames = lappend(columnnames, pstrdup(name ? name : ""));
+
+    JS_FreeCString(ctx, name);
+    JS_FreeValue(ctx, column);
+  }
+
+  // Without columns, COPY fills every column, which are all checked for
+  // privileges as well.
+  if (ncolumns == 0) {
+    TupleDesc tupdesc = RelationGetDescr(rel);
+
+    for (int i = 0; i < tupdesc->natts; i++) {
+      Form_pg_attribute attr = TupleDescAttr(tupdesc, i);
+
+      if (!attr->attisdropped && !attr->attgenerated) {
+        columnnames = lappend(columnnames, pstrdup(NameStr(attr->attname)));
+      }
+    }
+  }
+
+  state.ctx = ctx;
+  state.rows = rows;
+  state.nrows = js_array_length(ctx, rows);
+  state.ncolumns = list_length(columnnames);
+  state.atoms = palloc0(sizeof(JSAtom) * Max(state.ncolumns, 1));
+  state.types = palloc(sizeof(pljs_type) * Max(state.ncolumns, 1));
+  state.send = palloc(sizeof(FmgrInfo) * Max(state.ncolumns, 1));
+
+  PG_TRY();
+  {
+    foreach (lc, columnnames) {
+      int i = foreach_current_index(lc);
+      char *attname = lfirst(lc);
+      AttrNumber attnum = get_attnum(relid, attname);
+      Oid typsend;
+      bool typisvarlena;
+
+      if (attnum <= InvalidAttrNumber) {
+        ereport(ERROR, errcode(ERRCODE_UNDEFINED_COLUMN),
+                errmsg("column \"%s\" of relation \"%s\" does not exist",
+                       attname, RelationGetRelationName(rel)));
+      }
+
+      if (!table_insert && pg_attribute_aclcheck(relid, attnum, GetUserId(),
+                                                 ACL_INSERT) != ACLCHECK_OK) {
+        ereport(ERROR, errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+                errmsg("permission denied for table %s",
+                       RelationGetRelationName(rel)));
+      }
+
+      Oid typid = TupleDescAttr(RelationGetDescr(rel), attnum - 1)->atttypid;
+
+      state.atoms[i] = JS_NewAtom(ctx, attname);
+      pljs_type_fill(&state.types[i], typid);
+      getTypeBinaryOutputInfo(typid, &typsend, &typisvarlena);
+      fmgr_info(typsend, &state.send[i]);
+
+      attnamelist = lappend(attnamelist, makeString(attname));
+    }
+
+    state.row_context = AllocSetContextCreate(
+        CurrentMemoryContext, "PLJS copyFrom Context", ALLOCSET_SMALL_SIZES);
+
+    // The signature, no flags, and no header extension.
+    initStringInfo(&state.buffer);
+    appendBinaryStringInfo(&state.buffer, copy_signature,
+                           sizeof(copy_signature));
+    pq_sendint32(&state.buffer, 0);
+    pq_sendint32(&state.buffer, 0);
+
+    current_copy = &state;
+
+    ParseState *pstate = make_parsestate(NULL);
+    List *options =
+        list_make1(makeDefElem("format", (Node *)makeString("binary"), -1));
+
+    CopyFromState cstate = BeginCopyFrom(pstate, rel, NULL, NULL, false,
+                                         copy_read_data, attnamelist, options);
+
+    processed = CopyFrom(cstate);
+
+    EndCopyFrom(cstate);
+    free_parsestate(pstate);
+  }
+  PG_FINALLY();
+  {
+    current_copy = previous_copy;
+
+    for (int i = 0; i < state.ncolumns; i++) {
+      if (state.atoms[i] != JS_ATOM_NULL) {
+        JS_FreeAtom(ctx, state.atoms[i]);
+      }
+    }
+  }
+  PG_END_TRY();
+
+  MemoryContextDelete(state.row_context);
+  pfree(state.buffer.data);
+  pfree(state.atoms);
+  pfree(state.types);
+  pfree(state.send);
+
+  table_close(rel, NoLock);
+
+  return processed;
+}
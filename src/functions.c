@@ -2,23 +2,37 @@
 #include "postgres.h"
 
 #include "access/xact.h"
+#include "commands/portalcmds.h"
 #include "executor/spi.h"
 #include "nodes/params.h"
+#include "portability/instr_time.h"
 #include "parser/parse_type.h"
 #include "utils/elog.h"
 #include "utils/fmgrprotos.h"
+#include "utils/memutils.h"
+#include "utils/plancache.h"
 
 #include "pljs.h"
 #include "utils/palloc.h"
 #include "utils/resowner.h"
 
+// the plan of a statement run by pljs.execute.
+typedef struct pljs_execute_plan {
+  SPIPlanPtr plan;               // `NULL` until the statement is prepared
+  pljs_plan_cache_value *cached; // cache entry holding the plan, if any
+  pljs_param_state *parstate;    // types of the parameters of the plan
+} pljs_execute_plan;
+
 // local only functions for injecting into pljs
 static JSValue pljs_elog(JSContext *, JSValueConst, int, JSValueConst *);
 static JSValue pljs_execute(JSContext *, JSValueConst, int, JSValueConst *);
 static JSValue pljs_prepare(JSContext *, JSValueConst, int, JSValueConst *);
 static JSValue pljs_plan_execute(JSContext *, JSValueConst, int,
                                  JSValueConst *);
-static int pljs_execute_params(const char *, JSValue, JSContext *);
+static void execute_prepare(JSContext *, const char *, pljs_execute_plan *);
+static void execute_release(pljs_execute_plan *);
+static int pljs_execute_params(const char *, JSValue, JSContext *,
+                               pljs_execute_plan *);
 static JSValue pljs_plan_execute(JSContext *, JSValueConst, int,
                                  JSValueConst *);
 static JSValue pljs_plan_cursor(JSContext *, JSValueConst, int, JSValueConst *);
@@ -30,7 +44,14 @@ static JSValue pljs_plan_cursor_close(JSContext *, JSValueConst, int,
                                       JSValueConst *);
 static JSValue pljs_plan_cursor_to_string(JSContext *, JSValueConst, int,
                                           JSValueConst *);
+static JSValue pljs_plan_cursor_next(JSContext *, JSValueConst, int,
+                                     JSValueConst *);
+static JSValue pljs_plan_cursor_iterator(JSContext *, JSValueConst, int,
+                                         JSValueConst *);
+static void pljs_cursor_init(JSContext *);
 
+static JSValue pljs_plan_execute_many(JSContext *, JSValueConst, int,
+                                      JSValueConst *);
 static JSValue pljs_plan_free(JSContext *, JSValueConst, int, JSValueConst *);
 static JSValue pljs_plan_to_string(JSContext *, JSValueConst, int,
                                    JSValueConst *);
@@ -39,48 +60,68 @@ static JSValue pljs_rollback(JSContext *, JSValueConst, int, JSValueConst *);
 
 static JSValue pljs_find_function(JSContext *, JSValueConst, int,
                                   JSValueConst *);
+static JSValue pljs_return_next_row(JSContext *, JSValueConst, int,
+                                    JSValueConst *);
+static JSValue pljs_copy_from_rows(JSContext *, JSValueConst, int,
+                                   JSValueConst *);
 
-void pljs_setup_namespace(JSContext *ctx) {
-  // get a copy of the global object.
-  JSValue global_obj = JS_GetGlobalObject(ctx);
-
-  // set up the pljs namespace and functions.
-  JSValue pljs = JS_NewObject(ctx);
-  JS_SetPropertyStr(ctx, pljs, "elog",
-                    JS_NewCFunction(ctx, pljs_elog, "elog", 2));
-
-  JS_SetPropertyStr(ctx, pljs, "execute",
-                    JS_NewCFunction(ctx, pljs_execute, "execute", 2));
+// a javascript function defined like JS_SetPropertyStr would, enumerable
+// unlike with JS_CFUNC_DEF.
+#define PLJS_CFUNC_DEF(name, length, func)                                     \
+  {                                                                            \
+    name, JS_PROP_C_W_E, JS_DEF_CFUNC, 0, .u = {                               \
+      .func = {length, JS_CFUNC_generic, {.generic = func}}                    \
+    }                                                                          \
+  }
 
-  JS_SetPropertyStr(ctx, pljs, "prepare",
-                    JS_NewCFunction(ctx, pljs_prepare, "prepare", 2));
+// functions and properties of the pljs namespace.
+static const JSCFunctionListEntry pljs_namespace_functions[] = {
+    PLJS_CFUNC_DEF("elog", 2, pljs_elog),
+    PLJS_CFUNC_DEF("execute", 2, pljs_execute),
+    PLJS_CFUNC_DEF("prepare", 2, pljs_prepare),
+    PLJS_CFUNC_DEF("commit", 0, pljs_commit),
+    PLJS_CFUNC_DEF("rollback", 0, pljs_rollback),
+    PLJS_CFUNC_DEF("find_function", 1, pljs_find_function),
+    PLJS_CFUNC_DEF("return_next", 1, pljs_return_next_row),
+    PLJS_CFUNC_DEF("copyFrom", 3, pljs_copy_from_rows),
+    JS_PROP_STRING_DEF("version", PLJS_VERSION, JS_PROP_C_W_E),
+};
+
+// globals: the pljs namespace and the logging levels.
+static const JSCFunctionListEntry pljs_global_properties[] = {
+    JS_OBJECT_DEF("pljs", pljs_namespace_functions,
+                  lengthof(pljs_namespace_functions), JS_PROP_C_W_E),
+    JS_PROP_INT32_DEF("DEBUG5", DEBUG5, JS_PROP_C_W_E),
+    JS_PROP_INT32_DEF("DEBUG4", DEBUG4, JS_PROP_C_W_E),
+    JS_PROP_INT32_DEF("DEBUG3", DEBUG3, JS_PROP_C_W_E),
+    JS_PROP_INT32_DEF("DEBUG2", DEBUG2, JS_PROP_C_W_E),
+    JS_PROP_INT32_DEF("DEBUG1", DEBUG1, JS_PROP_C_W_E),
+    JS_PROP_INT32_DEF("LOG", LOG, JS_PROP_C_W_E),
+    JS_PROP_INT32_DEF("INFO", INFO, JS_PROP_C_W_E),
+    JS_PROP_INT32_DEF("NOTICE", NOTICE, JS_PROP_C_W_E),
+    JS_PROP_INT32_DEF("WARNING", WARNING, JS_PROP_C_W_E),
+    JS_PROP_INT32_DEF("ERROR", ERROR, JS_PROP_C_W_E),
+};
 
-  JS_SetPropertyStr(ctx, pljs, "commit",
-                    JS_NewCFunction(ctx, pljs_commit, "commit", 0));
+void pljs_setup_namespace(JSContext *ctx) {
+  // keep the intrinsics conversions use, before user code can replace them.
+  pljs_types_init(ctx);
 
-  JS_SetPropertyStr(ctx, pljs, "rollback",
-                    JS_NewCFunction(ctx, pljs_rollback, "rollback", 0));
+  // get a copy of the global object.
+  JSValue global_obj = JS_GetGlobalObject(ctx);
 
-  JS_SetPropertyStr(
-      ctx, pljs, "find_function",
-      JS_NewCFunction(ctx, pljs_find_function, "find_function", 1));
+  // set up the pljs namespace, its functions and the logging levels from
+  // static tables, in one step.
+  JS_SetPropertyFunctionList(ctx, global_obj, pljs_global_properties,
+                             lengthof(pljs_global_properties));
 
-  JS_SetPropertyStr(ctx, global_obj, "pljs", pljs);
+  JS_FreeValue(ctx, global_obj);
 
-  // version.
-  JS_SetPropertyStr(ctx, pljs, "version", JS_NewString(ctx, PLJS_VERSION));
+  // set up the class of the cursors returned by plan.cursor().
+  pljs_cursor_init(ctx);
 
-  // set up logging levels in the context.
-  JS_SetPropertyStr(ctx, global_obj, "DEBUG5", JS_NewInt32(ctx, DEBUG5));
-  JS_SetPropertyStr(ctx, global_obj, "DEBUG4", JS_NewInt32(ctx, DEBUG4));
-  JS_SetPropertyStr(ctx, global_obj, "DEBUG3", JS_NewInt32(ctx, DEBUG3));
-  JS_SetPropertyStr(ctx, global_obj, "DEBUG2", JS_NewInt32(ctx, DEBUG2));
-  JS_SetPropertyStr(ctx, global_obj, "DEBUG1", JS_NewInt32(ctx, DEBUG1));
-  JS_SetPropertyStr(ctx, global_obj, "LOG", JS_NewInt32(ctx, LOG));
-  JS_SetPropertyStr(ctx, global_obj, "INFO", JS_NewInt32(ctx, INFO));
-  JS_SetPropertyStr(ctx, global_obj, "NOTICE", JS_NewInt32(ctx, NOTICE));
-  JS_SetPropertyStr(ctx, global_obj, "WARNING", JS_NewInt32(ctx, WARNING));
-  JS_SetPropertyStr(ctx, global_obj, "ERROR", JS_NewInt32(ctx, ERROR));
+  // set up pljs.window, for window functions to reach their window.
+  pljs_window_init(ctx);
 }
 
 static JSValue pljs_elog(JSContext *ctx, JSValueConst this_val, int argc,
@@ -140,14 +181,201 @@ static JSValue pljs_elog(JSContext *ctx, JSValueConst this_val, int argc,
   return JS_UNDEFINED;
 }
 
+// the error of a statement that failed without a subtransaction.  Nothing
+// but aborting the transaction cleans up after such a statement, so the error
+// is raised again once the function returns, and until then every statement
+// fails with it.
+static ErrorData *pending_error = NULL;
+static MemoryContext pending_error_context = NULL;
+
+// whether every statement of a plan only reads, which is the case for plain
+// selects without data modifying CTEs or locking clauses.
+bool pljs_plan_read_only(SPIPlanPtr plan) {
+  ListCell *lc;
+
+  foreach (lc, SPI_plan_get_plan_sources(plan)) {
+    CachedPlanSource *plansource = (CachedPlanSource *)lfirst(lc);
+    ListCell *qc;
+
+    if (!plansource->is_valid || plansource->query_list == NIL ||
+        plansource->commandTag != CMDTAG_SELECT) {
+      return false;
+    }
+
+    foreach (qc, plansource->query_list) {
+      Query *query = lfirst_node(Query, qc);
+
+      if (query->commandType != CMD_SELECT || query->hasModifyingCTE ||
+          query->rowMarks != NIL) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// raise the error of a statement that failed without a subtransaction, if
+// there is one, called once the javascript of a function has returned.
+void pljs_raise_pending_error(void) {
+  ErrorData *edata = pending_error;
+
+  if (edata == NULL) {
+    return;
+  }
+
+  pending_error = NULL;
+
+  ReThrowError(edata);
+}
+
+// keep the error being handled to raise again once the function returns, and
+// throw it as an exception that cannot be caught.  for errors raised outside
+// of a subtransaction, which nothing but aborting the transaction cleans up
+// after, so no more javascript may run.  switches back to `mcontext`.
+JSValue pljs_throw_pending_error(JSContext *ctx, MemoryContext mcontext) {
+  if (pending_error_context == NULL) {
+    pending_error_context = AllocSetContextCreate(
+        TopMemoryContext, "PLJS Error Context", ALLOCSET_SMALL_SIZES);
+  }
+
+  // the previous error has already been raised again by now.
+  MemoryContextReset(pending_error_context);
+  MemoryContextSwitchTo(pending_error_context);
+
+  pending_error = CopyErrorData();
+  FlushErrorState();
+
+  MemoryContextSwitchTo(mcontext);
+
+  JSValue error = JS_NewError(ctx);
+
+  JS_SetPropertyStr(ctx, error, "message",
+                    JS_NewString(ctx, pending_error->message));
+  JS_SetUncatchableError(ctx, error, true);
+
+  return JS_Throw(ctx, error);
+}
+
+// a statement run by pljs.execute or a plan.
+typedef struct pljs_statement {
+  bool subtransaction;    // whether it runs in a subtransaction of its own
+  MemoryContext mcontext; // memory context to return to
+  ResourceOwner resowner; // resource owner to return to
+  instr_time start;       // when it started, for pljs.track_functions
+} pljs_statement;
+
+// time spent running statements, in milliseconds, only kept up to date when
+// pljs.track_functions is on.
+double pljs_statement_time = 0;
+
+// set up a statement before it starts, deciding whether it gets a
+// subtransaction of its own.
+static void statement_init(pljs_statement *statement, bool read_only) {
+  switch (configuration.execute_subtransactions) {
+  case PLJS_SUBTRANSACTIONS_OFF:
+    statement->subtransaction = false;
+    break;
+  case PLJS_SUBTRANSACTIONS_WRITES:
+    statement->subtransaction = !read_only;
+    break;
+  default:
+    statement->subtransaction = true;
+    break;
+  }
+
+  // parallel operations cannot start subtransactions, so in parallel workers
+  // and in a leader that runs them the errors of statements abort the
+  // function once it returns, as with off.
+  if (IsInParallelMode()) {
+    statement->subtransaction = false;
+  }
+
+  statement->mcontext = CurrentMemoryContext;
+  statement->resowner = CurrentResourceOwner;
+
+  if (configuration.track_functions) {
+    INSTR_TIME_SET_CURRENT(statement->start);
+  }
+}
+
+// add the time a statement took to the time spent running statements.
+static void statement_time(pljs_statement *statement) {
+  if (configuration.track_functions) {
+    instr_time elapsed;
+
+    INSTR_TIME_SET_CURRENT(elapsed);
+    INSTR_TIME_SUBTRACT(elapsed, statement->start);
+
+    pljs_statement_time += INSTR_TIME_GET_MILLISEC(elapsed);
+  }
+}
+
+// start a statement, inside of a subtransaction if it gets one.
+static void statement_begin(pljs_statement *statement) {
+  if (!IsTransactionOrTransactionBlock()) {
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                    errmsg("transaction lock failure")));
+  }
+
+  if (statement->subtransaction) {
+    BeginInternalSubTransaction(NULL);
+    MemoryContextSwitchTo(statement->mcontext);
+  }
+}
+
+// finish a statement that succeeded.
+static void statement_end(pljs_statement *statement) {
+  if (statement->subtransaction) {
+    ReleaseCurrentSubTransaction();
+  }
+
+  MemoryContextSwitchTo(statement->mcontext);
+  CurrentResourceOwner = statement->resowner;
+
+  statement_time(statement);
+}
+
+// turn the error of a failed statement into a javascript exception, rolling
+// back its subtransaction, or keeping the error to raise again once the
+// function returns when it has none.  without a subtransaction, nothing has
+// cleaned up after the error, so the exception cannot be caught and the
+// javascript unwinds at once, without running any more of it.
+static JSValue statement_error(JSContext *ctx, pljs_statement *statement) {
+  if (!statement->subtransaction) {
+    CurrentResourceOwner = statement->resowner;
+
+    statement_time(statement);
+
+    return pljs_throw_pending_error(ctx, statement->mcontext);
+  }
+
+  MemoryContextSwitchTo(statement->mcontext);
+
+  ErrorData *edata = CopyErrorData();
+  JSValue error = JS_NewError(ctx);
+
+  JS_SetPropertyStr(ctx, error, "message", JS_NewString(ctx, edata->message));
+
+  FlushErrorState();
+  FreeErrorData(edata);
+  RollbackAndReleaseCurrentSubTransaction();
+
+  MemoryContextSwitchTo(statement->mcontext);
+  CurrentResourceOwner = statement->resowner;
+
+  statement_time(statement);
+
+  return JS_Throw(ctx, error);
+}
+
 static JSValue pljs_execute(JSContext *ctx, JSValueConst this_val, int argc,
                             JSValueConst *argv) {
   int status;
   const char *sql;
   JSValue params = {0};
   int nparam;
-  ResourceOwner m_resowner;
-  MemoryContext m_mcontext;
+  pljs_statement statement;
 
   if (argc < 1) {
     return JS_UNDEFINED;
@@ -165,75 +393,129 @@ static JSValue pljs_execute(JSContext *ctx, JSValueConst this_val, int argc,
   }
 
   nparam = js_array_length(ctx, params);
-  m_resowner = CurrentResourceOwner;
-  m_mcontext = CurrentMemoryContext;
 
-  PG_TRY();
-  {
-    if (!IsTransactionOrTransactionBlock()) {
-      ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                      errmsg("transaction lock failure")));
+  if (pending_error) {
+    return js_throw(ctx, pending_error->message);
+  }
+
+  pljs_execute_plan prepared = {0};
+  bool read_only = false;
+
+  // With writes, every statement is prepared before it runs, to know whether
+  // it only reads.  Preparing only reads, so it runs without a
+  // subtransaction, as reading statements do.
+  if (configuration.execute_subtransactions == PLJS_SUBTRANSACTIONS_WRITES) {
+    statement_init(&statement, true);
+
+    PG_TRY();
+    {
+      statement_begin(&statement);
+      execute_prepare(ctx, sql, &prepared);
     }
+    PG_CATCH();
+    { return statement_error(ctx, &statement); }
+    PG_END_TRY();
 
-    BeginInternalSubTransaction(NULL);
-    MemoryContextSwitchTo(m_mcontext);
+    statement_end(&statement);
+
+    read_only = pljs_plan_read_only(prepared.plan);
+  }
+
+  statement_init(&statement, read_only);
+
+  PG_TRY();
+  {
+    statement_begin(&statement);
 
-    if (nparam == 0) {
+    if (nparam == 0 && prepared.plan == NULL) {
       status = SPI_exec(sql, 0);
     } else {
-      status = pljs_execute_params(sql, params, ctx);
+      status = pljs_execute_params(sql, params, ctx, &prepared);
     }
   }
   PG_CATCH();
   {
-    ErrorData *edata = CopyErrorData();
-    JSValue error = js_throw(ctx, edata->message);
-
-    RollbackAndReleaseCurrentSubTransaction();
-    MemoryContextSwitchTo(m_mcontext);
-    CurrentResourceOwner = m_resowner;
+    execute_release(&prepared);
 
-    return error;
+    return statement_error(ctx, &statement);
   }
   PG_END_TRY();
 
-  ReleaseCurrentSubTransaction();
-
-  MemoryContextSwitchTo(m_mcontext);
-  CurrentResourceOwner = m_resowner;
+  statement_end(&statement);
 
   return spi_result_to_jsvalue(ctx, status);
 }
 
-static int pljs_execute_params(const char *sql, JSValue params,
-                               JSContext *ctx) {
+// prepare a statement run by pljs.execute, reusing the plan for the query if
+// it has been prepared already.
+static void execute_prepare(JSContext *ctx, const char *sql,
+                            pljs_execute_plan *prepared) {
+  prepared->cached = pljs_cache_plan_acquire(ctx, sql);
+
+  if (prepared->cached) {
+    prepared->plan = prepared->cached->plan;
+    prepared->parstate = prepared->cached->parstate;
+  } else {
+    prepared->parstate = palloc0(sizeof(pljs_param_state));
+    prepared->parstate->memory_context = CurrentMemoryContext;
+
+    prepared->plan = SPI_prepare_params(sql, pljs_variable_param_setup,
+                                        prepared->parstate, 0);
+  }
+}
+
+// let go of the plan of a statement, once.
+static void execute_release(pljs_execute_plan *prepared) {
+  if (prepared->cached) {
+    pljs_cache_plan_release(prepared->cached);
+  } else if (prepared->plan) {
+    SPI_freeplan(prepared->plan);
+  }
+
+  prepared->cached = NULL;
+  prepared->plan = NULL;
+}
+
+static int pljs_execute_params(const char *sql, JSValue params, JSContext *ctx,
+                               pljs_execute_plan *prepared) {
   int nparams = js_array_length(ctx, params);
   int status;
   Datum *values = palloc(sizeof(Datum) * nparams);
   char *nulls = palloc(sizeof(char) * nparams);
 
-  SPIPlanPtr plan;
-  pljs_param_state parstate = {.memory_context = CurrentMemoryContext,
-                               .param_types = 0};
   ParamListInfo param_li;
 
-  plan = SPI_prepare_params(sql, pljs_variable_param_setup, &parstate, 0);
-
-  if (parstate.nparams != nparams) {
-    elog(ERROR, "parameter count mismatch: %d != %d", parstate.nparams,
-         nparams);
+  if (prepared->plan == NULL) {
+    execute_prepare(ctx, sql, prepared);
   }
 
-  for (int i = 0; i < nparams; i++) {
-    JSValue param = JS_GetPropertyUint32(ctx, params, i);
-    bool is_null;
+  SPIPlanPtr plan = prepared->plan;
+  pljs_param_state *parstate = prepared->parstate;
 
-    values[i] = pljs_jsvalue_to_datum(param, parstate.param_types[i], ctx, NULL,
-                                      &is_null);
-  }
+  PG_TRY();
+  {
+    if (parstate->nparams != nparams) {
+      elog(ERROR, "parameter count mismatch: %d != %d", parstate->nparams,
+           nparams);
+    }
+
+    for (int i = 0; i < nparams; i++) {
+      JSValue param = JS_GetPropertyUint32(ctx, params, i);
+      bool is_null;
+
+      values[i] = pljs_jsvalue_to_datum(param, parstate->param_types[i], ctx,
+                                        NULL, &is_null);
+      nulls[i] = is_null ? 'n' : ' ';
+
+      JS_FreeValue(ctx, param);
+    }
 
-  param_li = pljs_setup_variable_paramlist(&parstate, values, nulls);
-  status = SPI_execute_plan_with_paramlist(plan, param_li, false, 0);
+    param_li = pljs_setup_variable_paramlist(parstate, values, nulls);
+    status = SPI_execute_plan_with_paramlist(plan, param_li, false, 0);
+  }
+  PG_FINALLY();
+  { execute_release(prepared); }
+  PG_END_TRY();
 
   pfree(values);
   pfree(nulls);
@@ -263,8 +545,7 @@ static JSValue pljs_plan_execute(JSContext *ctx, JSValueConst this_val,
   char *nulls = NULL;
   int nparams = 0;
   int argcount;
-  MemoryContext m_mcontext;
-  ResourceOwner m_resowner;
+  pljs_statement statement;
   int status;
 
   if (argc) {
@@ -286,6 +567,10 @@ static JSValue pljs_plan_execute(JSContext *ctx, JSValueConst this_val,
     return js_throw(ctx, "Invalid plan");
   }
 
+  if (pending_error) {
+    return js_throw(ctx, pending_error->message);
+  }
+
   if (plan->parstate) {
     argcount = plan->parstate->nparams;
   } else {
@@ -309,20 +594,16 @@ static JSValue pljs_plan_execute(JSContext *ctx, JSValueConst this_val,
     values[i] = pljs_jsvalue_to_datum(
         param, plan->parstate ? plan->parstate->param_types[i] : 0, ctx, NULL,
         &is_null);
+    nulls[i] = is_null ? 'n' : ' ';
+
+    JS_FreeValue(ctx, param);
   }
 
-  m_resowner = CurrentResourceOwner;
-  m_mcontext = CurrentMemoryContext;
+  statement_init(&statement, pljs_plan_read_only(plan->plan));
 
   PG_TRY();
   {
-    if (!IsTransactionOrTransactionBlock()) {
-      ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-                      errmsg("transaction lock failure")));
-    }
-
-    BeginInternalSubTransaction(NULL);
-    MemoryContextSwitchTo(m_mcontext);
+    statement_begin(&statement);
 
     if (plan->parstate) {
       ParamListInfo paramLI;
@@ -337,12 +618,7 @@ static JSValue pljs_plan_execute(JSContext *ctx, JSValueConst this_val,
 
   PG_CATCH();
   {
-    ErrorData *edata = CopyErrorData();
-    JSValue error = js_throw(ctx, edata->message);
-
-    RollbackAndReleaseCurrentSubTransaction();
-    MemoryContextSwitchTo(m_mcontext);
-    CurrentResourceOwner = m_resowner;
+    JSValue error = statement_error(ctx, &statement);
 
     if (values) {
       pfree(values);
@@ -357,10 +633,7 @@ static JSValue pljs_plan_execute(JSContext *ctx, JSValueConst this_val,
 
   PG_END_TRY();
 
-  ReleaseCurrentSubTransaction();
-
-  MemoryContextSwitchTo(m_mcontext);
-  CurrentResourceOwner = m_resowner;
+  statement_end(&statement);
 
   JSValue ret = spi_result_to_jsvalue(ctx, status);
   SPI_freetuptable(SPI_tuptable);
@@ -376,6 +649,133 @@ static JSValue pljs_plan_execute(JSContext *ctx, JSValueConst this_val,
   return ret;
 }
 
+// execute a plan once for every array of parameters, all inside a single
+// subtransaction when it gets one, returning the total number of rows
+// processed.
+static JSValue pljs_plan_execute_many(JSContext *ctx, JSValueConst this_val,
+                                      int argc, JSValueConst *argv) {
+  pljs_plan *plan = NULL;
+  Datum *values = NULL;
+  char *nulls = NULL;
+  int argcount;
+  uint64 processed = 0;
+  pljs_statement statement;
+  MemoryContext row_mcontext;
+
+  if (argc < 1 || !JS_IsArray(ctx, argv[0])) {
+    return js_throw(ctx, "executeMany expects an array of parameter arrays");
+  }
+
+  JSValue ptr = JS_GetPropertyStr(ctx, this_val, "plan");
+
+  plan = JS_GetOpaque(ptr, js_prepared_statement_handle_id);
+
+  if (plan == NULL) {
+    return js_throw(ctx, "Invalid plan");
+  }
+
+  if (pending_error) {
+    return js_throw(ctx, pending_error->message);
+  }
+
+  if (plan->parstate) {
+    argcount = plan->parstate->nparams;
+  } else {
+    argcount = SPI_getargcount(plan->plan);
+  }
+
+  uint32_t nrows = js_array_length(ctx, argv[0]);
+
+  // the parameter buffers are shared by every execution.
+  if (argcount > 0) {
+    values = palloc(sizeof(Datum) * argcount);
+    nulls = palloc(sizeof(char) * argcount);
+  }
+
+  // converted parameters are freed after every execution.
+  row_mcontext = AllocSetContextCreate(
+      CurrentMemoryContext, "PLJS executeMany Context", ALLOCSET_SMALL_SIZES);
+
+  statement_init(&statement, pljs_plan_read_only(plan->plan));
+
+  PG_TRY();
+  {
+    statement_begin(&statement);
+    MemoryContextSwitchTo(row_mcontext);
+
+    for (uint32_t r = 0; r < nrows; r++) {
+      JSValue params = JS_GetPropertyUint32(ctx, argv[0], r);
+      int status;
+
+      if (!JS_IsArray(ctx, params) ||
+          js_array_length(ctx, params) != (uint32_t)argcount) {
+        JS_FreeValue(ctx, params);
+
+        elog(ERROR, "plan expected %d arguments in row %u", argcount, r);
+      }
+
+      for (int i = 0; i < argcount; i++) {
+        JSValue param = JS_GetPropertyUint32(ctx, params, i);
+        bool is_null = false;
+
+        values[i] = pljs_jsvalue_to_datum(
+            param, plan->parstate ? plan->parstate->param_types[i] : 0, ctx,
+            NULL, &is_null);
+        nulls[i] = is_null ? 'n' : ' ';
+
+        JS_FreeValue(ctx, param);
+      }
+
+      JS_FreeValue(ctx, params);
+
+      if (plan->parstate) {
+        ParamListInfo param_li =
+            pljs_setup_variable_paramlist(plan->parstate, values, nulls);
+
+        status =
+            SPI_execute_plan_with_paramlist(plan->plan, param_li, false, 0);
+      } else {
+        status = SPI_execute_plan(plan->plan, values, nulls, false, 0);
+      }
+
+      if (status < 0) {
+        elog(ERROR, "executeMany failed in row %u: %s", r,
+             SPI_result_code_string(status));
+      }
+
+      processed += SPI_processed;
+
+      SPI_freetuptable(SPI_tuptable);
+      MemoryContextReset(row_mcontext);
+    }
+  }
+  PG_CATCH();
+  {
+    JSValue error = statement_error(ctx, &statement);
+
+    MemoryContextDelete(row_mcontext);
+
+    if (values) {
+      pfree(values);
+      pfree(nulls);
+    }
+
+    return error;
+  }
+  PG_END_TRY();
+
+  statement_end(&statement);
+
+  MemoryContextDelete(row_mcontext);
+
+  if (values) {
+    pfree(values);
+    pfree(nulls);
+  }
+
+  return JS_NewInt64(ctx, (int64_t)processed);
+}
+
 static JSValue pljs_plan_free(JSContext *ctx, JSValueConst this_val, int argc,
                               JSValueConst *argv) {
   pljs_plan *plan;
@@ -402,6 +802,7 @@ static JSValue pljs_plan_free(JSContext *ctx, JSValueConst this_val, int argc,
 
 static const JSCFunctionListEntry js_plan_funcs[] = {
     JS_CFUNC_DEF("execute", 2, pljs_plan_execute),
+    JS_CFUNC_DEF("executeMany", 1, pljs_plan_execute_many),
     JS_CFUNC_DEF("free", 0, pljs_plan_free),
     JS_CFUNC_DEF("cursor", 0, pljs_plan_cursor),
     JS_CFUNC_DEF("toString", 0, pljs_plan_to_string)};
@@ -420,6 +821,10 @@ static JSValue pljs_prepare(JSContext *ctx, JSValueConst this_val, int argc,
     return JS_UNDEFINED;
   }
 
+  if (pending_error) {
+    return js_throw(ctx, pending_error->message);
+  }
+
   if (argc >= 2) {
     if (JS_IsArray(ctx, argv[1])) {
       params = argv[1];
@@ -472,7 +877,7 @@ static JSValue pljs_prepare(JSContext *ctx, JSValueConst this_val, int argc,
   JSValue ret = JS_NewObject(ctx);
   JSValue str = JS_NewString(ctx, "postgres execution plan");
   JS_SetPropertyStr(ctx, ret, "name", str);
-  JS_SetPropertyFunctionList(ctx, ret, js_plan_funcs, 4);
+  JS_SetPropertyFunctionList(ctx, ret, js_plan_funcs, lengthof(js_plan_funcs));
 
   plan = palloc(sizeof(pljs_plan));
 
@@ -486,11 +891,93 @@ static JSValue pljs_prepare(JSContext *ctx, JSValueConst this_val, int argc,
   return ret;
 }
 
+// a cursor, along with the rows prefetched while iterating over it.
+typedef struct pljs_cursor {
+  Portal portal;   // the portal of the cursor, `NULL` once it is dropped
+  dlist_node node; // in the list of cursors whose portal is still open
+  JSValue batch;   // array of prefetched rows
+  uint32_t batch_length;
+  uint32_t batch_position; // next row of the batch to return
+  bool done;               // whether the portal has run out of rows
+} pljs_cursor;
+
+// cursors whose portal has not been dropped yet.
+static dlist_head open_cursors = DLIST_STATIC_INIT(open_cursors);
+
+// cleanup of the portals of cursors, run by postgres whenever a portal is
+// dropped, be it by cursor.close(), by a CLOSE statement or at the end of
+// its transaction, so that cursors never hold on to a dropped portal.
+static void cursor_portal_cleanup(Portal portal) {
+  dlist_mutable_iter iter;
+
+  dlist_foreach_modify(iter, &open_cursors) {
+    pljs_cursor *cursor = dlist_container(pljs_cursor, node, iter.cur);
+
+    if (cursor->portal == portal) {
+      cursor->portal = NULL;
+      dlist_delete(&cursor->node);
+    }
+  }
+
+  PortalCleanup(portal);
+}
+
+static void js_cursor_finalizer(JSRuntime *rt, JSValue val) {
+  pljs_cursor *cursor = JS_GetOpaque(val, js_cursor_handle_id);
+
+  if (cursor == NULL) {
+    return;
+  }
+
+  if (cursor->portal != NULL) {
+    dlist_delete(&cursor->node);
+  }
+
+  JS_FreeValueRT(rt, cursor->batch);
+  js_free_rt(rt, cursor);
+}
+
+static void js_cursor_gc_mark(JSRuntime *rt, JSValueConst val,
+                              JS_MarkFunc *mark_func) {
+  pljs_cursor *cursor = JS_GetOpaque(val, js_cursor_handle_id);
+
+  if (cursor) {
+    JS_MarkValue(rt, cursor->batch, mark_func);
+  }
+}
+
+static JSClassDef js_cursor_class = {
+    .class_name = "Cursor",
+    .finalizer = js_cursor_finalizer,
+    .gc_mark = js_cursor_gc_mark,
+};
+
 static const JSCFunctionListEntry js_cursor_funcs[] = {
     JS_CFUNC_DEF("fetch", 2, pljs_plan_cursor_fetch),
     JS_CFUNC_DEF("move", 0, pljs_plan_cursor_move),
     JS_CFUNC_DEF("close", 0, pljs_plan_cursor_close),
-    JS_CFUNC_DEF("toString", 0, pljs_plan_cursor_to_string)};
+    JS_CFUNC_DEF("toString", 0, pljs_plan_cursor_to_string),
+    JS_CFUNC_DEF("next", 0, pljs_plan_cursor_next),
+    JS_CFUNC_DEF("[Symbol.iterator]", 0, pljs_plan_cursor_iterator)};
+
+// register the cursor class, and give it a prototype holding the methods of
+// cursors, so that they are not defined again for every cursor.
+static void pljs_cursor_init(JSContext *ctx) {
+  JSRuntime *rt = JS_GetRuntime(ctx);
+
+  if (js_cursor_handle_id == 0) {
+    JS_NewClassID(&js_cursor_handle_id);
+  }
+
+  if (!JS_IsRegisteredClass(rt, js_cursor_handle_id)) {
+    JS_NewClass(rt, js_cursor_handle_id, &js_cursor_class);
+  }
+
+  JSValue proto = JS_NewObject(ctx);
+  JS_SetPropertyFunctionList(ctx, proto, js_cursor_funcs,
+                             lengthof(js_cursor_funcs));
+  JS_SetClassProto(ctx, js_cursor_handle_id, proto);
+}
 
 static JSValue pljs_plan_cursor(JSContext *ctx, JSValueConst this_val, int argc,
                                 JSValueConst *argv) {
@@ -516,6 +1003,10 @@ static JSValue pljs_plan_cursor(JSContext *ctx, JSValueConst this_val, int argc,
     return JS_UNDEFINED;
   }
 
+  if (pending_error) {
+    return js_throw(ctx, pending_error->message);
+  }
+
   if (argc) {
     if (JS_IsArray(ctx, argv[0])) {
       params = argv[0];
@@ -550,6 +1041,7 @@ static JSValue pljs_plan_cursor(JSContext *ctx, JSValueConst this_val, int argc,
     values[i] = pljs_jsvalue_to_datum(
         param, plan->parstate ? plan->parstate->param_types[i] : 0, ctx, NULL,
         &is_null);
+    nulls[i] = is_null ? 'n' : ' ';
   }
 
   PG_TRY();
@@ -568,76 +1060,261 @@ static JSValue pljs_plan_cursor(JSContext *ctx, JSValueConst this_val, int argc,
   { return js_throw(ctx, "Error executing"); }
 
   PG_END_TRY();
-  JSValue ret = JS_NewObject(ctx);
+
+  // the portal is kept with the cursor, instead of being looked up by name,
+  // and the cursor lets go of it as soon as the portal is dropped.
+  pljs_cursor *handle = js_mallocz(ctx, sizeof(pljs_cursor));
+
+  handle->portal = cursor;
+  handle->batch = JS_UNDEFINED;
+  cursor->cleanup = cursor_portal_cleanup;
+  dlist_push_head(&open_cursors, &handle->node);
+
+  JSValue ret = JS_NewObjectClass(ctx, js_cursor_handle_id);
+  JS_SetOpaque(ret, handle);
+
   JSValue str = JS_NewString(ctx, cursor->name);
   JS_SetPropertyStr(ctx, ret, "name", str);
-  JS_SetPropertyFunctionList(ctx, ret, js_cursor_funcs, 4);
 
   return ret;
 }
 
-static JSValue pljs_plan_cursor_fetch(JSContext *ctx, JSValueConst this_val,
-                                      int argc, JSValueConst *argv) {
-  JSValue name = JS_GetPropertyStr(ctx, this_val, "name");
-  const char *plan_name = JS_ToCString(ctx, name);
-  int nfetch = 1;
-  bool forward = true, wantarray = false;
+// the portal of a cursor, which is gone once the cursor has been closed,
+// either explicitly or at the end of its transaction, and can not be used
+// while an error is pending.
+static Portal cursor_portal(pljs_cursor *cursor) {
+  if (cursor == NULL || pending_error) {
+    return NULL;
+  }
 
-  Portal cursor = SPI_cursor_find(plan_name);
+  return cursor->portal;
+}
 
-  if (cursor == NULL) {
-    return js_throw(ctx, "Unable to find cursor");
-  }
+// fetch or move a portal through SPI, leaving fetched rows in SPI_tuptable.
+// fetching only reads, so no batch gets a subtransaction of its own, and
+// errors of the portal cannot be caught, like those of statements run
+// without one.  going backward over a portal that cannot is checked first,
+// the error can be caught.
+static bool cursor_run(JSContext *ctx, Portal portal, bool fetch, bool forward,
+                       long count) {
+  pljs_statement statement;
 
-  if (argc >= 1) {
-    wantarray = true;
-    JS_ToInt32(ctx, &nfetch, argv[0]);
+  if (!forward && (portal->cursorOptions & CURSOR_OPT_NO_SCROLL)) {
+    js_throw(ctx, "cursor can only scan forward");
 
-    if (nfetch < 0) {
-      nfetch = -nfetch;
-      forward = false;
-    }
+    return false;
   }
 
+  statement_init(&statement, true);
+  statement.subtransaction = false;
+
   PG_TRY();
-  { SPI_cursor_fetch(cursor, forward, nfetch); }
+  {
+    statement_begin(&statement);
+
+    if (fetch) {
+      SPI_cursor_fetch(portal, forward, count);
+    } else {
+      SPI_cursor_move(portal, forward, count);
+    }
+  }
   PG_CATCH();
   {
-    SPI_rollback();
-    SPI_finish();
-    return js_throw(ctx, "Unable to fetch");
+    statement_error(ctx, &statement);
+
+    return false;
   }
   PG_END_TRY();
 
-  if (SPI_processed > 0) {
-    if (!wantarray) {
-      JSValue value =
-          tuple_to_jsvalue(ctx, SPI_tuptable->tupdesc, SPI_tuptable->vals[0]);
-      SPI_freetuptable(SPI_tuptable);
+  statement_end(&statement);
+
+  return true;
+}
+
+// drop the prefetched rows.
+static void cursor_free_batch(JSContext *ctx, pljs_cursor *cursor) {
+  JS_FreeValue(ctx, cursor->batch);
+  cursor->batch = JS_UNDEFINED;
+  cursor->batch_length = 0;
+  cursor->batch_position = 0;
+}
+
+// move up to `count` of the prefetched rows not returned yet into `rows`,
+// from `*length` on, returning how many were taken.
+static uint32_t cursor_take_batch(JSContext *ctx, pljs_cursor *cursor,
+                                  JSValue rows, uint32_t *length,
+                                  uint32_t count) {
+  uint32_t taken = 0;
+
+  while (taken < count && cursor->batch_position < cursor->batch_length) {
+    JSValue row =
+        JS_GetPropertyUint32(ctx, cursor->batch, cursor->batch_position++);
 
-      return value;
+    if (!JS_IsUndefined(rows)) {
+      JS_SetPropertyUint32(ctx, rows, (*length)++, row);
     } else {
-      JSValue obj = spi_result_to_jsvalue(ctx, SPI_processed);
+      JS_FreeValue(ctx, row);
+    }
+
+    taken++;
+  }
+
+  if (cursor->batch_position >= cursor->batch_length) {
+    cursor_free_batch(ctx, cursor);
+  }
+
+  return taken;
+}
+
+// move the portal back over the prefetched rows that have not been returned
+// yet, before going backward from the last row returned.  a portal that ran
+// out of rows is past its last row, one row further away.  only needed when
+// going backward, which the portal has to support anyway.
+static bool cursor_rewind_batch(JSContext *ctx, pljs_cursor *cursor,
+                                Portal portal) {
+  uint32_t remaining = cursor->batch_length - cursor->batch_position;
+  long count = remaining + (cursor->done ? 1 : 0);
+
+  cursor_free_batch(ctx, cursor);
 
+  if (remaining > 0 && !cursor_run(ctx, portal, false, false, count)) {
+    return false;
+  }
+
+  cursor->done = false;
+
+  return true;
+}
+
+// return the next row of a cursor, fetching `pljs.cursor_batch_size` rows at
+// a time, sets `done` once there are no more rows.
+static JSValue cursor_next_row(JSContext *ctx, pljs_cursor *cursor,
+                               bool *done) {
+  *done = false;
+
+  if (cursor->batch_position >= cursor->batch_length) {
+    Portal portal = cursor_portal(cursor);
+
+    if (portal == NULL) {
+      return js_throw(ctx, "Unable to find cursor");
+    }
+
+    cursor_free_batch(ctx, cursor);
+
+    if (cursor->done) {
+      *done = true;
+      return JS_UNDEFINED;
+    }
+
+    if (!cursor_run(ctx, portal, true, true,
+                    configuration.cursor_batch_size)) {
+      return JS_EXCEPTION;
+    }
+
+    cursor->batch_length = SPI_processed;
+    cursor->done = SPI_processed < (uint64)configuration.cursor_batch_size;
+
+    if (SPI_processed == 0) {
       SPI_freetuptable(SPI_tuptable);
 
-      return obj;
+      *done = true;
+      return JS_UNDEFINED;
     }
+
+    // the rows are converted while the tuples still exist, the batch is
+    // bounded by the batch size.
+    cursor->batch = spi_result_to_jsvalue(ctx, SPI_OK_SELECT);
+    SPI_freetuptable(SPI_tuptable);
   }
 
-  SPI_freetuptable(SPI_tuptable);
+  return JS_GetPropertyUint32(ctx, cursor->batch, cursor->batch_position++);
+}
 
-  return JS_UNDEFINED;
+// fetching forward returns the prefetched rows first, then fetches the rest
+// from the portal, so that the portal never has to go back over them.
+static JSValue pljs_plan_cursor_fetch(JSContext *ctx, JSValueConst this_val,
+                                      int argc, JSValueConst *argv) {
+  pljs_cursor *handle = JS_GetOpaque(this_val, js_cursor_handle_id);
+  int nfetch = 1;
+  bool forward = true, done;
+
+  if (argc < 1) {
+    if (handle == NULL) {
+      return js_throw(ctx, "Unable to find cursor");
+    }
+
+    return cursor_next_row(ctx, handle, &done);
+  }
+
+  Portal cursor = cursor_portal(handle);
+
+  if (cursor == NULL) {
+    return js_throw(ctx, "Unable to find cursor");
+  }
+
+  JS_ToInt32(ctx, &nfetch, argv[0]);
+
+  if (nfetch < 0) {
+    nfetch = -nfetch;
+    forward = false;
+  }
+
+  JSValue rows = JS_NewArray(ctx);
+  uint32_t length = 0;
+  uint32_t taken = 0;
+
+  if (forward) {
+    taken = cursor_take_batch(ctx, handle, rows, &length, nfetch);
+  } else if (!cursor_rewind_batch(ctx, handle, cursor)) {
+    JS_FreeValue(ctx, rows);
+
+    return JS_EXCEPTION;
+  }
+
+  if (taken < (uint32_t)nfetch && !(forward && handle->done)) {
+    if (!cursor_run(ctx, cursor, true, forward, nfetch - taken)) {
+      JS_FreeValue(ctx, rows);
+
+      return JS_EXCEPTION;
+    }
+
+    // fetching forward may have reached the end, but fetching backward
+    // leaves rows to fetch after it again.
+    handle->done = forward && SPI_processed < (uint64)(nfetch - taken);
+
+    if (SPI_processed > 0) {
+      JSValue fetched = spi_result_to_jsvalue(ctx, SPI_OK_SELECT);
+
+      for (uint64 i = 0; i < SPI_processed; i++) {
+        JS_SetPropertyUint32(ctx, rows, length++,
+                             JS_GetPropertyUint32(ctx, fetched, i));
+      }
+
+      JS_FreeValue(ctx, fetched);
+    }
+
+    SPI_freetuptable(SPI_tuptable);
+  }
+
+  if (length == 0) {
+    JS_FreeValue(ctx, rows);
+
+    return JS_UNDEFINED;
+  }
+
+  return rows;
 }
 
+// moving forward skips the prefetched rows first, like fetching does.
 static JSValue pljs_plan_cursor_move(JSContext *ctx, JSValueConst this_val,
                                      int argc, JSValueConst *argv) {
-  JSValue name = JS_GetPropertyStr(ctx, this_val, "name");
-  const char *cursor_name = JS_ToCString(ctx, name);
+  pljs_cursor *handle = JS_GetOpaque(this_val, js_cursor_handle_id);
   int nmove = 1;
   bool forward = true;
+  uint32_t length = 0;
+  uint32_t taken = 0;
 
-  Portal cursor = SPI_cursor_find(cursor_name);
+  Portal cursor = cursor_portal(handle);
 
   if (cursor == NULL) {
     return js_throw(ctx, "Unable to find plan");
@@ -654,20 +1331,28 @@ static JSValue pljs_plan_cursor_move(JSContext *ctx, JSValueConst this_val,
     forward = false;
   }
 
-  PG_TRY();
-  { SPI_cursor_move(cursor, forward, nmove); }
-  PG_CATCH();
-  { return js_throw(ctx, "Unable to fetch"); }
-  PG_END_TRY();
+  if (forward) {
+    taken = cursor_take_batch(ctx, handle, JS_UNDEFINED, &length, nmove);
+  } else if (!cursor_rewind_batch(ctx, handle, cursor)) {
+    return JS_EXCEPTION;
+  }
+
+  if (taken < (uint32_t)nmove && !(forward && handle->done)) {
+    if (!cursor_run(ctx, cursor, false, forward, nmove - taken)) {
+      return JS_EXCEPTION;
+    }
+
+    // moving backward makes the rows after the cursor reachable again.
+    handle->done = forward && SPI_processed < (uint64)(nmove - taken);
+  }
 
   return JS_UNDEFINED;
 }
 
 static JSValue pljs_plan_cursor_close(JSContext *ctx, JSValueConst this_val,
                                       int argc, JSValueConst *argv) {
-  JSValue name = JS_GetPropertyStr(ctx, this_val, "name");
-  const char *cursor_name = JS_ToCString(ctx, name);
-  Portal cursor = SPI_cursor_find(cursor_name);
+  pljs_cursor *handle = JS_GetOpaque(this_val, js_cursor_handle_id);
+  Portal cursor = cursor_portal(handle);
 
   if (!cursor) {
     return js_throw(ctx, "Unable to find cursor");
@@ -683,6 +1368,12 @@ static JSValue pljs_plan_cursor_close(JSContext *ctx, JSValueConst this_val,
   }
   PG_END_TRY();
 
+  // dropping the portal has let go of it already.
+  JS_FreeValue(ctx, handle->batch);
+  handle->batch = JS_UNDEFINED;
+  handle->batch_length = 0;
+  handle->batch_position = 0;
+
   JSValue ret = JS_NewInt32(ctx, cursor ? 1 : 0);
 
   return ret;
@@ -693,6 +1384,35 @@ static JSValue pljs_plan_cursor_to_string(JSContext *ctx, JSValueConst this_val,
   return JS_NewString(ctx, "[object Cursor]");
 }
 
+// iterator protocol, returns the next row as `{ value, done }`.
+static JSValue pljs_plan_cursor_next(JSContext *ctx, JSValueConst this_val,
+                                     int argc, JSValueConst *argv) {
+  pljs_cursor *handle = JS_GetOpaque(this_val, js_cursor_handle_id);
+  bool done;
+
+  if (handle == NULL) {
+    return js_throw(ctx, "Unable to find cursor");
+  }
+
+  JSValue value = cursor_next_row(ctx, handle, &done);
+
+  if (JS_IsException(value)) {
+    return value;
+  }
+
+  JSValue result = JS_NewObject(ctx);
+  JS_SetPropertyStr(ctx, result, "value", value);
+  JS_SetPropertyStr(ctx, result, "done", JS_NewBool(ctx, done));
+
+  return result;
+}
+
+// a cursor is its own iterator, for `for...of`.
+static JSValue pljs_plan_cursor_iterator(JSContext *ctx, JSValueConst this_val,
+                                         int argc, JSValueConst *argv) {
+  return JS_DupValue(ctx, this_val);
+}
+
 static JSValue pljs_plan_to_string(JSContext *ctx, JSValueConst this_val,
                                    int argc, JSValueConst *argv) {
   return JS_NewString(ctx, "[object Plan]");
@@ -700,6 +1420,10 @@ static JSValue pljs_plan_to_string(JSContext *ctx, JSValueConst this_val,
 
 static JSValue pljs_commit(JSContext *ctx, JSValueConst this_val, int argc,
                            JSValueConst *argv) {
+  if (pending_error) {
+    return js_throw(ctx, pending_error->message);
+  }
+
   PG_TRY();
   {
     // HoldPinnedPortals();
@@ -715,6 +1439,10 @@ static JSValue pljs_commit(JSContext *ctx, JSValueConst this_val, int argc,
 
 static JSValue pljs_rollback(JSContext *ctx, JSValueConst this_val, int argc,
                              JSValueConst *argv) {
+  if (pending_error) {
+    return js_throw(ctx, pending_error->message);
+  }
+
   PG_TRY();
   {
     // HoldPinnedPortals();
@@ -798,3 +1526,86 @@ static JSValue pljs_find_function(JSContext *ctx, JSValueConst this_val,
 
   return func;
 }
+
+/**
+ * @brief Adds a row to the result of a set returning function.
+ *
+ * Javascript function `pljs.return_next`, which stores its argument as the
+ * next row of the set returning function being called.
+ * @returns #JSValue undefined, or an exception if no set returning function
+ * is being called.
+ */
+static JSValue pljs_return_next_row(JSContext *ctx, JSValueConst this_val,
+                                    int argc, JSValueConst *argv) {
+  MemoryContext mcontext = CurrentMemoryContext;
+  bool stored;
+
+  if (pending_error) {
+    return js_throw(ctx, pending_error->message);
+  }
+
+  // a row that does not convert, or that cannot be stored, raises an error.
+  // storing it runs input functions and can write the tuplestore to disk
+  // outside of any subtransaction, so the error cannot be caught.
+  PG_TRY();
+  { stored = pljs_return_next(ctx, argc > 0 ? argv[0] : JS_UNDEFINED); }
+  PG_CATCH();
+  { return pljs_throw_pending_error(ctx, mcontext); }
+  PG_END_TRY();
+
+  if (!stored) {
+    return js_throw(ctx, "return_next can only be called from a set "
+                         "returning function");
+  }
+
+  return JS_UNDEFINED;
+}
+
+// insert rows into a table through COPY, inside a subtransaction unless
+// pljs.execute_subtransactions is off, returning the number of rows inserted.
+static JSValue pljs_copy_from_rows(JSContext *ctx, JSValueConst this_val,
+                                   int argc, JSValueConst *argv) {
+  uint64 processed;
+  pljs_statement statement;
+
+  if (argc < 3 || !JS_IsArray(ctx, argv[1]) || !JS_IsArray(ctx, argv[2])) {
+    return js_throw(ctx, "copyFrom expects a table, an array of columns and "
+                         "an array of rows");
+  }
+
+  const char *table = JS_ToCString(ctx, argv[0]);
+
+  if (table == NULL) {
+    return JS_EXCEPTION;
+  }
+
+  if (pending_error) {
+    JS_FreeCString(ctx, table);
+
+    return js_throw(ctx, pending_error->message);
+  }
+
+  statement_init(&statement, false);
+
+  PG_TRY();
+  {
+    statement_begin(&statement);
+
+    processed = pljs_copy_from(ctx, table, argv[1], argv[2]);
+  }
+  PG_CATCH();
+  {
+    JSValue error = statement_error(ctx, &statement);
+
+    JS_FreeCString(ctx, table);
+
+    return error;
+  }
+  PG_END_TRY();
+
+  statement_end(&statement);
+
+  JS_FreeCString(ctx, table);
+
+  return JS_NewInt64(ctx, (int64_t)processed);
+}
@@ -0,0 +1,315 @@
+#include "postgres.h"
+
+#include "catalog/pg_authid_d.h"
+#include "catalog/pg_type_d.h"
+#include "funcapi.h"
+#include "access/xact.h"
+#include "miscadmin.h"
+#include "utils/acl.h"
+#include "utils/array.h"
+#include "utils/hsearch.h"
+#include "utils/tuplestore.h"
+
+#include "deps/quickjs/quickjs.h"
+
+#include "pljs.h"
+
+PG_FUNCTION_INFO_V1(pljs_memory_usage);
+PG_FUNCTION_INFO_V1(pljs_gc);
+
+/**
+ * @brief Number of columns returned by #pljs_memory_usage.
+ */
+#define MEMORY_USAGE_COLUMNS 15
+
+/**
+ * @brief Whether javascript has run since the last collection at the end of
+ * a transaction.
+ */
+static bool gc_pending = false;
+
+static void memory_xact_callback(XactEvent event, void *arg);
+
+/**
+ * @brief Collects every runtime in use in this backend.
+ *
+ * Contexts are created in the runtime of the backend, or in a runtime of
+ * their own with `pljs.runtime_per_role`, and are found through the context
+ * cache.  Runtimes of contexts no longer in the cache are included as long
+ * as they are alive.
+ * @returns #List of the runtimes.
+ */
+static List *memory_runtimes(void) {
+  HASH_SEQ_STATUS status;
+  pljs_context_cache_value *entry;
+  List *runtimes = NIL;
+
+  if (rt != NULL) {
+    runtimes = lappend(runtimes, rt);
+  }
+
+  hash_seq_init(&status, pljs_context_HashTable);
+
+  while ((entry = (pljs_context_cache_value *)hash_seq_search(&status)) !=
+         NULL) {
+    runtimes = list_append_unique_ptr(runtimes, JS_GetRuntime(entry->ctx));
+  }
+
+  return list_concat_unique_ptr(runtimes, pljs_released_runtimes());
+}
+
+/**
+ * @brief Adds a row for the memory used by a runtime.
+ *
+ * Along with what `JS_ComputeMemoryUsage` reports, the row has the roles
+ * whose contexts live in the runtime, and the number of functions compiled
+ * in them.  Unless all roles are shown, only the context of the current
+ * role is, and runtimes without it are left out.
+ * @param all_roles @c bool - whether the contexts of every role are shown
+ */
+static void memory_usage_store(Tuplestorestate *tuplestore, TupleDesc tupdesc,
+                               JSRuntime *runtime, bool all_roles) {
+  HASH_SEQ_STATUS status;
+  pljs_context_cache_value *entry;
+  JSMemoryUsage usage;
+  Datum values[MEMORY_USAGE_COLUMNS];
+  bool nulls[MEMORY_USAGE_COLUMNS] = {0};
+  Datum *user_ids =
+      palloc(sizeof(Datum) * (hash_get_num_entries(pljs_context_HashTable) +
+                              1));
+  int contexts = 0;
+  int64 functions = 0;
+
+  hash_seq_init(&status, pljs_context_HashTable);
+
+  while ((entry = (pljs_context_cache_value *)hash_seq_search(&status)) !=
+         NULL) {
+    if (JS_GetRuntime(entry->ctx) != runtime ||
+        (!all_roles && entry->user_id != GetUserId())) {
+      continue;
+    }
+
+    user_ids[contexts++] = ObjectIdGetDatum(entry->user_id);
+
+    if (entry->function_hash_table) {
+      functions += hash_get_num_entries(entry->function_hash_table);
+    }
+  }
+
+  if (!all_roles && contexts == 0) {
+    pfree(user_ids);
+
+    return;
+  }
+
+  JS_ComputeMemoryUsage(runtime, &usage);
+
+  values[0] = PointerGetDatum(
+      construct_array(user_ids, contexts, OIDOID, sizeof(Oid), true,
+                      TYPALIGN_INT));
+  values[1] = Int32GetDatum(contexts);
+  values[2] = Int64GetDatum(functions);
+  values[3] = Int64GetDatum(usage.malloc_size);
+  values[4] = Int64GetDatum(usage.malloc_count);
+  values[5] = Int64GetDatum(usage.memory_used_size);
+  values[6] = Int64GetDatum(usage.obj_count);
+  values[7] = Int64GetDatum(usage.obj_size);
+  values[8] = Int64GetDatum(usage.str_count);
+  values[9] = Int64GetDatum(usage.str_size);
+  values[10] = Int64GetDatum(usage.atom_count);
+  values[11] = Int64GetDatum(usage.atom_size);
+  values[12] = Int64GetDatum(usage.js_func_count);
+  values[13] = Int64GetDatum(usage.js_func_code_size);
+
+  // A runtime without a limit reports a limit of -1.
+  if (usage.malloc_limit < 0) {
+    nulls[14] = true;
+    values[14] = (Datum)0;
+  } else {
+    values[14] = Int64GetDatum(usage.malloc_limit);
+  }
+
+  tuplestore_putvalues(tuplestore, tupdesc, values, nulls);
+
+  pfree(user_ids);
+}
+
+/**
+ * @brief Reports the memory used by the javascript runtimes of this backend.
+ *
+ * Returns one row for each runtime, computed by `JS_ComputeMemoryUsage`,
+ * which walks through everything the runtime has allocated.  Roles without
+ * the privileges of `pg_read_all_stats` only see the runtime of their own
+ * context, and none of the other roles in it.
+ */
+Datum pljs_memory_usage(PG_FUNCTION_ARGS) {
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+  TupleDesc tupdesc;
+
+  if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo) ||
+      !(rsinfo->allowedModes & SFRM_Materialize)) {
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                    errmsg("set-valued function called in context that "
+                           "cannot accept a set")));
+  }
+
+  if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+    elog(ERROR, "return type must be a row type");
+  }
+
+  MemoryContext old_context =
+      MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+  tupdesc = CreateTupleDescCopy(tupdesc);
+
+  Tuplestorestate *tuplestore = tuplestore_begin_heap(
+      (rsinfo->allowedModes & SFRM_Materialize_Random) != 0, false, work_mem);
+
+  MemoryContextSwitchTo(old_context);
+
+  List *runtimes = memory_runtimes();
+  ListCell *lc;
+  bool all_roles = has_privs_of_role(GetUserId(), ROLE_PG_READ_ALL_STATS);
+
+  foreach (lc, runtimes) {
+    memory_usage_store(tuplestore, tupdesc, lfirst(lc), all_roles);
+  }
+
+  list_free(runtimes);
+
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult = tuplestore;
+  rsinfo->setDesc = tupdesc;
+
+  PG_RETURN_NULL();
+}
+
+/**
+ * @brief Runs the garbage collector of every runtime of this backend.
+ *
+ * @returns @c int8 of the number of bytes freed.
+ */
+Datum pljs_gc(PG_FUNCTION_ARGS) {
+  List *runtimes = memory_runtimes();
+  ListCell *lc;
+  int64 freed = 0;
+
+  foreach (lc, runtimes) {
+    JSRuntime *runtime = lfirst(lc);
+    JSMemoryUsage before;
+    JSMemoryUsage after;
+
+    JS_ComputeMemoryUsage(runtime, &before);
+    JS_RunGC(runtime);
+    JS_ComputeMemoryUsage(runtime, &after);
+
+    freed += before.malloc_size - after.malloc_size;
+  }
+
+  list_free(runtimes);
+  pljs_abandoned_runtimes_free();
+
+  PG_RETURN_INT64(freed);
+}
+
+/**
+ * @brief Converts `pljs.gc_threshold` to what `JS_SetGCThreshold` expects.
+ *
+ * A threshold of 0 never reaches the threshold, so that the garbage collector
+ * only runs when asked to.
+ */
+static size_t memory_gc_threshold(int threshold) {
+  return threshold == 0 ? SIZE_MAX : (size_t)threshold * 1024;
+}
+
+/**
+ * @brief Sets up the garbage collection of the memory module.
+ *
+ * Registers the callback collecting garbage at the end of transactions.
+ */
+void pljs_memory_init(void) {
+  RegisterXactCallback(memory_xact_callback, NULL);
+}
+
+/**
+ * @brief Applies `pljs.gc_threshold` to a runtime.
+ *
+ * quickjs raises the threshold itself after every collection it triggers, to
+ * half again the memory in use, so the setting is where the next collection
+ * starts from.
+ * @param runtime #JSRuntime - the runtime to set the threshold of
+ */
+void pljs_gc_setup(JSRuntime *runtime) {
+  JS_SetGCThreshold(runtime, memory_gc_threshold(configuration.gc_threshold));
+}
+
+/**
+ * @brief Assign hook of `pljs.gc_threshold`.
+ *
+ * The setting applies to the runtimes of every role, which is why only
+ * superusers can change it.
+ */
+void pljs_gc_threshold_assign(int newval, void *extra) {
+  HASH_SEQ_STATUS status;
+  pljs_context_cache_value *entry;
+
+  if (rt != NULL) {
+    JS_SetGCThreshold(rt, memory_gc_threshold(newval));
+  }
+
+  if (pljs_context_HashTable == NULL) {
+    return;
+  }
+
+  // Roles with a runtime of their own follow the setting as well.
+  hash_seq_init(&status, pljs_context_HashTable);
+
+  while ((entry = (pljs_context_cache_value *)hash_seq_search(&status)) !=
+         NULL) {
+    JS_SetGCThreshold(JS_GetRuntime(entry->ctx), memory_gc_threshold(newval));
+  }
+}
+
+/**
+ * @brief Marks that javascript has run in the current transaction.
+ *
+ * The garbage left behind is collected when the transaction ends if
+ * `pljs.gc_at_transaction_end` is on.
+ */
+void pljs_gc_request(void) { gc_pending = true; }
+
+/**
+ * @brief Collects garbage once a transaction that ran javascript ends.
+ *
+ * Nothing is waiting on javascript by then, so the collection does not add
+ * to the time of a call.  The threshold is set back afterwards, undoing what
+ * quickjs raised it to during the transaction.
+ */
+static void memory_xact_callback(XactEvent event, void *arg) {
+  if (event != XACT_EVENT_COMMIT && event != XACT_EVENT_ABORT) {
+    return;
+  }
+
+  if (!gc_pending || !configuration.gc_at_transaction_end) {
+    return;
+  }
+
+  gc_pending = false;
+
+  if (pljs_context_HashTable == NULL) {
+    return;
+  }
+
+  MemoryContext old_context = MemoryContextSwitchTo(TopMemoryContext);
+  List *runtimes = memory_runtimes();
+  ListCell *lc;
+
+  MemoryContextSwitchTo(old_context);
+
+  foreach (lc, runtimes) {
+    JS_RunGC(lfirst(lc));
+    pljs_gc_setup(lfirst(lc));
+  }
+
+  list_free(runtimes);
+}
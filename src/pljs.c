@@ -1,19 +1,35 @@
 #include "postgres.h"
 
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#elif defined(__linux__)
+#include <malloc.h>
+#endif
+
+#include "access/htup_details.h"
+#include "catalog/namespace.h"
 #include "catalog/pg_database.h"
 #include "catalog/pg_proc.h"
 #include "catalog/pg_type_d.h"
+#include "commands/proclang.h"
 #include "commands/trigger.h"
 #include "executor/spi.h"
 #include "funcapi.h"
 #include "miscadmin.h"
 #include "nodes/parsenodes.h"
+#include "portability/instr_time.h"
+#include "utils/acl.h"
 #include "utils/builtins.h"
 #include "utils/guc.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/palloc.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
+#include "utils/tuplestore.h"
+#include "utils/typcache.h"
+#include "utils/varlena.h"
 
 #include "deps/quickjs/quickjs.h"
 
@@ -24,16 +40,26 @@ PG_MODULE_MAGIC;
 Datum pljs_call_handler(PG_FUNCTION_ARGS);
 Datum pljs_call_validator(PG_FUNCTION_ARGS);
 Datum pljs_inline_handler(PG_FUNCTION_ARGS);
+Datum pljs_preload(PG_FUNCTION_ARGS);
 
 PG_FUNCTION_INFO_V1(pljs_call_handler);
 PG_FUNCTION_INFO_V1(pljs_call_validator);
 PG_FUNCTION_INFO_V1(pljs_inline_handler);
+PG_FUNCTION_INFO_V1(pljs_preload);
 
-static Datum pljs_call_function(PG_FUNCTION_ARGS, pljs_context *context,
+static Datum pljs_call_function(PG_FUNCTION_ARGS, pljs_call_state *state,
                                 JSValueConst *argv);
+static Datum pljs_call_srf(FunctionCallInfo fcinfo, pljs_call_state *state,
+                           JSValueConst *argv);
+static Datum pljs_call_window(FunctionCallInfo fcinfo, pljs_call_state *state,
+                              JSValueConst *argv);
 
 static void pljs_call_anonymous_function(JSContext *, const char *);
-static Datum pljs_call_trigger(FunctionCallInfo fcinfo, pljs_context *context);
+static Datum pljs_call_trigger(FunctionCallInfo fcinfo, pljs_call_state *state);
+static JSRuntime *runtime_new(void);
+static JSRuntime *runtime_shared(void);
+static void context_start(void);
+static void preload_functions(JSContext *ctx);
 
 /**
  * @brief Converts a javascript error into a string.
@@ -96,18 +122,309 @@ static char *dump_error(JSContext *ctx) {
 
 /** \brief QuickJS Runtime */
 JSRuntime *rt = NULL;
-static uint64_t os_pending_signals = 0;
 
 pljs_configuration configuration = {0};
 
-static void signal_handler(int sig_num) {
-  os_pending_signals |= ((uint64_t)1 << sig_num);
+/**
+ * @brief State of a set returning function while it produces rows.
+ */
+typedef struct pljs_srf_state {
+  JSContext *ctx; // the context of the function
+  Tuplestorestate *tuplestore;
+  TupleDesc tupdesc;
+  pljs_type *type;           // the return type of the function
+  bool is_scalar;            // whether rows are single values, not records
+  MemoryContext row_context; // reset after each row is stored
+} pljs_srf_state;
+
+// The set returning function currently being called, for `return_next`.
+// Cleared while the functions it calls through SPI run, so that they cannot
+// add rows to its result.
+static pljs_srf_state *current_srf = NULL;
+
+/**
+ * @brief Statistics of the call in progress, `NULL` unless
+ * `pljs.track_functions` is on.
+ */
+static pljs_function_stats *current_stats = NULL;
+
+/**
+ * @brief Timer for a part of the call in progress.
+ *
+ * Time spent running statements, and converting results, while the timer
+ * runs is not counted as running javascript.
+ */
+typedef struct pljs_stats_timer {
+  instr_time start;
+  double statement_time; // #pljs_statement_time when started
+  double result_time;    // result conversion time of the call when started
+} pljs_stats_timer;
+
+// Adds the time since `timer` was started to `field` of the statistics of
+// the call in progress.
+#define STATS_ADD(field, timer)                                               \
+  do {                                                                        \
+    if (current_stats) {                                                      \
+      current_stats->field += stats_elapsed(&(timer));                        \
+    }                                                                         \
+  } while (0)
+
+// Javascript memory allocated by every runtime, and the most allocated since
+// the call in progress started.
+static size_t js_allocated = 0;
+static size_t js_allocated_peak = 0;
+
+/**
+ * @brief Number of calls into javascript in progress.
+ *
+ * Cached contexts and functions are only evicted once the outermost call has
+ * returned, as the calls in progress may still be using them.
+ */
+static int call_depth = 0;
+
+/**
+ * @brief When the outermost call in progress started, for
+ * `pljs.execution_timeout`.
+ */
+static instr_time call_start;
+
+/**
+ * @brief Number of polls of #interrupt_handler between checks of the clock.
+ *
+ * quickjs already only polls every so many instructions, so the clock is
+ * read rarely enough to not be noticed.
+ */
+#define INTERRUPT_CLOCK_POLLS 8
+
+/**
+ * @brief Polls of #interrupt_handler since the clock was last checked.
+ */
+static int interrupt_polls = 0;
+
+/**
+ * @brief Whether javascript was interrupted by `pljs.execution_timeout`.
+ */
+static bool execution_timed_out = false;
+
+/**
+ * @brief Starts a call into javascript.
+ *
+ * The outermost call starts the clock of `pljs.execution_timeout`, nested
+ * calls count against the time of the call they are made from.
+ */
+static void call_enter(void) {
+  if (call_depth++ == 0) {
+    INSTR_TIME_SET_CURRENT(call_start);
+    interrupt_polls = 0;
+  }
+}
+
+/**
+ * @brief Interrupt handler of every runtime, polled by quickjs while
+ * javascript runs.
+ *
+ * Interrupts javascript when postgres has a query cancel or a termination
+ * pending, such as from `statement_timeout` or `pg_cancel_backend`, which
+ * can be processed right away, or once `pljs.execution_timeout` has passed.
+ * Nothing is raised here, #raise_interrupt raises the error once javascript
+ * has unwound.
+ * @returns @c int of 1 to interrupt javascript, 0 to carry on.
+ */
+static int interrupt_handler(JSRuntime *runtime, void *opaque) {
+  if (InterruptPending && (QueryCancelPending || ProcDiePending) &&
+      INTERRUPTS_CAN_BE_PROCESSED()) {
+    return 1;
+  }
+
+  if (configuration.execution_timeout > 0 && call_depth > 0 &&
+      ++interrupt_polls >= INTERRUPT_CLOCK_POLLS) {
+    instr_time elapsed;
+
+    interrupt_polls = 0;
+
+    INSTR_TIME_SET_CURRENT(elapsed);
+    INSTR_TIME_SUBTRACT(elapsed, call_start);
+
+    if (INSTR_TIME_GET_MILLISEC(elapsed) >=
+        configuration.execution_timeout * 1000.0) {
+      execution_timed_out = true;
+
+      return 1;
+    }
+  }
+
+  return 0;
 }
 
-static int interrupt_handler(JSRuntime *rt, void *opaque) {
-  return (os_pending_signals >> SIGINT) & 1;
+/**
+ * @brief Raises the error of an interrupt of javascript.
+ *
+ * Called once javascript has returned, pending cancels and terminations are
+ * processed by postgres with their own errors.
+ */
+static void raise_interrupt(void) {
+  CHECK_FOR_INTERRUPTS();
+
+  if (execution_timed_out) {
+    execution_timed_out = false;
+
+    ereport(ERROR, errcode(ERRCODE_QUERY_CANCELED),
+            errmsg("canceling javascript due to pljs.execution_timeout"));
+  }
 }
 
+/**
+ * @brief Raises the error of a statement that failed without a
+ * subtransaction, or of an interrupt, once javascript has returned.
+ *
+ * The value javascript returned is freed before anything is raised, as
+ * nothing would free it afterwards.
+ * @param ctx #JSContext - the context javascript ran in
+ * @param value #JSValue - the value javascript returned
+ */
+static void raise_call_error(JSContext *ctx, JSValue value) {
+  PG_TRY();
+  {
+    pljs_raise_pending_error();
+    raise_interrupt();
+  }
+  PG_CATCH();
+  {
+    JS_FreeValue(ctx, value);
+    PG_RE_THROW();
+  }
+  PG_END_TRY();
+}
+
+/**
+ * @brief Starts timing a part of the call in progress.
+ */
+static void stats_start(pljs_stats_timer *timer) {
+  if (current_stats) {
+    INSTR_TIME_SET_CURRENT(timer->start);
+    timer->statement_time = pljs_statement_time;
+    timer->result_time = current_stats->result_time;
+  }
+}
+
+/**
+ * @brief Milliseconds since a timer was started.
+ */
+static double stats_elapsed(pljs_stats_timer *timer) {
+  instr_time elapsed;
+
+  INSTR_TIME_SET_CURRENT(elapsed);
+  INSTR_TIME_SUBTRACT(elapsed, timer->start);
+
+  return INSTR_TIME_GET_MILLISEC(elapsed);
+}
+
+/**
+ * @brief Adds the time since a timer was started as time spent running
+ * javascript and running statements.
+ */
+static void stats_add_js(pljs_stats_timer *timer) {
+  if (current_stats) {
+    double spi_time = pljs_statement_time - timer->statement_time;
+    double result_time = current_stats->result_time - timer->result_time;
+
+    current_stats->spi_time += spi_time;
+    current_stats->js_time += stats_elapsed(timer) - spi_time - result_time;
+  }
+}
+
+#if defined(__APPLE__) || defined(__linux__)
+/**
+ * @brief Overhead of an allocation, as counted by quickjs itself.
+ */
+#define JS_MALLOC_OVERHEAD 8
+
+/**
+ * @brief Size of an allocation of the runtime.
+ */
+static size_t js_allocation_size(const void *ptr) {
+#if defined(__APPLE__)
+  return malloc_size(ptr);
+#else
+  return malloc_usable_size((void *)ptr);
+#endif
+}
+
+/**
+ * @brief Counts memory allocated by the runtime.
+ *
+ * Keeps the accounting that quickjs does for `pljs.memory_limit`, along with
+ * the total allocated by every runtime.
+ */
+static void js_allocation_count(JSMallocState *s, ssize_t count,
+                                ssize_t size) {
+  s->malloc_count += count;
+  s->malloc_size += size;
+  js_allocated += size;
+
+  if (js_allocated > js_allocated_peak) {
+    js_allocated_peak = js_allocated;
+  }
+}
+
+static void *js_allocation_malloc(JSMallocState *s, size_t size) {
+  if (s->malloc_size + size > s->malloc_limit) {
+    return NULL;
+  }
+
+  void *ptr = malloc(size);
+
+  if (ptr) {
+    js_allocation_count(s, 1, js_allocation_size(ptr) + JS_MALLOC_OVERHEAD);
+  }
+
+  return ptr;
+}
+
+static void js_allocation_free(JSMallocState *s, void *ptr) {
+  if (ptr) {
+    ssize_t size = js_allocation_size(ptr) + JS_MALLOC_OVERHEAD;
+
+    js_allocation_count(s, -1, -size);
+    free(ptr);
+  }
+}
+
+static void *js_allocation_realloc(JSMallocState *s, void *ptr, size_t size) {
+  if (ptr == NULL) {
+    return size ? js_allocation_malloc(s, size) : NULL;
+  }
+
+  if (size == 0) {
+    js_allocation_free(s, ptr);
+
+    return NULL;
+  }
+
+  size_t old_size = js_allocation_size(ptr);
+
+  if (s->malloc_size + size - old_size > s->malloc_limit) {
+    return NULL;
+  }
+
+  ptr = realloc(ptr, size);
+
+  if (ptr) {
+    js_allocation_count(s, 0,
+                        (ssize_t)js_allocation_size(ptr) - (ssize_t)old_size);
+  }
+
+  return ptr;
+}
+
+/**
+ * @brief Allocation functions of the runtime.
+ */
+static const JSMallocFunctions js_allocation_functions = {
+    js_allocation_malloc, js_allocation_free, js_allocation_realloc,
+    js_allocation_size};
+#endif
+
 /**
  * @brief PostgreSQL extension initialization function.
  *
@@ -115,40 +432,354 @@ static int interrupt_handler(JSRuntime *rt, void *opaque) {
  * runtime.
  */
 void _PG_init(void) {
-  signal(SIGINT, signal_handler);
-  signal(SIGTERM, signal_handler);
-  signal(SIGABRT, signal_handler);
-
   // Initialize cache.
   pljs_cache_init();
 
+  // Evict functions from the cache when they are changed.
+  CacheRegisterSyscacheCallback(PROCOID, pljs_cache_function_invalidate,
+                                (Datum)0);
+
+  // Mark cached plans stale when the relations they use are changed.
+  CacheRegisterRelcacheCallback(pljs_cache_plan_invalidate, (Datum)0);
+
   // Initialize the GUCs.
   pljs_guc_init();
 
-  // Set up the quickjs runtime.
-  rt = JS_NewRuntime();
+  // Request shared memory when loaded through shared_preload_libraries.
+  pljs_shmem_init();
+
+  // Collect garbage at the end of transactions.
+  pljs_memory_init();
+
+  // The quickjs runtime shared by the roles without one of their own is only
+  // created once it is needed, see runtime_shared().
+}
+
+/**
+ * @brief Creates a quickjs runtime.
+ *
+ * The runtime counts what it allocates where the size of an allocation can
+ * be found, has the classes used by pljs registered, and takes its memory
+ * limit and garbage collection threshold from the current settings.
+ * @returns #JSRuntime of the new runtime.
+ */
+static JSRuntime *runtime_new(void) {
+#if defined(__APPLE__) || defined(__linux__)
+  JSRuntime *runtime = JS_NewRuntime2(&js_allocation_functions, NULL);
+#else
+  JSRuntime *runtime = JS_NewRuntime();
+#endif
+
+  if (runtime == NULL) {
+    ereport(ERROR, errcode(ERRCODE_OUT_OF_MEMORY),
+            errmsg("could not create a javascript runtime"));
+  }
+
+  // Register the classes used by pljs.
+  pljs_row_init(runtime);
+
+  // Let javascript be interrupted.
+  JS_SetInterruptHandler(runtime, interrupt_handler, NULL);
+
+  // Schedule the garbage collection.
+  pljs_gc_setup(runtime);
 
   // Set up a memory limit if it exists.
   if (configuration.memory_limit) {
-    JS_SetMemoryLimit(rt, configuration.memory_limit * 1024 * 1024);
+    JS_SetMemoryLimit(runtime, configuration.memory_limit * 1024 * 1024);
+  }
+
+  return runtime;
+}
+
+/**
+ * @brief Returns the runtime shared by the roles without one of their own.
+ *
+ * The runtime is created the first time it is needed rather than when pljs
+ * is loaded, as parallel workers load pljs before the settings of their
+ * leader are restored, and most of them never call a function.
+ * @returns #JSRuntime of the shared runtime.
+ */
+static JSRuntime *runtime_shared(void) {
+  if (rt == NULL) {
+    rt = runtime_new();
+  }
+
+  return rt;
+}
+
+/**
+ * @brief Creates the javascript context of the current user and caches it.
+ *
+ * With `pljs.runtime_per_role`, the context gets a runtime of its own, so
+ * that its memory limit, garbage collection and interrupts are kept apart
+ * from those of other roles.  Otherwise it shares the runtime of the
+ * backend.  Once cached, `pljs.start_proc` is run in the context, and
+ * `pljs.preload_functions` are compiled into it.
+ * @returns #JSContext of the new context.
+ */
+static JSContext *context_new(void) {
+  JSRuntime *runtime =
+      configuration.runtime_per_role ? runtime_new() : runtime_shared();
+
+  // Create a new execution context.
+  JSContext *ctx = JS_NewContext(runtime);
+
+  if (ctx == NULL) {
+    if (runtime != rt) {
+      JS_FreeRuntime(runtime);
+    }
+
+    ereport(ERROR, errcode(ERRCODE_OUT_OF_MEMORY),
+            errmsg("could not create a javascript context"));
+  }
+
+  // Set up the namespace, globals and functions available inside the
+  // context.
+  pljs_setup_namespace(ctx);
+
+  // Save the context in the cache for this user id.
+  pljs_cache_context_add(GetUserId(), ctx);
+
+  // A context that fails to start is not kept around half set up.
+  PG_TRY();
+  { context_start(); }
+  PG_CATCH();
+  {
+    pljs_cache_context_remove(GetUserId());
+    PG_RE_THROW();
+  }
+  PG_END_TRY();
+
+  return ctx;
+}
+
+/**
+ * @brief A context that values kept outside of javascript hold on to.
+ *
+ * Aggregate states and partition locals of window functions outlive the call
+ * that created them, their context is kept alive until they are released,
+ * even once it has been removed from the cache.
+ */
+typedef struct pljs_context_pin {
+  JSContext *ctx;
+  int count;     // number of values holding on to the context
+  bool released; // removed from the cache, freed along with the last value
+  dlist_node node;
+} pljs_context_pin;
+
+/**
+ * @brief Contexts pinned by values kept outside of javascript.
+ */
+static dlist_head context_pins = DLIST_STATIC_INIT(context_pins);
+
+/**
+ * @brief Runtimes of their own left behind by freed contexts, as objects of
+ * them were still alive.
+ */
+static List *abandoned_runtimes = NIL;
+
+/**
+ * @brief Finds the pin of a context, `NULL` if it is not pinned.
+ */
+static pljs_context_pin *context_pin_find(JSContext *ctx) {
+  dlist_iter iter;
+
+  dlist_foreach(iter, &context_pins) {
+    pljs_context_pin *pin = dlist_container(pljs_context_pin, node, iter.cur);
+
+    if (pin->ctx == ctx) {
+      return pin;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Keeps a context alive for a value that outlives the call.
+ *
+ * @param ctx #JSContext - the context the value belongs to
+ */
+void pljs_context_pin(JSContext *ctx) {
+  pljs_context_pin *pin = context_pin_find(ctx);
+
+  if (pin == NULL) {
+    pin = MemoryContextAllocZero(TopMemoryContext, sizeof(pljs_context_pin));
+    pin->ctx = ctx;
+    dlist_push_head(&context_pins, &pin->node);
+  }
+
+  pin->count++;
+}
+
+/**
+ * @brief Lets go of a context pinned by #pljs_context_pin.
+ *
+ * The last value released frees the context if it has been removed from the
+ * cache in the meantime.
+ * @param ctx #JSContext - the context the value belonged to
+ */
+void pljs_context_unpin(JSContext *ctx) {
+  pljs_context_pin *pin = context_pin_find(ctx);
+
+  Assert(pin != NULL);
+
+  if (--pin->count > 0) {
+    return;
+  }
+
+  bool released = pin->released;
+
+  dlist_delete(&pin->node);
+  pfree(pin);
+
+  if (released) {
+    pljs_context_free(ctx);
+  }
+}
+
+/**
+ * @brief Whether values kept outside of javascript hold on to a context.
+ */
+bool pljs_context_pinned(JSContext *ctx) {
+  return context_pin_find(ctx) != NULL;
+}
+
+/**
+ * @brief Lists the runtimes of contexts no longer in the cache.
+ *
+ * These are the runtimes of pinned contexts that have been removed from the
+ * cache, and runtimes left behind with objects still alive.
+ * @returns #List of the runtimes, allocated in the current memory context.
+ */
+List *pljs_released_runtimes(void) {
+  List *runtimes = list_copy(abandoned_runtimes);
+  dlist_iter iter;
+
+  dlist_foreach(iter, &context_pins) {
+    pljs_context_pin *pin = dlist_container(pljs_context_pin, node, iter.cur);
+
+    if (pin->released) {
+      runtimes = list_append_unique_ptr(runtimes, JS_GetRuntime(pin->ctx));
+    }
   }
+
+  return runtimes;
 }
 
+/**
+ * @brief Frees the runtimes left behind whose objects have all been
+ * collected since.
+ */
+void pljs_abandoned_runtimes_free(void) {
+  ListCell *lc;
+
+  foreach (lc, abandoned_runtimes) {
+    JSRuntime *runtime = lfirst(lc);
+    JSMemoryUsage usage;
+
+    JS_ComputeMemoryUsage(runtime, &usage);
+
+    if (usage.obj_count == 0) {
+      abandoned_runtimes = foreach_delete_current(abandoned_runtimes, lc);
+      JS_FreeRuntime(runtime);
+    }
+  }
+}
+
+/**
+ * @brief Frees a javascript context once it has been removed from the cache.
+ *
+ * A pinned context is only freed once the last value holding on to it has
+ * been released.  A context with a runtime of its own takes the runtime with
+ * it, unless objects of the runtime are somehow still alive, in which case
+ * the runtime is left behind rather than freed from under them.  It is still
+ * reported by pljs_memory_usage(), and pljs_gc() frees it once its objects
+ * are gone.  Contexts
+ * sharing the runtime of the backend leave their garbage to the garbage
+ * collector.
+ * @param ctx #JSContext - the context to free
+ */
+void pljs_context_free(JSContext *ctx) {
+  pljs_context_pin *pin = context_pin_find(ctx);
+
+  if (pin != NULL) {
+    pin->released = true;
+
+    return;
+  }
+
+  JSRuntime *runtime = JS_GetRuntime(ctx);
+
+  pljs_types_free(ctx);
+  JS_FreeContext(ctx);
+
+  if (runtime == rt) {
+    return;
+  }
+
+  JSMemoryUsage usage;
+
+  pljs_row_runtime_release(runtime);
+  JS_RunGC(runtime);
+  JS_ComputeMemoryUsage(runtime, &usage);
+
+  if (usage.obj_count > 0) {
+    elog(DEBUG1,
+         "not freeing a javascript runtime with " INT64_FORMAT
+         " objects left",
+         (int64)usage.obj_count);
+
+    MemoryContext old_context = MemoryContextSwitchTo(TopMemoryContext);
+
+    abandoned_runtimes = lappend(abandoned_runtimes, runtime);
+
+    MemoryContextSwitchTo(old_context);
+
+    return;
+  }
+
+  JS_FreeRuntime(runtime);
+}
+
+/**
+ * @brief Values of `pljs.execute_subtransactions`.
+ */
+static const struct config_enum_entry subtransactions_options[] = {
+    {"on", PLJS_SUBTRANSACTIONS_ON, false},
+    {"writes", PLJS_SUBTRANSACTIONS_WRITES, false},
+    {"off", PLJS_SUBTRANSACTIONS_OFF, false},
+    {"true", PLJS_SUBTRANSACTIONS_ON, true},
+    {"false", PLJS_SUBTRANSACTIONS_OFF, true},
+    {"yes", PLJS_SUBTRANSACTIONS_ON, true},
+    {"no", PLJS_SUBTRANSACTIONS_OFF, true},
+    {"1", PLJS_SUBTRANSACTIONS_ON, true},
+    {"0", PLJS_SUBTRANSACTIONS_OFF, true},
+    {NULL, 0, false}};
+
+/**
+ * @brief Values of `pljs.numeric_conversion`.
+ */
+static const struct config_enum_entry numeric_conversion_options[] = {
+    {"number", PLJS_NUMERIC_NUMBER, false},
+    {"bigint", PLJS_NUMERIC_BIGINT, false},
+    {"string", PLJS_NUMERIC_STRING, false},
+    {NULL, 0, false}};
+
 /**
  * @brief Set up the GUCs.
  *
  * Sets up the GUCs that help define the behavior of the interpreter.
  */
 void pljs_guc_init(void) {
-#ifdef EXECUTION_TIMEOUT
   DefineCustomIntVariable(
-      "pljs.execution_timeout", gettext_noop("Javascriot execution timeout."),
-      gettext_noop(
-          "The default value is 300 seconds."
-          "This allows you to override the default execution timeout."),
-      &configuration.execution_timeout, 300, 1, 65536, PGC_USERSET, 0, NULL,
-      NULL, NULL);
-#endif
+      "pljs.execution_timeout", gettext_noop("Javascript execution timeout."),
+      gettext_noop("Javascript is interrupted once a call has run for this "
+                   "long, including the statements it runs, 0 disables the "
+                   "timeout.  The default value is 0."),
+      &configuration.execution_timeout, 0, 0, INT_MAX / 1000, PGC_USERSET,
+      GUC_UNIT_S, NULL, NULL, NULL);
 
   DefineCustomIntVariable("pljs.memory_limit",
                           gettext_noop("Runtime limit in MBytes"),
@@ -156,10 +787,166 @@ void pljs_guc_init(void) {
                           (int *)&configuration.memory_limit, 256, 256, 3096,
                           PGC_SUSET, 0, NULL, NULL, NULL);
 
+  DefineCustomBoolVariable(
+      "pljs.bytecode_cache",
+      gettext_noop("Store compiled bytecode in the data directory."),
+      gettext_noop("When enabled, compiled functions are stored in the "
+                   "pljs_bytecode directory and loaded from there instead of "
+                   "being compiled again by other backends."),
+      &configuration.bytecode_cache, false, PGC_SUSET, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable(
+      "pljs.shared_cache_size",
+      gettext_noop("Shared bytecode cache size in MBytes."),
+      gettext_noop("Compiled bytecode is shared between backends when pljs "
+                   "is in shared_preload_libraries, 0 disables sharing.  The "
+                   "default value is 64 MB."),
+      &configuration.shared_cache_size, 64, 0, 65536, PGC_POSTMASTER,
+      GUC_UNIT_MB, NULL, NULL, NULL);
+
+  DefineCustomBoolVariable(
+      "pljs.lazy_rows", gettext_noop("Convert row columns on first access."),
+      gettext_noop("When enabled, trigger NEW and OLD and rows returned by "
+                   "queries only convert a column to javascript when it is "
+                   "first accessed."),
+      &configuration.lazy_rows, false, PGC_USERSET, 0, NULL, NULL, NULL);
+
+  DefineCustomBoolVariable(
+      "pljs.typed_arrays",
+      gettext_noop("Convert numeric arrays to typed arrays."),
+      gettext_noop("When enabled, int2, int4, int8, float4 and float8 arrays "
+                   "without nulls are passed to javascript as typed arrays, "
+                   "copied all at once, instead of as arrays.  Typed arrays "
+                   "have no push or concat, and Array.isArray is false for "
+                   "them."),
+      &configuration.typed_arrays, false, PGC_USERSET, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable(
+      "pljs.plan_cache_size",
+      gettext_noop("Number of plans cached for pljs.execute."),
+      gettext_noop("Queries run through pljs.execute with parameters are "
+                   "prepared once and their plans reused, 0 disables the "
+                   "cache.  The default value is 64 plans."),
+      &configuration.plan_cache_size, 64, 0, 65536, PGC_USERSET, 0, NULL,
+      NULL, NULL);
+
+  DefineCustomIntVariable(
+      "pljs.inline_cache_size",
+      gettext_noop("Number of DO blocks cached."),
+      gettext_noop("DO blocks are compiled once and cached by a hash of their "
+                   "source, 0 disables the cache.  The default value is 64 "
+                   "blocks."),
+      &configuration.inline_cache_size, 64, 0, 65536, PGC_USERSET, 0, NULL,
+      NULL, NULL);
+
+  DefineCustomIntVariable(
+      "pljs.cursor_batch_size",
+      gettext_noop("Number of rows prefetched when iterating over a cursor."),
+      gettext_noop("Cursors fetch this many rows at a time when iterated "
+                   "over or fetched one row at a time.  The default value is "
+                   "1000 rows."),
+      &configuration.cursor_batch_size, 1000, 1, INT_MAX, PGC_USERSET, 0,
+      NULL, NULL, NULL);
+
+  DefineCustomEnumVariable(
+      "pljs.execute_subtransactions",
+      gettext_noop("Run statements inside of subtransactions."),
+      gettext_noop("With on, every statement run by pljs.execute and plans "
+                   "runs in its own subtransaction, so that its errors can "
+                   "be caught.  With writes, statements are prepared first, "
+                   "and those that only read run without one, and with off "
+                   "no statement does.  Errors of statements run without a "
+                   "subtransaction cannot be caught, and abort the function "
+                   "at once.  Fetching from cursors only reads, and never "
+                   "runs in one."),
+      &configuration.execute_subtransactions, PLJS_SUBTRANSACTIONS_ON,
+      subtransactions_options, PGC_USERSET, 0, NULL, NULL, NULL);
+
+  DefineCustomEnumVariable(
+      "pljs.numeric_conversion",
+      gettext_noop("How numeric values are converted to javascript."),
+      gettext_noop("With number, numeric values become numbers, which may "
+                   "lose precision.  With bigint, integral values become a "
+                   "BigInt instead, and with string every value becomes a "
+                   "string of its exact value.  Strings and BigInts are "
+                   "converted back to numeric exactly."),
+      &configuration.numeric_conversion, PLJS_NUMERIC_NUMBER,
+      numeric_conversion_options, PGC_USERSET, 0, NULL, NULL, NULL);
+
+  DefineCustomBoolVariable(
+      "pljs.track_functions", gettext_noop("Collect function statistics."),
+      gettext_noop("When enabled, the time spent compiling, converting "
+                   "arguments and results, running javascript and running "
+                   "statements is kept for every function, and reported by "
+                   "pljs_stat_functions."),
+      &configuration.track_functions, false, PGC_SUSET, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable(
+      "pljs.gc_threshold",
+      gettext_noop("Memory allocated before the garbage collector runs."),
+      gettext_noop("The garbage collector runs once the runtime has "
+                   "allocated this much, and then again whenever it grows "
+                   "by half, 0 only collects at the end of transactions or "
+                   "through pljs_gc().  It applies to the runtimes of every "
+                   "role, so only superusers can change it.  The default "
+                   "value is 256 kB."),
+      &configuration.gc_threshold, 256, 0, INT_MAX / 1024, PGC_SUSET,
+      GUC_UNIT_KB, NULL, pljs_gc_threshold_assign, NULL);
+
+  DefineCustomBoolVariable(
+      "pljs.gc_at_transaction_end",
+      gettext_noop("Collect garbage at the end of transactions."),
+      gettext_noop("When enabled, the garbage collector runs once a "
+                   "transaction that ran javascript commits or aborts, "
+                   "instead of while functions run."),
+      &configuration.gc_at_transaction_end, false, PGC_USERSET, 0, NULL,
+      NULL, NULL);
+
+  DefineCustomBoolVariable(
+      "pljs.runtime_per_role",
+      gettext_noop("Give the context of every role a runtime of its own."),
+      gettext_noop("When enabled, the javascript context of a role is "
+                   "created in its own runtime, with the memory limit and "
+                   "garbage collection threshold in effect when it is "
+                   "created, such as those set by ALTER ROLE.  Otherwise "
+                   "every role shares the runtime of the backend."),
+      &configuration.runtime_per_role, false, PGC_SUSET, 0, NULL, NULL, NULL);
+
+  DefineCustomIntVariable(
+      "pljs.max_cached_contexts",
+      gettext_noop("Number of javascript contexts cached."),
+      gettext_noop("Every role calling pljs functions gets a javascript "
+                   "context, the least recently used contexts are freed "
+                   "along with their functions once more are cached, 0 "
+                   "keeps every context.  The default value is 0."),
+      &configuration.max_cached_contexts, 0, 0, INT_MAX, PGC_USERSET, 0, NULL,
+      NULL, NULL);
+
+  DefineCustomIntVariable(
+      "pljs.max_cached_functions",
+      gettext_noop("Number of compiled functions cached."),
+      gettext_noop("The least recently used functions of every context are "
+                   "freed once more are cached, 0 keeps every function.  "
+                   "The default value is 0."),
+      &configuration.max_cached_functions, 0, 0, INT_MAX, PGC_USERSET, 0,
+      NULL, NULL, NULL);
+
   DefineCustomStringVariable(
       "pljs.start_proc",
-      gettext_noop("PLJS function to run once when PLJS is first used."), NULL,
+      gettext_noop("PLJS function to run once when PLJS is first used."),
+      gettext_noop("The function is run whenever the javascript context of "
+                   "a role is created, before the function being called."),
       &configuration.start_proc, NULL, PGC_USERSET, 0, NULL, NULL, NULL);
+
+  DefineCustomStringVariable(
+      "pljs.preload_functions",
+      gettext_noop("PLJS functions compiled when a context is created."),
+      gettext_noop("A list of function names, compiled into the javascript "
+                   "context of a role when it is created, or when "
+                   "pljs_preload() is called, instead of when they are "
+                   "first called."),
+      &configuration.preload_functions, NULL, PGC_USERSET, GUC_LIST_INPUT,
+      NULL, NULL, NULL);
 }
 
 /**
@@ -204,6 +991,11 @@ static bool setup_function(FunctionCallInfo fcinfo, HeapTuple proctuple,
 
   pg_proc_entry = (Form_pg_proc)GETSTRUCT(proctuple);
 
+  // Remember which version of the function this is, so that the cache can
+  // tell when it has been replaced.
+  pljs_function->fn_xmin = HeapTupleHeaderGetRawXmin(proctuple->t_data);
+  pljs_function->fn_tid = proctuple->t_self;
+
   // Get the actual name of the procedure.
   strlcpy(pljs_function->proname, NameStr(pg_proc_entry->proname), NAMEDATALEN);
 
@@ -268,21 +1060,123 @@ static bool setup_function(FunctionCallInfo fcinfo, HeapTuple proctuple,
 }
 
 /**
- * @brief Converts all function call arguments from postgres to javascript.
+ * @brief Resolves and caches the state of a call site.
  *
- * Allocates and creates an array of arguments as javascript values.
+ * Looks up the function, finds or compiles it into the javascript context of
+ * the current user, and resolves the argument and return types for this call
+ * site.  The result is stored in `fcinfo->flinfo->fn_extra` so that any
+ * further calls from the same call site do not need to touch the catalog.
+ * @param fcinfo #FunctionCallInfo - the function call information
+ * @param is_trigger #bool - whether the function is being called as a trigger
+ * @returns #pljs_call_state for the call site.
  */
-static JSValueConst *convert_arguments_to_javascript(FunctionCallInfo fcinfo,
-                                                     HeapTuple proctuple,
-                                                     pljs_context *context) {
-  char **arguments;
+static pljs_call_state *setup_call_state(FunctionCallInfo fcinfo,
+                                         bool is_trigger) {
+  Oid fn_oid = fcinfo->flinfo->fn_oid;
+  pljs_call_state *state = (pljs_call_state *)fcinfo->flinfo->fn_extra;
+  HeapTuple proctuple;
+  JSContext *ctx;
   Oid *argtypes = NULL;
+  char **arguments;
   char *argmodes;
   int nargs;
 
+  // Everything resolved lives as long as the call site does.
+  MemoryContext old_context = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+
+  if (state == NULL) {
+    state = (pljs_call_state *)palloc0(sizeof(pljs_call_state));
+    fcinfo->flinfo->fn_extra = state;
+  } else {
+    // The state is being resolved again, so release what was resolved before.
+    if (state->argument_types) {
+      pfree(state->argument_types);
+    }
+
+    if (state->return_tupdesc) {
+      FreeTupleDesc(state->return_tupdesc);
+    }
+
+    memset(state, 0, sizeof(pljs_call_state));
+  }
+
+  proctuple = SearchSysCache(PROCOID, ObjectIdGetDatum(fn_oid), 0, 0, 0);
+
+  if (!HeapTupleIsValid(proctuple)) {
+    ereport(ERROR, errcode(ERRCODE_INTERNAL_ERROR),
+            errmsg("cache lookup failed for function %u", fn_oid));
+  }
+
+  // First search for a cached copy of the function, which is only used if
+  // the function has not been changed since it was cached.
+  pljs_function_cache_value *function_entry =
+      pljs_cache_function_find_current(GetUserId(), proctuple);
+
+  if (function_entry) {
+    // Make a copy of the function entry to the pljs context.
+    pljs_function_cache_to_context(&state->context, function_entry);
+    state->function_entry = function_entry;
+  } else {
+    // Check to see if a context exists in the cache for this user.
+    pljs_context_cache_value *entry = pljs_cache_context_find(GetUserId());
+
+    if (entry) {
+      ctx = entry->ctx;
+    } else {
+      ctx = context_new();
+    }
+
+    state->context.ctx = ctx;
+
+    // Set up a copy of all of the function data.
+    setup_function(fcinfo, proctuple, &state->context);
+
+    pljs_stats_timer timer;
+
+    // Compile the function.
+    stats_start(&timer);
+    state->context.js_function =
+        pljs_compile_function(&state->context, is_trigger);
+    STATS_ADD(compile_time, timer);
+
+    // Create the cache entry for the function.
+    state->function_entry = pljs_cache_function_add(&state->context);
+  }
+
+  Form_pg_proc pg_proc_entry = (Form_pg_proc)GETSTRUCT(proctuple);
+
+  // Resolve the return type for this call site.
+  Oid rettype = pg_proc_entry->prorettype;
+
+  if (!is_trigger && IsPolymorphicType(rettype)) {
+    rettype = get_fn_expr_rettype(fcinfo->flinfo);
+  }
+
+  state->context.function->rettype = rettype;
+  state->context.function->is_srf = pg_proc_entry->proretset;
+  state->context.function->is_window =
+      pg_proc_entry->prokind == PROKIND_WINDOW;
+
+  if (!is_trigger && rettype == RECORDOID) {
+    TupleDesc tupdesc;
+
+    if (get_call_result_type(fcinfo, &rettype, &tupdesc) !=
+            TYPEFUNC_COMPOSITE ||
+        tupdesc == NULL) {
+      ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                      errmsg("function returning record called in context "
+                             "that cannot accept type record")));
+    }
+
+    state->return_tupdesc = BlessTupleDesc(CreateTupleDescCopy(tupdesc));
+  }
+
+  pljs_type_fill(&state->return_type, rettype);
+
+  // Resolve the input argument types for this call site.
   nargs = get_func_arg_info(proctuple, &argtypes, &arguments, &argmodes);
 
-  JSValueConst *argv = (JSValueConst *)palloc(sizeof(JSValueConst) * nargs);
+  state->argument_types = (pljs_type *)palloc(sizeof(pljs_type) * (nargs + 1));
 
   int inargs = 0;
   for (int i = 0; i < nargs; i++) {
@@ -298,108 +1192,190 @@ static JSValueConst *convert_arguments_to_javascript(FunctionCallInfo fcinfo,
       continue;
     }
 
-    /* Resolve polymorphic types, if this is an actual call context. */
-    if (fcinfo && IsPolymorphicType(argtype)) {
-      argtype = get_fn_expr_argtype(fcinfo->flinfo, i);
-    }
-    if (fcinfo->args[inargs].isnull == 1) {
-      argv[inargs] = JS_NULL;
-    } else {
-      argv[inargs] = pljs_datum_to_jsvalue(fcinfo->args[inargs].value, argtype,
-                                           context->ctx);
+    // Resolve polymorphic types against the actual call.
+    if (IsPolymorphicType(argtype)) {
+      argtype = get_fn_expr_argtype(fcinfo->flinfo, inargs);
     }
 
+    pljs_type_fill(&state->argument_types[inargs], argtype);
+
     inargs++;
   }
 
+  state->context.function->inargs = inargs;
+
+  ReleaseSysCache(proctuple);
+
+  state->user_id = GetUserId();
+  state->cache_generation = pljs_cache_generation;
+
+  MemoryContextSwitchTo(old_context);
+
+  return state;
+}
+
+/**
+ * @brief Converts all function call arguments from postgres to javascript.
+ *
+ * Allocates and creates an array of arguments as javascript values, using
+ * the types already resolved for the call site.
+ */
+static JSValueConst *convert_arguments_to_javascript(FunctionCallInfo fcinfo,
+                                                     pljs_call_state *state) {
+  int inargs = state->context.function->inargs;
+
+  JSValueConst *argv =
+      (JSValueConst *)palloc(sizeof(JSValueConst) * (inargs + 1));
+
+  for (int i = 0; i < inargs; i++) {
+    if (fcinfo->args[i].isnull == 1) {
+      argv[i] = JS_NULL;
+    } else if (state->argument_types[i].typid == INTERNALOID) {
+      // The state of an aggregate, which is already a javascript value.
+      argv[i] = pljs_aggregate_state_get(state->context.ctx,
+                                         fcinfo->args[i].value);
+    } else {
+      argv[i] = pljs_datum_to_jsvalue_typed(fcinfo->args[i].value,
+                                            &state->argument_types[i],
+                                            state->context.ctx);
+    }
+  }
+
   return argv;
 }
 
 /**
- * @brief Call Javascript from PostgreSQL.
+ * @brief Calls a function or trigger.
  *
- * Calls Javascript in some form from PostgreSQL, returning the result on
- * success, or throwing an error on exception.  Calls can be of types
- * `function`, `procedure`, `do`, or `trigger`, and are dispatched from this
- * entry point.
- * @param PG_FUNCTION_ARGS Pointer to struct FunctionCallInfoBaseData
- * @returns @c #Datum of the result.
+ * Resolves the call site when needed, and dispatches the call.
  */
-Datum pljs_call_handler(PG_FUNCTION_ARGS) {
-  Oid fn_oid = fcinfo->flinfo->fn_oid;
-  HeapTuple proctuple;
-  JSContext *ctx;
-  Datum retval;
-  bool nonatomic = fcinfo->context && IsA(fcinfo->context, CallContext) &&
-                   !castNode(CallContext, fcinfo->context)->atomic;
+static Datum call_handler(FunctionCallInfo fcinfo) {
   bool is_trigger = CALLED_AS_TRIGGER(fcinfo);
-  pljs_context context = {0};
-
-  proctuple = SearchSysCache(PROCOID, ObjectIdGetDatum(fn_oid), 0, 0, 0);
+  pljs_call_state *state = (pljs_call_state *)fcinfo->flinfo->fn_extra;
+  Datum retval;
 
-  if (!HeapTupleIsValid(proctuple)) {
-    ereport(ERROR, errcode(ERRCODE_INTERNAL_ERROR),
-            errmsg("cache lookup failed for function %u", fn_oid));
+  // Only resolve the call site if it has not been seen yet, or if the cache
+  // has changed since it was resolved.
+  if (state == NULL || state->cache_generation != pljs_cache_generation ||
+      state->user_id != GetUserId()) {
+    state = setup_call_state(fcinfo, is_trigger);
+  } else {
+    pljs_cache_function_touch(state->function_entry);
   }
 
-  // First search for a cached copy of the context.
-  pljs_function_cache_value *function_entry =
-      pljs_cache_function_find(GetUserId(), fn_oid);
+  // A set returning function calling this one through SPI keeps its rows to
+  // itself, only a set returning function sets up a result of its own.
+  pljs_srf_state *previous_srf = current_srf;
 
-  if (function_entry) {
-    // Make a copy of the function entry to the pljs context.
-    pljs_function_cache_to_context(&context, function_entry);
-  } else {
-    // Check to see if a context exists in the cache for this user.
-    pljs_context_cache_value *entry = pljs_cache_context_find(GetUserId());
+  current_srf = NULL;
 
-    if (entry) {
-      ctx = entry->ctx;
+  PG_TRY();
+  {
+    if (is_trigger) {
+      // Call in the context of a trigger.
+      retval = pljs_call_trigger(fcinfo, state);
     } else {
-      // Create a new execution context.
-      ctx = JS_NewContext(rt);
-
-      // Set up the namespace, globals and functions available inside the
-      // context.
-      pljs_setup_namespace(ctx);
-
-      // Save the context in the cache for this user id.
-      pljs_cache_context_add(GetUserId(), ctx);
+      pljs_stats_timer timer;
+
+      // Call as a function.
+      stats_start(&timer);
+      JSValueConst *argv = convert_arguments_to_javascript(fcinfo, state);
+      STATS_ADD(arguments_time, timer);
+
+      if (state->context.function->is_srf) {
+        retval = pljs_call_srf(fcinfo, state, argv);
+      } else if (state->context.function->is_window) {
+        retval = pljs_call_window(fcinfo, state, argv);
+      } else {
+        retval = pljs_call_function(fcinfo, state, argv);
+      }
     }
+  }
+  PG_FINALLY();
+  { current_srf = previous_srf; }
+  PG_END_TRY();
 
-    context.ctx = ctx;
+  return retval;
+}
 
-    // Set up a copy of all of the function data.
-    setup_function(fcinfo, proctuple, &context);
+/**
+ * @brief Calls a function while keeping its statistics.
+ *
+ * Statistics of nested calls are kept separately, the time they take is
+ * also counted in the statistics of the calls they are made from.
+ */
+static Datum call_handler_tracked(FunctionCallInfo fcinfo) {
+  pljs_function_stats stats = {0};
+  pljs_function_stats *previous_stats = current_stats;
+  size_t previous_peak = js_allocated_peak;
+  size_t allocated = js_allocated;
+  instr_time start;
+  Datum retval;
 
-    // Compile the function.
-    context.js_function = pljs_compile_function(&context, is_trigger);
+  INSTR_TIME_SET_CURRENT(start);
 
-    // If there was a problem creating the function, we'll just return VOID.
-    if (JS_IsUndefined(context.js_function)) {
-      PG_RETURN_VOID();
-    }
+  current_stats = &stats;
+  js_allocated_peak = js_allocated;
 
-    // Create the cache entry for the function.
-    pljs_cache_function_add(&context);
+  PG_TRY();
+  { retval = call_handler(fcinfo); }
+  PG_FINALLY();
+  {
+    current_stats = previous_stats;
+    stats.peak_bytes = js_allocated_peak - allocated;
+    js_allocated_peak = Max(previous_peak, js_allocated_peak);
   }
+  PG_END_TRY();
 
-  ReleaseSysCache(proctuple);
+  instr_time elapsed;
 
-  if (is_trigger) {
-    // Call in the context of a trigger.
-    Form_pg_proc procStruct;
+  INSTR_TIME_SET_CURRENT(elapsed);
+  INSTR_TIME_SUBTRACT(elapsed, start);
 
-    procStruct = (Form_pg_proc)GETSTRUCT(proctuple);
+  stats.calls = 1;
+  stats.total_time = INSTR_TIME_GET_MILLISEC(elapsed);
 
-    context.function->rettype = procStruct->prorettype;
-    retval = pljs_call_trigger(fcinfo, &context);
-  } else {
-    // Call as a function.
-    JSValueConst *argv =
-        convert_arguments_to_javascript(fcinfo, proctuple, &context);
+  pljs_stats_report(fcinfo->flinfo->fn_oid, &stats);
+
+  return retval;
+}
+
+/**
+ * @brief Call Javascript from PostgreSQL.
+ *
+ * Calls Javascript in some form from PostgreSQL, returning the result on
+ * success, or throwing an error on exception.  Calls can be of types
+ * `function`, `procedure`, `do`, or `trigger`, and are dispatched from this
+ * entry point.
+ * @param PG_FUNCTION_ARGS Pointer to struct FunctionCallInfoBaseData
+ * @returns @c #Datum of the result.
+ */
+Datum pljs_call_handler(PG_FUNCTION_ARGS) {
+  Datum retval;
 
-    retval = pljs_call_function(fcinfo, &context, argv);
+  pljs_gc_request();
+
+  call_enter();
+
+  PG_TRY();
+  {
+    if (configuration.track_functions) {
+      retval = call_handler_tracked(fcinfo);
+    } else {
+      // Calls made from a tracked call are only counted in that call.
+      pljs_function_stats *previous_stats = current_stats;
+
+      current_stats = NULL;
+      retval = call_handler(fcinfo);
+      current_stats = previous_stats;
+    }
+  }
+  PG_FINALLY();
+  { call_depth--; }
+  PG_END_TRY();
+
+  if (call_depth == 0) {
+    pljs_cache_evict();
   }
 
   return retval;
@@ -419,35 +1395,47 @@ Datum pljs_inline_handler(PG_FUNCTION_ARGS) {
       (InlineCodeBlock *)DatumGetPointer(PG_GETARG_DATUM(0));
   char *sourcecode = code_block->source_text;
 
-  JSContext *ctx = NULL;
   bool nonatomic = fcinfo->context && IsA(fcinfo->context, CallContext) &&
                    !castNode(CallContext, fcinfo->context)->atomic;
 
-  // An inline handler is called separately, so there may not be a
-  // context created at this point.
-  if (entry) {
-    ctx = entry->ctx;
-  } else {
-    // Create a new execution context.
-    ctx = JS_NewContext(rt);
+  pljs_gc_request();
 
-    // Set up the namespace, globals and functions available inside the
-    // context.
-    pljs_setup_namespace(ctx);
+  call_enter();
 
-    // Save the context
-    pljs_cache_context_add(GetUserId(), ctx);
-  }
+  // A DO block run by a set returning function cannot add rows to its
+  // result.
+  pljs_srf_state *previous_srf = current_srf;
 
-  if (SPI_connect_ext(nonatomic ? SPI_OPT_NONATOMIC : 0) != SPI_OK_CONNECT) {
-    elog(ERROR, "could not connect to spi manager");
-  }
+  current_srf = NULL;
+
+  PG_TRY();
+  {
+    // An inline handler is called separately, so there may not be a
+    // context created at this point.  Creating one runs `pljs.start_proc`,
+    // which is part of the call, like it is for functions.
+    JSContext *ctx = entry ? entry->ctx : context_new();
+
+    if (SPI_connect_ext(nonatomic ? SPI_OPT_NONATOMIC : 0) !=
+        SPI_OK_CONNECT) {
+      elog(ERROR, "could not connect to spi manager");
+    }
 
-  // Call the function.
-  pljs_call_anonymous_function(ctx, sourcecode);
+    // Call the function.
+    pljs_call_anonymous_function(ctx, sourcecode);
+  }
+  PG_FINALLY();
+  {
+    call_depth--;
+    current_srf = previous_srf;
+  }
+  PG_END_TRY();
 
   SPI_finish();
 
+  if (call_depth == 0) {
+    pljs_cache_evict();
+  }
+
   PG_RETURN_VOID();
 }
 
@@ -466,44 +1454,117 @@ Datum pljs_call_validator(PG_FUNCTION_ARGS) {
   bool isnull;
   JSContext *ctx;
 
-  if (fcinfo->flinfo->fn_extra) {
-    elog(DEBUG3, "fn_extra on validate");
-  }
-  proctuple = SearchSysCache(PROCOID, ObjectIdGetDatum(fn_oid), 0, 0, 0);
+  if (fcinfo->flinfo->fn_extra) {
+    elog(DEBUG3, "fn_extra on validate");
+  }
+  proctuple = SearchSysCache(PROCOID, ObjectIdGetDatum(fn_oid), 0, 0, 0);
+
+  if (!HeapTupleIsValid(proctuple)) {
+    elog(ERROR, "cache lookup failed for function %u", fn_oid);
+  }
+
+  prosrcdatum =
+      SysCacheGetAttr(PROCOID, proctuple, Anum_pg_proc_prosrc, &isnull);
+
+  if (isnull) {
+    elog(ERROR, "null prosrc");
+  }
+
+  sourcecode = TextDatumGetCString(prosrcdatum);
+
+  ctx = JS_NewContext(runtime_shared());
+
+  JSValue val = JS_Eval(ctx, sourcecode, strlen(sourcecode), "<function>",
+                        JS_EVAL_FLAG_COMPILE_ONLY);
+
+  if (JS_IsException(val)) {
+    ereport(ERROR,
+            (errmsg("execution error"), errdetail("%s", dump_error(ctx))));
+  }
+
+  // call validator can release the context
+  JS_FreeContext(ctx);
+
+  ReleaseSysCache(proctuple);
+
+  // There is no need to clear the caches here, changing the function
+  // invalidates its `pg_proc` entry, and only that function is evicted from
+  // the cache the next time it is looked up.
+
+  PG_RETURN_VOID();
+}
+
+/**
+ * @brief Compile javascript source into bytecode, using cached bytecode.
+ *
+ * Looks for bytecode of the function with a matching source, first in the
+ * shared cache and then in the data directory, and only compiles the source
+ * if there is none.  Freshly compiled bytecode is published for use by other
+ * backends.
+ * @param ctx #JSContext - context to compile into
+ * @param fn_oid #Oid - the function being compiled
+ * @param source @c char * - the generated source of the function
+ * @param length #size_t - the length of the source
+ * @returns #JSValue of the compiled, but not yet evaluated, bytecode.
+ */
+static JSValue compile_bytecode(JSContext *ctx, Oid fn_oid, const char *source,
+                                size_t length) {
+  uint8 hash[STORAGE_HASH_LEN];
+  size_t bytecode_length;
+  JSValue compiled;
+
+  pljs_storage_hash(source, length, hash);
+
+  uint8 *bytecode = pljs_shared_cache_find(fn_oid, hash, &bytecode_length);
 
-  if (!HeapTupleIsValid(proctuple)) {
-    elog(ERROR, "cache lookup failed for function %u", fn_oid);
+  if (bytecode == NULL && configuration.bytecode_cache) {
+    bytecode = pljs_storage_load(fn_oid, hash, &bytecode_length);
+
+    if (bytecode != NULL) {
+      pljs_shared_cache_add(fn_oid, hash, bytecode, bytecode_length);
+    }
   }
 
-  prosrcdatum =
-      SysCacheGetAttr(PROCOID, proctuple, Anum_pg_proc_prosrc, &isnull);
+  if (bytecode != NULL) {
+    compiled =
+        JS_ReadObject(ctx, bytecode, bytecode_length, JS_READ_OBJ_BYTECODE);
 
-  if (isnull) {
-    elog(ERROR, "null prosrc");
+    pfree(bytecode);
+
+    if (!JS_IsException(compiled)) {
+      return compiled;
+    }
+
+    // Bytecode from a different version of quickjs will not load, clear the
+    // exception and fall back to compiling.
+    JS_FreeValue(ctx, JS_GetException(ctx));
   }
 
-  sourcecode = TextDatumGetCString(prosrcdatum);
+  compiled =
+      JS_Eval(ctx, source, length, "<function>", JS_EVAL_FLAG_COMPILE_ONLY);
 
-  ctx = JS_NewContext(rt);
+  if (JS_IsException(compiled)) {
+    return compiled;
+  }
 
-  JSValue val = JS_Eval(ctx, sourcecode, strlen(sourcecode), "<function>",
-                        JS_EVAL_FLAG_COMPILE_ONLY);
+  uint8_t *written =
+      JS_WriteObject(ctx, &bytecode_length, compiled, JS_WRITE_OBJ_BYTECODE);
 
-  if (JS_IsException(val)) {
-    ereport(ERROR,
-            (errmsg("execution error"), errdetail("%s", dump_error(ctx))));
+  if (written == NULL) {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+
+    return compiled;
   }
 
-  // call validator can release the context
-  JS_FreeContext(ctx);
+  pljs_shared_cache_add(fn_oid, hash, written, bytecode_length);
 
-  ReleaseSysCache(proctuple);
+  if (configuration.bytecode_cache) {
+    pljs_storage_save(fn_oid, hash, written, bytecode_length);
+  }
 
-  // We also clear the caches.  It is safest to just clear up any instances of
-  // the function or procedure.
-  pljs_cache_reset();
+  js_free(ctx, written);
 
-  PG_RETURN_VOID();
+  return compiled;
 }
 
 /**
@@ -523,12 +1584,16 @@ JSValue pljs_compile_function(pljs_context *context, bool is_trigger) {
 
   initStringInfo(&src);
 
-  // generate the function as javascript with all of its arguments
-  appendStringInfo(&src, "function %s (", context->function->proname);
+  // generate the function as javascript with all of its arguments, set
+  // returning functions are generators so that they can yield their rows.
+  appendStringInfo(&src, "%s %s (",
+                   context->function->is_srf ? "function*" : "function",
+                   context->function->proname);
 
   int inarg = 0;
   for (i = 0; i < context->function->nargs; i++) {
-    if (context->function->argmodes[i] == PROARGMODE_OUT) {
+    if (context->function->argmodes[i] == PROARGMODE_OUT ||
+        context->function->argmodes[i] == PROARGMODE_TABLE) {
       continue;
     }
     // commas between arguments
@@ -560,8 +1625,18 @@ JSValue pljs_compile_function(pljs_context *context, bool is_trigger) {
   appendStringInfo(&src, ") {\n%s\n}\n %s;\n", context->function->prosrc,
                    context->function->proname);
 
-  JSValue val =
-      JS_Eval(context->ctx, src.data, strlen(src.data), "<function>", 0);
+  JSValue val;
+
+  if ((configuration.bytecode_cache || pljs_shared_cache_enabled()) &&
+      OidIsValid(context->function->fn_oid)) {
+    JSValue compiled = compile_bytecode(context->ctx, context->function->fn_oid,
+                                        src.data, src.len);
+
+    val = JS_IsException(compiled) ? compiled
+                                   : JS_EvalFunction(context->ctx, compiled);
+  } else {
+    val = JS_Eval(context->ctx, src.data, strlen(src.data), "<function>", 0);
+  }
 
   if (!JS_IsException(val)) {
     pfree(src.data);
@@ -579,27 +1654,49 @@ JSValue pljs_compile_function(pljs_context *context, bool is_trigger) {
 
 /**
  * @brief Compile and call an anonymous function.
+ *
+ * The compiled block is cached by the hash of its source, so running the
+ * same `DO` block again skips parsing it.
  */
 static void pljs_call_anonymous_function(JSContext *ctx, const char *source) {
-  StringInfoData src;
+  uint8 hash[STORAGE_HASH_LEN];
 
-  initStringInfo(&src);
+  pljs_storage_hash(source, strlen(source), hash);
 
-  // generate the function as javascript with all of its arguments
-  appendStringInfo(&src, "(function () {\n%s\n})();", source);
+  JSValue bytecode = pljs_cache_inline_find(ctx, hash);
 
-  JS_SetInterruptHandler(JS_GetRuntime(ctx), interrupt_handler, NULL);
-  os_pending_signals &= ~((uint64_t)1 << SIGINT);
+  if (JS_IsUndefined(bytecode)) {
+    StringInfoData src;
 
-  JSValue val = JS_Eval(ctx, src.data, strlen(src.data), "<function>", 0);
+    initStringInfo(&src);
+
+    // generate the function as javascript with all of its arguments
+    appendStringInfo(&src, "(function () {\n%s\n})();", source);
+
+    bytecode = JS_Eval(ctx, src.data, src.len, "<function>",
+                       JS_EVAL_FLAG_COMPILE_ONLY);
 
-  if (!JS_IsException(val)) {
     pfree(src.data);
-  } else {
 
+    if (JS_IsException(bytecode)) {
+      ereport(ERROR,
+              (errmsg("execution error"), errdetail("%s", dump_error(ctx))));
+    }
+
+    pljs_cache_inline_add(ctx, hash, bytecode);
+  }
+
+  // Evaluating the block frees it, the cache keeps its own reference.
+  JSValue val = JS_EvalFunction(ctx, bytecode);
+
+  raise_call_error(ctx, val);
+
+  if (JS_IsException(val)) {
     ereport(ERROR,
             (errmsg("execution error"), errdetail("%s", dump_error(ctx))));
   }
+
+  JS_FreeValue(ctx, val);
 }
 
 /**
@@ -609,7 +1706,9 @@ static void pljs_call_anonymous_function(JSContext *ctx, const char *source) {
  * a trigger function.  This also determines the result type and
  * generates a resulting return Datum for postgres to injest.
  */
-static Datum pljs_call_trigger(FunctionCallInfo fcinfo, pljs_context *context) {
+static Datum pljs_call_trigger(FunctionCallInfo fcinfo,
+                               pljs_call_state *state) {
+  pljs_context *context = &state->context;
   TriggerData *trig = (TriggerData *)fcinfo->context;
   Relation rel = trig->tg_relation;
   TriggerEvent event = trig->tg_event;
@@ -620,6 +1719,9 @@ static Datum pljs_call_trigger(FunctionCallInfo fcinfo, pljs_context *context) {
       AllocSetContextCreate(CurrentMemoryContext, "PLJS Trigger Memory Context",
                             ALLOCSET_SMALL_SIZES);
   MemoryContext old_context = MemoryContextSwitchTo(execution_context);
+  pljs_stats_timer timer;
+
+  stats_start(&timer);
 
   if (TRIGGER_FIRED_FOR_ROW(event)) {
     TupleDesc tupdesc = RelationGetDescr(rel);
@@ -644,7 +1746,16 @@ static Datum pljs_call_trigger(FunctionCallInfo fcinfo, pljs_context *context) {
       argv[1] = tuple_to_jsvalue(context->ctx, tupdesc, trig->tg_trigtuple);
     }
   } else {
-    argv[0] = argv[1] = JS_UNDEFINED;
+    // Statement level triggers get the transition tables as NEW and OLD,
+    // when they reference them.
+    TupleDesc tupdesc = RelationGetDescr(rel);
+
+    argv[0] = trig->tg_newtable ? pljs_transition_table_new(
+                                      context->ctx, trig->tg_newtable, tupdesc)
+                                : JS_UNDEFINED;
+    argv[1] = trig->tg_oldtable ? pljs_transition_table_new(
+                                      context->ctx, trig->tg_oldtable, tupdesc)
+                                : JS_UNDEFINED;
   }
 
   // 2: TG_NAME
@@ -697,11 +1808,55 @@ static Datum pljs_call_trigger(FunctionCallInfo fcinfo, pljs_context *context) {
 
   argv[9] = tgargv;
 
-  JS_SetInterruptHandler(JS_GetRuntime(context->ctx), interrupt_handler, NULL);
-  os_pending_signals &= ~((uint64_t)1 << SIGINT);
+  STATS_ADD(arguments_time, timer);
+
+  if (SPI_connect() != SPI_OK_CONNECT) {
+    elog(ERROR, "could not connect to spi manager");
+  }
+
+  // Make the transition tables available to queries by name as well.
+  if (SPI_register_trigger_data(trig) != SPI_OK_TD_REGISTER) {
+    elog(ERROR, "could not register transition tables");
+  }
+
+  // Hold a reference to the function for the duration of the call, it can
+  // be replaced in the cache while it is running.
+  JSValue js_function = JS_DupValue(context->ctx, context->js_function);
+
+  JSValue ret;
+
+  stats_start(&timer);
+
+  // The transition tables are gone once the trigger returns, even when it
+  // fails, so they are closed in any case.
+  PG_TRY();
+  { ret = JS_Call(context->ctx, js_function, JS_UNDEFINED, 10, argv); }
+  PG_FINALLY();
+  {
+    if (!TRIGGER_FIRED_FOR_ROW(event)) {
+      pljs_transition_table_close(context->ctx, argv[0]);
+      pljs_transition_table_close(context->ctx, argv[1]);
+    }
+  }
+  PG_END_TRY();
+
+  stats_add_js(&timer);
+
+  // NEW itself is returned by most triggers, only its assigned columns need
+  // to be converted back then.
+  bool returned_new = TRIGGER_FIRED_FOR_ROW(event) && JS_IsObject(ret) &&
+                      JS_IsObject(argv[0]) &&
+                      JS_VALUE_GET_PTR(ret) == JS_VALUE_GET_PTR(argv[0]);
 
-  JSValue ret =
-      JS_Call(context->ctx, context->js_function, JS_UNDEFINED, 10, argv);
+  JS_FreeValue(context->ctx, js_function);
+
+  for (int i = 0; i < 10; i++) {
+    JS_FreeValue(context->ctx, argv[i]);
+  }
+
+  raise_call_error(context->ctx, ret);
+
+  SPI_finish();
 
   if (JS_IsException(ret)) {
     ereport(ERROR, (errmsg("execution error"),
@@ -713,15 +1868,24 @@ static Datum pljs_call_trigger(FunctionCallInfo fcinfo, pljs_context *context) {
     PG_RETURN_VOID();
   }
 
+  HeapTuple tuple;
+
   if (JS_IsNull(ret) || !TRIGGER_FIRED_FOR_ROW(event)) {
     result = PointerGetDatum(NULL);
+  } else if (returned_new &&
+             pljs_row_apply(context->ctx, ret,
+                            (HeapTuple)DatumGetPointer(result), &tuple)) {
+    result = PointerGetDatum(tuple);
   } else if (!JS_IsUndefined(ret)) {
 
     TupleDesc tupdesc = RelationGetDescr(rel);
 
-    pljs_type type;
-    pljs_type_fill(&type, context->function->rettype);
-    Datum d = pljs_jsvalue_to_record(ret, &type, context->ctx, NULL, tupdesc);
+    stats_start(&timer);
+
+    Datum d = pljs_jsvalue_to_record(ret, &state->return_type, context->ctx,
+                                     NULL, tupdesc);
+
+    STATS_ADD(result_time, timer);
 
     HeapTupleHeader header = DatumGetHeapTupleHeader(d);
 
@@ -741,37 +1905,38 @@ static Datum pljs_call_trigger(FunctionCallInfo fcinfo, pljs_context *context) {
  * an error on exception.
  * @returns @c #Datum of the result.
  */
-static Datum pljs_call_function(FunctionCallInfo fcinfo, pljs_context *context,
-                                JSValueConst *argv) {
+static Datum pljs_call_function(FunctionCallInfo fcinfo,
+                                pljs_call_state *state, JSValueConst *argv) {
+  pljs_context *context = &state->context;
   MemoryContext execution_context = AllocSetContextCreate(
       CurrentMemoryContext, "PLJS Memory Context", ALLOCSET_SMALL_SIZES);
   MemoryContext old_context = MemoryContextSwitchTo(execution_context);
 
-  Oid fn_oid = fcinfo->flinfo->fn_oid;
-  HeapTuple proctuple =
-      SearchSysCache(PROCOID, ObjectIdGetDatum(fn_oid), 0, 0, 0);
-
-  Oid rettype;
-  Form_pg_proc pg_proc_entry = (Form_pg_proc)GETSTRUCT(proctuple);
-
-  if (fcinfo && IsPolymorphicType(pg_proc_entry->prorettype)) {
-    rettype = get_fn_expr_rettype(fcinfo->flinfo);
-  } else {
-    rettype = pg_proc_entry->prorettype;
-  }
-  ReleaseSysCache(proctuple);
-
   bool nonatomic = fcinfo->context && IsA(fcinfo->context, CallContext) &&
                    !castNode(CallContext, fcinfo->context)->atomic;
   if (SPI_connect_ext(nonatomic ? SPI_OPT_NONATOMIC : 0) != SPI_OK_CONNECT) {
     elog(ERROR, "could not connect to spi manager");
   }
 
-  JS_SetInterruptHandler(JS_GetRuntime(context->ctx), interrupt_handler, NULL);
-  os_pending_signals &= ~((uint64_t)1 << SIGINT);
+  // Hold a reference to the function for the duration of the call, it can
+  // be replaced in the cache while it is running.
+  JSValue js_function = JS_DupValue(context->ctx, context->js_function);
+  pljs_stats_timer timer;
 
-  JSValue ret = JS_Call(context->ctx, context->js_function, JS_UNDEFINED,
+  stats_start(&timer);
+  JSValue ret = JS_Call(context->ctx, js_function, JS_UNDEFINED,
                         context->function->inargs, argv);
+  stats_add_js(&timer);
+
+  JS_FreeValue(context->ctx, js_function);
+
+  for (int i = 0; i < context->function->inargs; i++) {
+    JS_FreeValue(context->ctx, argv[i]);
+  }
+
+  // A statement that failed without a subtransaction has left SPI in no state
+  // to be finished, only aborting the transaction cleans up after it.
+  raise_call_error(context->ctx, ret);
 
   SPI_finish();
 
@@ -786,20 +1951,32 @@ static Datum pljs_call_function(FunctionCallInfo fcinfo, pljs_context *context,
     PG_RETURN_VOID();
   } else {
     Datum datum;
+    bool is_null = false;
+
+    stats_start(&timer);
+
+    if (state->return_tupdesc) {
+      datum = pljs_jsvalue_to_record(ret, &state->return_type, context->ctx,
+                                     &is_null, state->return_tupdesc);
+    } else if (state->return_type.typid == INTERNALOID) {
+      // A transition function keeps its state as a javascript value, and
+      // updates the state it was passed.
+      bool has_state = context->function->inargs > 0 &&
+                       state->argument_types[0].typid == INTERNALOID &&
+                       !fcinfo->args[0].isnull;
+
+      datum = pljs_aggregate_state_set(
+          fcinfo, context->ctx, has_state ? fcinfo->args[0].value : (Datum)0,
+          ret, &is_null);
+    } else {
+      datum = pljs_jsvalue_to_datum_typed(ret, &state->return_type,
+                                          context->ctx, fcinfo, &is_null);
+    }
 
-    if (rettype == RECORDOID) {
-      Oid rettype;
-      TupleDesc tupdesc;
-      get_call_result_type(fcinfo, &rettype, &tupdesc);
-
-      pljs_type type;
-      pljs_type_fill(&type, rettype);
+    STATS_ADD(result_time, timer);
 
-      datum = pljs_jsvalue_to_record(ret, &type, context->ctx, NULL, tupdesc);
-    } else {
-      bool is_null;
-      datum =
-          pljs_jsvalue_to_datum(ret, rettype, context->ctx, fcinfo, &is_null);
+    if (is_null) {
+      fcinfo->isnull = true;
     }
 
     JS_FreeValue(context->ctx, ret);
@@ -810,6 +1987,273 @@ static Datum pljs_call_function(FunctionCallInfo fcinfo, pljs_context *context,
   }
 }
 
+/**
+ * @brief Stores a row in the result of a set returning function.
+ *
+ * Converts a javascript value into a row, either a single value or a record
+ * depending on the return type, and adds it to the tuplestore.
+ */
+static void srf_store_row(pljs_srf_state *srf, JSContext *ctx,
+                          JSValueConst value) {
+  MemoryContext old_context = MemoryContextSwitchTo(srf->row_context);
+  pljs_stats_timer timer;
+
+  stats_start(&timer);
+
+  if (srf->is_scalar) {
+    bool is_null = false;
+    Datum datum =
+        pljs_jsvalue_to_datum_typed(value, srf->type, ctx, NULL, &is_null);
+
+    tuplestore_putvalues(srf->tuplestore, srf->tupdesc, &datum, &is_null);
+  } else if (JS_IsNull(value) || JS_IsUndefined(value)) {
+    Datum *values = palloc0(sizeof(Datum) * srf->tupdesc->natts);
+    bool *nulls = palloc(sizeof(bool) * srf->tupdesc->natts);
+
+    memset(nulls, true, sizeof(bool) * srf->tupdesc->natts);
+
+    tuplestore_putvalues(srf->tuplestore, srf->tupdesc, values, nulls);
+  } else {
+    bool is_null = false;
+    Datum record = pljs_jsvalue_to_record(value, srf->type, ctx, &is_null,
+                                          srf->tupdesc);
+    HeapTupleHeader header = DatumGetHeapTupleHeader(record);
+    HeapTupleData tuple;
+
+    tuple.t_len = HeapTupleHeaderGetDatumLength(header);
+    ItemPointerSetInvalid(&tuple.t_self);
+    tuple.t_tableOid = InvalidOid;
+    tuple.t_data = header;
+
+    tuplestore_puttuple(srf->tuplestore, &tuple);
+  }
+
+  STATS_ADD(result_time, timer);
+
+  MemoryContextSwitchTo(old_context);
+  MemoryContextReset(srf->row_context);
+}
+
+/**
+ * @brief Adds a row to the result of the set returning function being called.
+ *
+ * Backs `pljs.return_next`, which is only available to the set returning
+ * function itself.
+ * @returns @c bool of whether a set returning function is being called.
+ */
+bool pljs_return_next(JSContext *ctx, JSValueConst value) {
+  if (current_srf == NULL || current_srf->ctx != ctx) {
+    return false;
+  }
+
+  srf_store_row(current_srf, ctx, value);
+
+  return true;
+}
+
+/**
+ * @brief Steps through a generator of a set returning function until it is
+ * done, storing the rows it produces.
+ */
+static void srf_run_steps(pljs_srf_state *srf, JSContext *ctx,
+                          JSValueConst generator, JSValueConst next) {
+  bool done = false;
+
+  while (!done) {
+    CHECK_FOR_INTERRUPTS();
+
+    JSValue result = JS_Call(ctx, next, generator, 0, NULL);
+
+    raise_call_error(ctx, result);
+
+    if (JS_IsException(result)) {
+      ereport(ERROR, (errmsg("execution error"),
+                      errdetail("%s", dump_error(ctx))));
+    }
+
+    JSValue done_value = JS_GetPropertyStr(ctx, result, "done");
+    JSValue value = JS_GetPropertyStr(ctx, result, "value");
+
+    done = JS_ToBool(ctx, done_value);
+
+    JS_FreeValue(ctx, done_value);
+    JS_FreeValue(ctx, result);
+
+    if (!done) {
+      srf_store_row(srf, ctx, value);
+    } else if (JS_IsArray(ctx, value)) {
+      uint32_t length = js_array_length(ctx, value);
+
+      for (uint32_t i = 0; i < length; i++) {
+        JSValue element = JS_GetPropertyUint32(ctx, value, i);
+
+        srf_store_row(srf, ctx, element);
+        JS_FreeValue(ctx, element);
+      }
+    } else if (!JS_IsUndefined(value)) {
+      srf_store_row(srf, ctx, value);
+    }
+
+    JS_FreeValue(ctx, value);
+  }
+}
+
+/**
+ * @brief Runs the generator of a set returning function to completion.
+ *
+ * Stores each yielded value as a row as soon as it is produced, so that the
+ * result is never held in javascript as a whole.  A returned array adds each
+ * of its elements as a row, and any other returned value a single row.  The
+ * generator is freed, whether it completes or raises an error.
+ */
+static void srf_run_generator(pljs_srf_state *srf, JSContext *ctx,
+                              JSValue generator) {
+  JSValue next = JS_GetPropertyStr(ctx, generator, "next");
+
+  PG_TRY();
+  { srf_run_steps(srf, ctx, generator, next); }
+  PG_FINALLY();
+  {
+    JS_FreeValue(ctx, next);
+    JS_FreeValue(ctx, generator);
+  }
+  PG_END_TRY();
+}
+
+/**
+ * @brief Call a window function.
+ *
+ * Window functions are passed `null` for all of their arguments, and read
+ * them through `pljs.window` instead, so that only the values they look at
+ * are converted.
+ * @returns @c #Datum of the result.
+ */
+static Datum pljs_call_window(FunctionCallInfo fcinfo, pljs_call_state *state,
+                              JSValueConst *argv) {
+  // Window functions can call each other, the window they are called for
+  // is restored once they return.
+  pljs_window previous = pljs_window_enter(PG_WINDOW_OBJECT(), state);
+  Datum retval;
+
+  PG_TRY();
+  { retval = pljs_call_function(fcinfo, state, argv); }
+  PG_FINALLY();
+  { pljs_window_leave(previous); }
+  PG_END_TRY();
+
+  return retval;
+}
+
+/**
+ * @brief Call a set returning Javascript function.
+ *
+ * Set returning functions are compiled as generators, and rows are stored
+ * in a tuplestore in materialize mode as they are yielded or passed to
+ * `pljs.return_next`.
+ * @returns @c #Datum of the result, which is returned through `resultinfo`.
+ */
+static Datum pljs_call_srf(FunctionCallInfo fcinfo, pljs_call_state *state,
+                           JSValueConst *argv) {
+  pljs_context *context = &state->context;
+  ReturnSetInfo *rsi = (ReturnSetInfo *)fcinfo->resultinfo;
+  pljs_srf_state srf;
+
+  if (rsi == NULL || !IsA(rsi, ReturnSetInfo) ||
+      !(rsi->allowedModes & SFRM_Materialize)) {
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                    errmsg("set-valued function called in context that "
+                           "cannot accept a set")));
+  }
+
+  // The result outlives the call, so it needs to be in per query memory.
+  MemoryContext old_context =
+      MemoryContextSwitchTo(rsi->econtext->ecxt_per_query_memory);
+
+  srf.type = &state->return_type;
+
+  if (state->return_tupdesc) {
+    srf.tupdesc = CreateTupleDescCopy(state->return_tupdesc);
+    srf.is_scalar = false;
+  } else if (state->return_type.is_composite &&
+             state->return_type.category != TYPCATEGORY_ARRAY) {
+    srf.tupdesc = lookup_rowtype_tupdesc_copy(state->return_type.typid, -1);
+    srf.is_scalar = false;
+  } else {
+    srf.tupdesc = CreateTemplateTupleDesc(1);
+    TupleDescInitEntry(srf.tupdesc, (AttrNumber)1, "pljs",
+                       context->function->rettype, -1, 0);
+    srf.is_scalar = true;
+  }
+
+  srf.tuplestore = tuplestore_begin_heap(
+      (rsi->allowedModes & SFRM_Materialize_Random) != 0, false, work_mem);
+
+  MemoryContextSwitchTo(old_context);
+
+  MemoryContext execution_context = AllocSetContextCreate(
+      CurrentMemoryContext, "PLJS Memory Context", ALLOCSET_SMALL_SIZES);
+  srf.row_context = AllocSetContextCreate(
+      execution_context, "PLJS Row Memory Context", ALLOCSET_DEFAULT_SIZES);
+
+  old_context = MemoryContextSwitchTo(execution_context);
+
+  if (SPI_connect() != SPI_OK_CONNECT) {
+    elog(ERROR, "could not connect to spi manager");
+  }
+
+  srf.ctx = context->ctx;
+
+  pljs_srf_state *previous_srf = current_srf;
+  current_srf = &srf;
+
+  pljs_stats_timer timer;
+
+  // Rows are converted as they are produced, which is not counted as running
+  // javascript.
+  stats_start(&timer);
+
+  PG_TRY();
+  {
+    // Hold a reference to the function for the duration of the call, it can
+    // be replaced in the cache while it is running.
+    JSValue js_function = JS_DupValue(context->ctx, context->js_function);
+
+    JSValue generator = JS_Call(context->ctx, js_function, JS_UNDEFINED,
+                                context->function->inargs, argv);
+
+    JS_FreeValue(context->ctx, js_function);
+
+    for (int i = 0; i < context->function->inargs; i++) {
+      JS_FreeValue(context->ctx, argv[i]);
+    }
+
+    raise_call_error(context->ctx, generator);
+
+    if (JS_IsException(generator)) {
+      ereport(ERROR, (errmsg("execution error"),
+                      errdetail("%s", dump_error(context->ctx))));
+    }
+
+    srf_run_generator(&srf, context->ctx, generator);
+  }
+  PG_FINALLY();
+  { current_srf = previous_srf; }
+  PG_END_TRY();
+
+  stats_add_js(&timer);
+
+  SPI_finish();
+
+  MemoryContextSwitchTo(old_context);
+  MemoryContextDelete(execution_context);
+
+  rsi->returnMode = SFRM_Materialize;
+  rsi->setResult = srf.tuplestore;
+  rsi->setDesc = srf.tupdesc;
+
+  PG_RETURN_NULL();
+}
+
 /**
  * @brief Throws a Javascript exception.
  *
@@ -843,6 +2287,7 @@ JSValue pljs_find_js_function(Oid fn_oid) {
 
   /* Should not happen? */
   if (!OidIsValid(prolang)) { // NOLINT
+    ReleaseSysCache(functuple);
     return func;
   }
 
@@ -856,6 +2301,7 @@ JSValue pljs_find_js_function(Oid fn_oid) {
     ReleaseSysCache(langtuple);
 
     if (langtupoid != prolang) {
+      ReleaseSysCache(functuple);
       return func;
     }
   }
@@ -863,24 +2309,26 @@ JSValue pljs_find_js_function(Oid fn_oid) {
   pljs_context context = {0};
 
   pljs_function_cache_value *function_entry =
-      pljs_cache_function_find(GetUserId(), fn_oid);
+      pljs_cache_function_find_current(GetUserId(), functuple);
 
   if (function_entry != NULL) {
     pljs_function_cache_to_context(&context, function_entry);
 
-    func = context.js_function;
+    // The cache keeps its own reference to the function.
+    func = JS_DupValue(context.ctx, context.js_function);
   } else {
     pljs_context_cache_value *context_entry =
         pljs_cache_context_find(GetUserId());
 
     context.ctx = context_entry->ctx;
     setup_function(NULL, functuple, &context);
+    context.function->fn_oid = fn_oid;
 
     func = pljs_compile_function(&context, false);
-
-    ReleaseSysCache(functuple);
   }
 
+  ReleaseSysCache(functuple);
+
   // If there was a problem creating the function, we'll just return VOID.
   if (JS_IsUndefined(func)) {
     return JS_UNDEFINED;
@@ -888,3 +2336,153 @@ JSValue pljs_find_js_function(Oid fn_oid) {
 
   return func;
 }
+
+/**
+ * @brief Runs `pljs.start_proc` and compiles `pljs.preload_functions` in the
+ * context just created for the current user.
+ *
+ * The start function is called like any other function, with the privileges
+ * of the current user, and can set up globals or load code shared by other
+ * functions.
+ */
+static void context_start(void) {
+  pljs_context_cache_value *entry = pljs_cache_context_find(GetUserId());
+
+  if (configuration.start_proc != NULL && configuration.start_proc[0] != '\0') {
+    Oid fn_oid = DatumGetObjectId(DirectFunctionCall1(
+        regprocin, CStringGetDatum(configuration.start_proc)));
+
+#if PG_VERSION_NUM >= 160000
+    AclResult aclresult =
+        object_aclcheck(ProcedureRelationId, fn_oid, GetUserId(), ACL_EXECUTE);
+#else
+    AclResult aclresult = pg_proc_aclcheck(fn_oid, GetUserId(), ACL_EXECUTE);
+#endif
+
+    if (aclresult != ACLCHECK_OK) {
+      aclcheck_error(aclresult, OBJECT_FUNCTION, get_func_name(fn_oid));
+    }
+
+    FmgrInfo flinfo;
+    LOCAL_FCINFO(fcinfo, 0);
+
+    fmgr_info(fn_oid, &flinfo);
+    InitFunctionCallInfoData(*fcinfo, &flinfo, 0, InvalidOid, NULL, NULL);
+
+    FunctionCallInvoke(fcinfo);
+  }
+
+  preload_functions(entry->ctx);
+}
+
+/**
+ * @brief Compiles the functions of `pljs.preload_functions` into a context.
+ *
+ * Every pljs function matching a name of the list, through the search path
+ * unless the name is qualified, is compiled and cached unless it already is.
+ * Names that match no function are skipped with a warning.
+ * @param ctx #JSContext - the context of the current user
+ */
+static void preload_functions(JSContext *ctx) {
+  List *names;
+  ListCell *lc;
+
+  if (configuration.preload_functions == NULL ||
+      configuration.preload_functions[0] == '\0') {
+    return;
+  }
+
+  char *rawnames = pstrdup(configuration.preload_functions);
+
+  if (!SplitGUCList(rawnames, ',', &names)) {
+    ereport(ERROR, errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+            errmsg("invalid list syntax in pljs.preload_functions"));
+  }
+
+  Oid language_oid = get_language_oid("pljs", false);
+
+  foreach (lc, names) {
+    char *name = (char *)lfirst(lc);
+
+#if PG_VERSION_NUM >= 160000
+    List *qualified_name = stringToQualifiedNameList(name, NULL);
+#else
+    List *qualified_name = stringToQualifiedNameList(name);
+#endif
+
+    FuncCandidateList candidates = FuncnameGetCandidates(
+        qualified_name, -1, NIL, false, false, false, true);
+
+    if (candidates == NULL) {
+      ereport(WARNING, errcode(ERRCODE_UNDEFINED_FUNCTION),
+              errmsg("function %s in pljs.preload_functions does not exist",
+                     name));
+    }
+
+    for (; candidates != NULL; candidates = candidates->next) {
+      HeapTuple proctuple =
+          SearchSysCache1(PROCOID, ObjectIdGetDatum(candidates->oid));
+
+      if (!HeapTupleIsValid(proctuple)) {
+        continue;
+      }
+
+      Form_pg_proc proc = (Form_pg_proc)GETSTRUCT(proctuple);
+
+      if (proc->prolang != language_oid ||
+          pljs_cache_function_find_current(GetUserId(), proctuple) != NULL) {
+        ReleaseSysCache(proctuple);
+
+        continue;
+      }
+
+      pljs_context context = {0};
+
+      context.ctx = ctx;
+      setup_function(NULL, proctuple, &context);
+      context.function->fn_oid = candidates->oid;
+      context.js_function =
+          pljs_compile_function(&context, proc->prorettype == TRIGGEROID);
+
+      pljs_cache_function_add(&context);
+
+      ReleaseSysCache(proctuple);
+    }
+  }
+}
+
+/**
+ * @brief Prepares the context of the current user ahead of its first call.
+ *
+ * Creates the context if it does not exist yet, which runs
+ * `pljs.start_proc`, and compiles the functions of
+ * `pljs.preload_functions` that are not cached yet.  Meant to be called when
+ * a connection is set up, so that the first call does not pay for any of it.
+ * @returns @c int8 of the number of functions cached in the context.
+ */
+Datum pljs_preload(PG_FUNCTION_ARGS) {
+  pljs_context_cache_value *entry = pljs_cache_context_find(GetUserId());
+
+  call_enter();
+
+  PG_TRY();
+  {
+    if (entry) {
+      preload_functions(entry->ctx);
+    } else {
+      context_new();
+    }
+  }
+  PG_FINALLY();
+  { call_depth--; }
+  PG_END_TRY();
+
+  entry = pljs_cache_context_find(GetUserId());
+  int64 functions = hash_get_num_entries(entry->function_hash_table);
+
+  if (call_depth == 0) {
+    pljs_cache_evict();
+  }
+
+  PG_RETURN_INT64(functions);
+}
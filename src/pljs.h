@@ -7,8 +7,10 @@
 #include "access/tupdesc.h"
 #include "executor/spi.h"
 #include "fmgr.h"
+#include "lib/ilist.h"
 #include "nodes/params.h"
 #include "parser/parse_node.h"
+#include "windowapi.h"
 
 #include "deps/quickjs/quickjs-libc.h"
 #include "deps/quickjs/quickjs.h"
@@ -19,11 +21,42 @@
 #define PLJS_VERSION "unknown"
 #endif
 
+// When statements run by `pljs.execute` and plans are wrapped in a
+// subtransaction.
+typedef enum pljs_subtransactions {
+  PLJS_SUBTRANSACTIONS_OFF,    // never
+  PLJS_SUBTRANSACTIONS_WRITES, // unless the statement only reads
+  PLJS_SUBTRANSACTIONS_ON,     // always
+} pljs_subtransactions;
+
+// how numeric values are converted to javascript.
+typedef enum pljs_numeric_conversion {
+  PLJS_NUMERIC_NUMBER, // a number, which may lose precision
+  PLJS_NUMERIC_BIGINT, // a BigInt when integral, otherwise a number
+  PLJS_NUMERIC_STRING, // a string of the exact value
+} pljs_numeric_conversion;
+
 // pljs current runtime configuration.
 typedef struct pljs_configuration {
   size_t memory_limit;
   char *start_proc;
+  char *preload_functions;
   int execution_timeout;
+  bool bytecode_cache;
+  int shared_cache_size;
+  bool lazy_rows;
+  bool typed_arrays;
+  int plan_cache_size;
+  int inline_cache_size;
+  int cursor_batch_size;
+  int execute_subtransactions; // #pljs_subtransactions
+  int numeric_conversion;      // #pljs_numeric_conversion
+  bool track_functions;
+  int gc_threshold; // in kB, 0 leaves collection to pljs_gc()
+  bool gc_at_transaction_end;
+  bool runtime_per_role;
+  int max_cached_contexts;  // 0 for no limit
+  int max_cached_functions; // 0 for no limit
 } pljs_configuration;
 
 // Global #pljs_configuration configuration.
@@ -38,11 +71,26 @@ typedef struct pljs_context_cache_value {
   JSContext *ctx;
   MemoryContext function_memory_context;
   HTAB *function_hash_table;
+  HTAB *plan_hash_table;   // plans prepared by `pljs.execute`, by query
+  dlist_head plan_lru;     // plans, most recently used first
+  HTAB *inline_hash_table; // compiled `DO` blocks, by hash of their source
+  dlist_head inline_lru;   // `DO` blocks, most recently used first
+  dlist_node lru_node;     // position in the least recently used contexts
 } pljs_context_cache_value;
 
+// Compiled `DO` block cache value definition.
+typedef struct pljs_inline_cache_value {
+  uint8 hash[STORAGE_HASH_LEN]; // hash of the source, the key
+  JSValue bytecode;             // the compiled block, run with JS_EvalFunction
+  dlist_node lru_node;          // position in the least recently used list
+} pljs_inline_cache_value;
+
 // Function cache value defition.
 typedef struct pljs_function_cache_value {
   Oid fn_oid;
+  TransactionId fn_xmin;
+  ItemPointerData fn_tid;
+  uint32 hashvalue; // syscache hash value of the `pg_proc` entry
   JSValue fn;
   JSContext *ctx;
   bool trigger;
@@ -52,6 +100,8 @@ typedef struct pljs_function_cache_value {
   Oid argtypes[FUNC_MAX_ARGS];
   char argmodes[FUNC_MAX_ARGS];
   char *prosrc;
+  dlist_node lru_node; // position in the least recently used functions
+  pljs_context_cache_value *context_entry;
 } pljs_function_cache_value;
 
 typedef struct pljs_param_state {
@@ -60,6 +110,16 @@ typedef struct pljs_param_state {
   MemoryContext memory_context;
 } pljs_param_state;
 
+// Plan cache value definition, for plans prepared automatically.
+typedef struct pljs_plan_cache_value {
+  const char *sql;            // the text of the query, the key
+  SPIPlanPtr plan;            // the saved plan
+  pljs_param_state *parstate; // parameter types inferred for the plan
+  dlist_node lru_node;        // position in the least recently used list
+  int refcount;               // executions of the plan in progress
+  bool stale;                 // a relation the plan depends on has changed
+} pljs_plan_cache_value;
+
 // Expanded type definitions for pljs.
 typedef struct pljs_type {
   Oid typid;
@@ -69,10 +129,24 @@ typedef struct pljs_type {
   char align;
   char category;
   bool is_composite;
+  char element_category; // category of the elements, for arrays
   FmgrInfo fn_input;
   FmgrInfo fn_output;
 } pljs_type;
 
+// Statistics of the calls of a function, kept when `pljs.track_functions` is
+// on.  Times are in milliseconds.
+typedef struct pljs_function_stats {
+  int64 calls;
+  double total_time;
+  double compile_time;
+  double arguments_time; // converting the arguments to javascript
+  double js_time;        // running javascript, outside of statements
+  double spi_time;       // running statements
+  double result_time;    // converting the result from javascript
+  int64 peak_bytes;      // most javascript memory allocated by a call
+} pljs_function_stats;
+
 // Plan for prepared statements.
 typedef struct pljs_plan {
   SPIPlanPtr plan;
@@ -94,6 +168,7 @@ typedef struct pljs_func {
   int inargs;                   // the number of input arguments
   int nargs;                    // the total number of arguments
   bool is_srf;                  // are we a set returning function?
+  bool is_window;               // are we a window function?
   Oid rettype;                  // the return type
   Oid argtypes[FUNC_MAX_ARGS];  // the types of the argument passed
   char argmodes[FUNC_MAX_ARGS]; // mode of each argument
@@ -108,6 +183,26 @@ typedef struct pljs_context {
   pljs_func *function;
 } pljs_context;
 
+// Per call site state, hung off of `fcinfo->flinfo->fn_extra`.  This holds
+// everything that has been resolved from the catalog for a call site, so
+// that subsequent calls do not need to look anything up.
+typedef struct pljs_call_state {
+  uint64 cache_generation;   // cache generation this state is valid for
+  // The cached function, only valid for `cache_generation`.
+  pljs_function_cache_value *function_entry;
+  Oid user_id;               // the user the state was resolved for
+  pljs_context context;      // the function and its javascript context
+  pljs_type return_type;     // the resolved return type
+  TupleDesc return_tupdesc;  // result descriptor, when returning a record
+  pljs_type *argument_types; // the resolved types of the input arguments
+} pljs_call_state;
+
+// The window function being called, for `pljs.window` to work on.
+typedef struct pljs_window {
+  WindowObject winobj;    // the window of the call
+  pljs_call_state *state; // the call state of the window function
+} pljs_window;
+
 // Functions in pljs.c
 JSValue js_throw(JSContext *, const char *);
 void _PG_init(void);
@@ -117,12 +212,28 @@ void pljs_cache_reset(void);
 void pljs_setup_namespace(JSContext *);
 JSValue pljs_compile_function(pljs_context *context, bool is_trigger);
 JSValue pljs_find_js_function(Oid fn_oid);
+bool pljs_return_next(JSContext *ctx, JSValueConst value);
+void pljs_context_free(JSContext *);
+void pljs_context_pin(JSContext *);
+void pljs_context_unpin(JSContext *);
+bool pljs_context_pinned(JSContext *);
+List *pljs_released_runtimes(void);
+void pljs_abandoned_runtimes_free(void);
 
 // Functions in cache.c
+extern HTAB *pljs_context_HashTable;
+extern uint64 pljs_cache_generation;
+
 void pljs_cache_context_add(Oid, JSContext *);
 void pljs_cache_context_remove(Oid);
 pljs_function_cache_value *pljs_cache_function_find(Oid user_id, Oid fn_oid);
-void pljs_cache_function_add(pljs_context *context);
+pljs_function_cache_value *pljs_cache_function_find_current(Oid user_id,
+                                                            HeapTuple);
+void pljs_cache_function_remove(Oid user_id, Oid fn_oid);
+void pljs_cache_function_invalidate(Datum, int, uint32);
+pljs_function_cache_value *pljs_cache_function_add(pljs_context *context);
+void pljs_cache_function_touch(pljs_function_cache_value *);
+void pljs_cache_evict(void);
 pljs_context_cache_value *pljs_cache_context_find(Oid user_id);
 
 void pljs_function_cache_to_context(pljs_context *,
@@ -130,10 +241,78 @@ void pljs_function_cache_to_context(pljs_context *,
 void pljs_context_to_function_cache(pljs_function_cache_value *function_entry,
                                     pljs_context *context);
 
+pljs_plan_cache_value *pljs_cache_plan_acquire(JSContext *ctx,
+                                               const char *sql);
+void pljs_cache_plan_release(pljs_plan_cache_value *entry);
+JSValue pljs_cache_inline_find(JSContext *ctx, const uint8 *hash);
+void pljs_cache_inline_add(JSContext *ctx, const uint8 *hash,
+                           JSValue bytecode);
+void pljs_cache_plan_invalidate(Datum, Oid);
+
+// Functions in storage.c
+void pljs_storage_hash(const char *source, size_t length, uint8 *hash);
+uint8 *pljs_storage_load(Oid fn_oid, const uint8 *hash, size_t *length);
+void pljs_storage_save(Oid fn_oid, const uint8 *hash, const uint8 *bytecode,
+                       size_t length);
+void pljs_storage_remove(Oid fn_oid);
+
+// Functions in shmem.c
+void pljs_shmem_init(void);
+bool pljs_shared_cache_enabled(void);
+uint8 *pljs_shared_cache_find(Oid fn_oid, const uint8 *hash, size_t *length);
+void pljs_shared_cache_add(Oid fn_oid, const uint8 *hash,
+                           const uint8 *bytecode, size_t length);
+void pljs_stats_report(Oid fn_oid, const pljs_function_stats *call);
+
+// Functions in row.c
+typedef struct pljs_row_shape pljs_row_shape;
+
+void pljs_row_init(JSRuntime *);
+pljs_row_shape *pljs_row_shape_new(JSContext *, TupleDesc);
+void pljs_row_shape_release(JSRuntime *, pljs_row_shape *);
+void pljs_row_runtime_release(JSRuntime *);
+JSValue pljs_row_new(JSContext *, pljs_row_shape *, HeapTuple);
+JSValue pljs_row_to_object(JSContext *, pljs_row_shape *, HeapTuple);
+bool pljs_row_apply(JSContext *, JSValueConst, HeapTuple, HeapTuple *);
+
+// Functions in transition.c
+JSValue pljs_transition_table_new(JSContext *, Tuplestorestate *, TupleDesc);
+void pljs_transition_table_close(JSContext *, JSValueConst);
+
+// Functions in aggregate.c
+JSValue pljs_aggregate_state_get(JSContext *, Datum);
+Datum pljs_aggregate_state_set(FunctionCallInfo, JSContext *, Datum,
+                               JSValueConst, bool *);
+
+// Functions in window.c
+void pljs_window_init(JSContext *);
+pljs_window pljs_window_enter(WindowObject, pljs_call_state *);
+void pljs_window_leave(pljs_window);
+
+// Functions in copy.c
+uint64 pljs_copy_from(JSContext *, const char *, JSValueConst, JSValueConst);
+
+// Functions in memory.c
+void pljs_memory_init(void);
+void pljs_gc_setup(JSRuntime *);
+void pljs_gc_threshold_assign(int newval, void *extra);
+void pljs_gc_request(void);
+
+// Functions in functions.c
+extern double pljs_statement_time;
+
+bool pljs_plan_read_only(SPIPlanPtr);
+void pljs_raise_pending_error(void);
+JSValue pljs_throw_pending_error(JSContext *ctx, MemoryContext mcontext);
+
 // Functions in type.c
+void pljs_types_init(JSContext *);
+void pljs_types_free(JSContext *);
 uint32_t js_array_length(JSContext *, JSValue);
 void pljs_type_fill(pljs_type *, Oid);
 JSValue pljs_datum_to_jsvalue(Datum arg, Oid type, JSContext *ctx);
+JSValue pljs_datum_to_jsvalue_typed(Datum arg, pljs_type *type,
+                                    JSContext *ctx);
 JSValue pljs_datum_to_array(Datum arg, pljs_type *type, JSContext *ctx);
 JSValue pljs_datum_to_object(Datum arg, pljs_type *type, JSContext *ctx);
 
@@ -141,6 +320,8 @@ Datum pljs_jsvalue_to_array(JSValue, pljs_type *, JSContext *,
                             FunctionCallInfo);
 Datum pljs_jsvalue_to_datum(JSValue, Oid, JSContext *, FunctionCallInfo,
                             bool *);
+Datum pljs_jsvalue_to_datum_typed(JSValue, pljs_type *, JSContext *,
+                                  FunctionCallInfo, bool *);
 Datum pljs_jsvalue_to_record(JSValue val, pljs_type *type, JSContext *ctx,
                              bool *is_null, TupleDesc);
 JSValue values_to_array(JSContext *, JSValue *, int, int);
@@ -0,0 +1,672 @@
+#include "postgres.h"
+
+#include "access/heaptoast.h"
+#include "access/htup_details.h"
+#include "access/tupdesc.h"
+#include "catalog/pg_type_d.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+#include "deps/quickjs/quickjs.h"
+
+#include "pljs.h"
+
+/**
+ * @brief Class of lazily converted row objects.
+ */
+static JSClassID pljs_row_class_id = 0;
+
+/**
+ * @brief Memory context holding row tuples and shapes, these live as long as
+ * the javascript objects that reference them.
+ */
+static MemoryContext row_memory_context = NULL;
+
+/**
+ * @brief Key of a shape in the shape cache.
+ */
+typedef struct pljs_row_shape_key {
+  JSRuntime *runtime; // the runtime owning the atoms of the shape
+  Oid typid;          // `tdtypeid` of the descriptor
+  int32 typmod;       // `tdtypmod` of the descriptor
+} pljs_row_shape_key;
+
+/**
+ * @brief Entry in the shape cache.
+ */
+typedef struct pljs_row_shape_entry {
+  pljs_row_shape_key key;
+  struct pljs_row_shape *shape; // holds a reference to the shape
+} pljs_row_shape_entry;
+
+/**
+ * @brief #HTAB of shapes of row types, so that converting rows of a known
+ * type does not start with creating the atoms of its column names.
+ */
+static HTAB *row_shape_cache = NULL;
+
+/**
+ * @brief State of a column in a row.
+ */
+typedef enum pljs_row_column_state {
+  ROW_COLUMN_PENDING = 0, // not yet converted from the tuple
+  ROW_COLUMN_LOADED,      // converted from the tuple
+  ROW_COLUMN_MODIFIED,    // assigned from javascript
+  ROW_COLUMN_DELETED      // deleted from javascript
+} pljs_row_column_state;
+
+/**
+ * @brief Everything about a row that is shared by all rows of a result.
+ */
+struct pljs_row_shape {
+  int refcount;
+  TupleDesc tupdesc; // copy of the descriptor of the rows
+  JSAtom *atoms;     // column names, `JS_ATOM_NULL` for dropped columns
+  pljs_type *types;  // column types, filled on first use
+  bool *typed;       // whether a column type has been filled
+  Datum *values;     // buffer of #pljs_row_to_object for deformed columns
+  bool *nulls;       // buffer of #pljs_row_to_object for null columns
+  bool deforming;    // whether the buffers are in use
+};
+
+/**
+ * @brief Opaque data of a row object.
+ */
+typedef struct pljs_row {
+  pljs_row_shape *shape;
+  HeapTuple tuple; // copy of the tuple
+  Datum *datums;   // deformed columns of the tuple, NULL until first access
+  bool *nulls;     // null columns of the tuple, NULL until first access
+  JSValue *values; // converted values of the columns
+  uint8 *states;   // #pljs_row_column_state of each column
+} pljs_row;
+
+static pljs_type *row_shape_type(pljs_row_shape *, int);
+static void row_finalizer(JSRuntime *, JSValue);
+static void row_gc_mark(JSRuntime *, JSValueConst, JS_MarkFunc *);
+static int row_get_own_property(JSContext *, JSPropertyDescriptor *,
+                                JSValueConst, JSAtom);
+static int row_get_own_property_names(JSContext *, JSPropertyEnum **,
+                                      uint32_t *, JSValueConst);
+static int row_delete_property(JSContext *, JSValueConst, JSAtom);
+static int row_define_own_property(JSContext *, JSValueConst, JSAtom,
+                                   JSValueConst, JSValueConst, JSValueConst,
+                                   int);
+
+static JSClassExoticMethods row_exotic_methods = {
+    .get_own_property = row_get_own_property,
+    .get_own_property_names = row_get_own_property_names,
+    .delete_property = row_delete_property,
+    .define_own_property = row_define_own_property,
+};
+
+static JSClassDef row_class = {
+    .class_name = "Row",
+    .finalizer = row_finalizer,
+    .gc_mark = row_gc_mark,
+    .exotic = &row_exotic_methods,
+};
+
+/**
+ * @brief Registers the row class with the runtime.
+ *
+ * @param runtime #JSRuntime - the runtime to register the class with
+ */
+void pljs_row_init(JSRuntime *runtime) {
+  if (row_memory_context == NULL) {
+    row_memory_context = AllocSetContextCreate(
+        TopMemoryContext, "PLJS Row Context", ALLOCSET_DEFAULT_SIZES);
+  }
+
+  if (row_shape_cache == NULL) {
+    HASHCTL ctl = {0};
+
+    ctl.keysize = sizeof(pljs_row_shape_key);
+    ctl.entrysize = sizeof(pljs_row_shape_entry);
+    ctl.hcxt = row_memory_context;
+
+    row_shape_cache =
+        hash_create("PLJS Row Shape Cache", 64, &ctl,
+                    HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+  }
+
+  if (pljs_row_class_id == 0) {
+    JS_NewClassID(&pljs_row_class_id);
+  }
+
+  if (!JS_IsRegisteredClass(runtime, pljs_row_class_id)) {
+    JS_NewClass(runtime, pljs_row_class_id, &row_class);
+  }
+}
+
+/**
+ * @brief Whether a shape still describes the rows of a descriptor.
+ *
+ * A row type keeps its `tdtypeid` when it is altered, so the columns are
+ * compared to find out whether the cached shape is out of date.
+ */
+static bool row_shape_matches(pljs_row_shape *shape, TupleDesc tupdesc) {
+  if (shape->tupdesc->natts != tupdesc->natts) {
+    return false;
+  }
+
+  for (int i = 0; i < tupdesc->natts; i++) {
+    Form_pg_attribute cached = TupleDescAttr(shape->tupdesc, i);
+    Form_pg_attribute attr = TupleDescAttr(tupdesc, i);
+
+    if (cached->atttypid != attr->atttypid ||
+        cached->atttypmod != attr->atttypmod ||
+        cached->attisdropped != attr->attisdropped ||
+        strcmp(NameStr(cached->attname), NameStr(attr->attname)) != 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief Creates the shape from a descriptor.
+ */
+static pljs_row_shape *row_shape_create(JSContext *ctx, TupleDesc tupdesc) {
+  MemoryContext old_context = MemoryContextSwitchTo(row_memory_context);
+
+  pljs_row_shape *shape = palloc(sizeof(pljs_row_shape));
+
+  shape->refcount = 1;
+  shape->tupdesc = CreateTupleDescCopy(tupdesc);
+  shape->atoms = palloc(sizeof(JSAtom) * Max(tupdesc->natts, 1));
+  shape->types = palloc(sizeof(pljs_type) * Max(tupdesc->natts, 1));
+  shape->typed = palloc0(sizeof(bool) * Max(tupdesc->natts, 1));
+  shape->values = palloc(sizeof(Datum) * Max(tupdesc->natts, 1));
+  shape->nulls = palloc(sizeof(bool) * Max(tupdesc->natts, 1));
+  shape->deforming = false;
+
+  for (int i = 0; i < tupdesc->natts; i++) {
+    Form_pg_attribute attr = TupleDescAttr(tupdesc, i);
+
+    shape->atoms[i] = attr->attisdropped
+                          ? JS_ATOM_NULL
+                          : JS_NewAtom(ctx, NameStr(attr->attname));
+  }
+
+  MemoryContextSwitchTo(old_context);
+
+  return shape;
+}
+
+/**
+ * @brief Finds or creates the shape shared by rows with the same descriptor.
+ *
+ * Shapes of named row types and registered record types are cached by
+ * `tdtypeid` and `tdtypmod`, anonymous records get a new shape every time.
+ * The shape is returned with a reference held by the caller, which must be
+ * released with #pljs_row_shape_release once no more rows are created.
+ * @param ctx #JSContext - the context the rows are created in
+ * @param tupdesc #TupleDesc - the descriptor of the rows
+ * @returns #pljs_row_shape of the rows.
+ */
+pljs_row_shape *pljs_row_shape_new(JSContext *ctx, TupleDesc tupdesc) {
+  if (tupdesc->tdtypeid == RECORDOID && tupdesc->tdtypmod < 0) {
+    return row_shape_create(ctx, tupdesc);
+  }
+
+  pljs_row_shape_key key = {0};
+  JSRuntime *runtime = JS_GetRuntime(ctx);
+
+  key.runtime = runtime;
+  key.typid = tupdesc->tdtypeid;
+  key.typmod = tupdesc->tdtypmod;
+
+  pljs_row_shape_entry *entry = (pljs_row_shape_entry *)hash_search(
+      row_shape_cache, &key, HASH_FIND, NULL);
+
+  if (entry && row_shape_matches(entry->shape, tupdesc)) {
+    entry->shape->refcount++;
+
+    return entry->shape;
+  }
+
+  pljs_row_shape *shape = row_shape_create(ctx, tupdesc);
+
+  if (entry) {
+    // Rows of the old shape keep their own references to it.
+    pljs_row_shape_release(runtime, entry->shape);
+  } else {
+    entry = (pljs_row_shape_entry *)hash_search(row_shape_cache, &key,
+                                                HASH_ENTER, NULL);
+  }
+
+  entry->shape = shape;
+  shape->refcount++;
+
+  return shape;
+}
+
+/**
+ * @brief Releases a reference to a row shape, freeing it with the last one.
+ */
+void pljs_row_shape_release(JSRuntime *runtime, pljs_row_shape *shape) {
+  if (--shape->refcount > 0) {
+    return;
+  }
+
+  for (int i = 0; i < shape->tupdesc->natts; i++) {
+    if (shape->atoms[i] != JS_ATOM_NULL) {
+      JS_FreeAtomRT(runtime, shape->atoms[i]);
+    }
+  }
+
+  FreeTupleDesc(shape->tupdesc);
+  pfree(shape->atoms);
+  pfree(shape->types);
+  pfree(shape->typed);
+  pfree(shape->values);
+  pfree(shape->nulls);
+  pfree(shape);
+}
+
+/**
+ * @brief Releases the shapes cached for a runtime that is being freed.
+ *
+ * @param runtime #JSRuntime - the runtime owning the atoms of the shapes
+ */
+void pljs_row_runtime_release(JSRuntime *runtime) {
+  HASH_SEQ_STATUS status;
+  pljs_row_shape_entry *entry;
+
+  if (row_shape_cache == NULL) {
+    return;
+  }
+
+  hash_seq_init(&status, row_shape_cache);
+
+  while ((entry = (pljs_row_shape_entry *)hash_seq_search(&status)) != NULL) {
+    if (entry->key.runtime == runtime) {
+      pljs_row_shape_release(runtime, entry->shape);
+      hash_search(row_shape_cache, &entry->key, HASH_REMOVE, NULL);
+    }
+  }
+}
+
+/**
+ * @brief Creates a row object for a tuple.
+ *
+ * Columns are only converted to javascript when they are first accessed.
+ * The tuple is copied, with any toasted values fetched, so the row remains
+ * valid after the tuple itself is gone.
+ * @param ctx #JSContext - the context to create the row in
+ * @param shape #pljs_row_shape - the shape of the row
+ * @param tuple #HeapTuple - the tuple
+ * @returns #JSValue of the row.
+ */
+JSValue pljs_row_new(JSContext *ctx, pljs_row_shape *shape, HeapTuple tuple) {
+  // Rows behave like ordinary objects, so give their class a prototype
+  // inheriting from Object the first time a context creates one.
+  JSValue proto = JS_GetClassProto(ctx, pljs_row_class_id);
+
+  if (JS_IsNull(proto)) {
+    JS_SetClassProto(ctx, pljs_row_class_id, JS_NewObject(ctx));
+  }
+
+  JS_FreeValue(ctx, proto);
+
+  MemoryContext old_context = MemoryContextSwitchTo(row_memory_context);
+
+  int natts = shape->tupdesc->natts;
+  pljs_row *row = palloc(sizeof(pljs_row));
+
+  row->shape = shape;
+  row->tuple = HeapTupleHasExternal(tuple)
+                   ? toast_flatten_tuple(tuple, shape->tupdesc)
+                   : heap_copytuple(tuple);
+  row->datums = NULL;
+  row->nulls = NULL;
+  row->values = palloc(sizeof(JSValue) * Max(natts, 1));
+  row->states = palloc0(sizeof(uint8) * Max(natts, 1));
+
+  MemoryContextSwitchTo(old_context);
+
+  shape->refcount++;
+
+  JSValue obj = JS_NewObjectClass(ctx, pljs_row_class_id);
+  JS_SetOpaque(obj, row);
+
+  return obj;
+}
+
+/**
+ * @brief Converts a tuple to an ordinary object all at once.
+ *
+ * Uses the atoms and types of the shape, so that only the values themselves
+ * are converted for every row.  The tuple is deformed in a single pass into
+ * the buffers of the shape, rather than finding every column from the start
+ * of the tuple.
+ * @param ctx #JSContext - the context to create the object in
+ * @param shape #pljs_row_shape - the shape of the row
+ * @param tuple #HeapTuple - the tuple
+ * @returns #JSValue of the object.
+ */
+JSValue pljs_row_to_object(JSContext *ctx, pljs_row_shape *shape,
+                           HeapTuple tuple) {
+  JSValue obj = JS_NewObject(ctx);
+  int natts = shape->tupdesc->natts;
+  Datum *values = shape->values;
+  bool *nulls = shape->nulls;
+  bool borrowed = !shape->deforming;
+
+  // Converting a column can run javascript that converts rows of the same
+  // shape, which then need buffers of their own.
+  if (borrowed) {
+    shape->deforming = true;
+  } else {
+    values = palloc(sizeof(Datum) * Max(natts, 1));
+    nulls = palloc(sizeof(bool) * Max(natts, 1));
+  }
+
+  heap_deform_tuple(tuple, shape->tupdesc, values, nulls);
+
+  for (int i = 0; i < natts; i++) {
+    if (shape->atoms[i] == JS_ATOM_NULL) {
+      continue;
+    }
+
+    JSValue value =
+        nulls[i] ? JS_NULL
+                 : pljs_datum_to_jsvalue_typed(values[i],
+                                               row_shape_type(shape, i), ctx);
+
+    JS_DefinePropertyValue(ctx, obj, shape->atoms[i], value, JS_PROP_C_W_E);
+  }
+
+  if (borrowed) {
+    shape->deforming = false;
+  } else {
+    pfree(values);
+    pfree(nulls);
+  }
+
+  return obj;
+}
+
+/**
+ * @brief Applies the columns assigned in a row object to its tuple.
+ *
+ * Only the columns that javascript may have changed are converted back,
+ * those assigned or deleted, and those holding an object, which could have
+ * been changed in place.  Everything else is left as it is in the tuple,
+ * and when nothing may have changed the tuple itself is the result.
+ * @param ctx #JSContext - the context of the row
+ * @param obj #JSValueConst - the row object
+ * @param tuple #HeapTuple - the tuple the row was created from
+ * @param result #HeapTuple * - set to the tuple with the changes applied
+ * @returns @c bool of whether the object is a row object, if it is not the
+ * result is left unset.
+ */
+bool pljs_row_apply(JSContext *ctx, JSValueConst obj, HeapTuple tuple,
+                    HeapTuple *result) {
+  pljs_row *row = JS_GetOpaque(obj, pljs_row_class_id);
+
+  if (row == NULL) {
+    return false;
+  }
+
+  pljs_row_shape *shape = row->shape;
+  int natts = shape->tupdesc->natts;
+  Datum *values = palloc(sizeof(Datum) * Max(natts, 1));
+  bool *nulls = palloc0(sizeof(bool) * Max(natts, 1));
+  bool *replace = palloc0(sizeof(bool) * Max(natts, 1));
+  bool modified = false;
+
+  for (int i = 0; i < natts; i++) {
+    uint8 state = row->states[i];
+    JSValue value = row->values[i];
+
+    if (state == ROW_COLUMN_PENDING ||
+        (state == ROW_COLUMN_LOADED && !JS_IsObject(value))) {
+      continue;
+    }
+
+    replace[i] = true;
+    modified = true;
+
+    if (state == ROW_COLUMN_DELETED || JS_IsNull(value) ||
+        JS_IsUndefined(value)) {
+      nulls[i] = true;
+      values[i] = (Datum)0;
+    } else {
+      values[i] = pljs_jsvalue_to_datum_typed(value, row_shape_type(shape, i),
+                                              ctx, NULL, &nulls[i]);
+    }
+  }
+
+  *result = modified ? heap_modify_tuple(tuple, shape->tupdesc, values, nulls,
+                                         replace)
+                     : tuple;
+
+  pfree(values);
+  pfree(nulls);
+  pfree(replace);
+
+  return true;
+}
+
+/**
+ * @brief Finds the column for a property, or -1 if it is not a column.
+ */
+static int row_find_column(pljs_row_shape *shape, JSAtom prop) {
+  for (int i = 0; i < shape->tupdesc->natts; i++) {
+    if (shape->atoms[i] == prop) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * @brief Returns the type of a column, filling it on first use.
+ */
+static pljs_type *row_shape_type(pljs_row_shape *shape, int column) {
+  if (!shape->typed[column]) {
+    MemoryContext old_context = MemoryContextSwitchTo(row_memory_context);
+
+    pljs_type_fill(&shape->types[column],
+                   TupleDescAttr(shape->tupdesc, column)->atttypid);
+    shape->typed[column] = true;
+
+    MemoryContextSwitchTo(old_context);
+  }
+
+  return &shape->types[column];
+}
+
+/**
+ * @brief Returns the value of a column, converting it on first access.
+ *
+ * The first access deforms the whole tuple, later accesses to other columns
+ * only convert the value they need.
+ */
+static JSValue row_column_value(JSContext *ctx, pljs_row *row, int column) {
+  if (row->states[column] != ROW_COLUMN_PENDING) {
+    return row->values[column];
+  }
+
+  pljs_row_shape *shape = row->shape;
+
+  if (row->datums == NULL) {
+    int natts = shape->tupdesc->natts;
+
+    row->datums = MemoryContextAlloc(row_memory_context,
+                                     sizeof(Datum) * Max(natts, 1));
+    row->nulls =
+        MemoryContextAlloc(row_memory_context, sizeof(bool) * Max(natts, 1));
+
+    heap_deform_tuple(row->tuple, shape->tupdesc, row->datums, row->nulls);
+  }
+
+  if (row->nulls[column]) {
+    row->values[column] = JS_NULL;
+  } else {
+    row->values[column] = pljs_datum_to_jsvalue_typed(
+        row->datums[column], row_shape_type(shape, column), ctx);
+  }
+
+  row->states[column] = ROW_COLUMN_LOADED;
+
+  return row->values[column];
+}
+
+static void row_finalizer(JSRuntime *runtime, JSValue val) {
+  pljs_row *row = JS_GetOpaque(val, pljs_row_class_id);
+
+  if (row == NULL) {
+    return;
+  }
+
+  for (int i = 0; i < row->shape->tupdesc->natts; i++) {
+    if (row->states[i] == ROW_COLUMN_LOADED ||
+        row->states[i] == ROW_COLUMN_MODIFIED) {
+      JS_FreeValueRT(runtime, row->values[i]);
+    }
+  }
+
+  pljs_row_shape_release(runtime, row->shape);
+
+  heap_freetuple(row->tuple);
+
+  if (row->datums != NULL) {
+    pfree(row->datums);
+    pfree(row->nulls);
+  }
+
+  pfree(row->values);
+  pfree(row->states);
+  pfree(row);
+}
+
+static void row_gc_mark(JSRuntime *runtime, JSValueConst val,
+                        JS_MarkFunc *mark_func) {
+  pljs_row *row = JS_GetOpaque(val, pljs_row_class_id);
+
+  if (row == NULL) {
+    return;
+  }
+
+  for (int i = 0; i < row->shape->tupdesc->natts; i++) {
+    if (row->states[i] == ROW_COLUMN_LOADED ||
+        row->states[i] == ROW_COLUMN_MODIFIED) {
+      JS_MarkValue(runtime, row->values[i], mark_func);
+    }
+  }
+}
+
+static int row_get_own_property(JSContext *ctx, JSPropertyDescriptor *desc,
+                                JSValueConst obj, JSAtom prop) {
+  pljs_row *row = JS_GetOpaque(obj, pljs_row_class_id);
+  int column = row_find_column(row->shape, prop);
+
+  if (column < 0 || row->states[column] == ROW_COLUMN_DELETED) {
+    return FALSE;
+  }
+
+  JSValue value = row_column_value(ctx, row, column);
+
+  if (desc) {
+    desc->flags = JS_PROP_C_W_E;
+    desc->value = JS_DupValue(ctx, value);
+    desc->getter = JS_UNDEFINED;
+    desc->setter = JS_UNDEFINED;
+  }
+
+  return TRUE;
+}
+
+static int row_get_own_property_names(JSContext *ctx, JSPropertyEnum **ptab,
+                                      uint32_t *plen, JSValueConst obj) {
+  pljs_row *row = JS_GetOpaque(obj, pljs_row_class_id);
+  pljs_row_shape *shape = row->shape;
+  uint32_t count = 0;
+
+  JSPropertyEnum *tab = js_mallocz(
+      ctx, sizeof(JSPropertyEnum) * Max(shape->tupdesc->natts, 1));
+
+  if (tab == NULL) {
+    return -1;
+  }
+
+  // Columns are listed in table order, without converting any of them.
+  for (int i = 0; i < shape->tupdesc->natts; i++) {
+    if (shape->atoms[i] == JS_ATOM_NULL ||
+        row->states[i] == ROW_COLUMN_DELETED) {
+      continue;
+    }
+
+    tab[count].is_enumerable = TRUE;
+    tab[count].atom = JS_DupAtom(ctx, shape->atoms[i]);
+    count++;
+  }
+
+  *ptab = tab;
+  *plen = count;
+
+  return 0;
+}
+
+static int row_delete_property(JSContext *ctx, JSValueConst obj, JSAtom prop) {
+  pljs_row *row = JS_GetOpaque(obj, pljs_row_class_id);
+  int column = row_find_column(row->shape, prop);
+
+  if (column < 0) {
+    return TRUE;
+  }
+
+  if (row->states[column] == ROW_COLUMN_LOADED ||
+      row->states[column] == ROW_COLUMN_MODIFIED) {
+    JS_FreeValue(ctx, row->values[column]);
+  }
+
+  row->values[column] = JS_UNDEFINED;
+  row->states[column] = ROW_COLUMN_DELETED;
+
+  return TRUE;
+}
+
+static int row_define_own_property(JSContext *ctx, JSValueConst this_obj,
+                                   JSAtom prop, JSValueConst val,
+                                   JSValueConst getter, JSValueConst setter,
+                                   int flags) {
+  pljs_row *row = JS_GetOpaque(this_obj, pljs_row_class_id);
+  int column = row_find_column(row->shape, prop);
+
+  // Anything that is not a column is an ordinary property of the object.
+  if (column < 0) {
+    return JS_DefineProperty(ctx, this_obj, prop, val, getter, setter,
+                             flags | JS_PROP_NO_EXOTIC);
+  }
+
+  if (flags & (JS_PROP_HAS_GET | JS_PROP_HAS_SET)) {
+    JS_ThrowTypeError(ctx, "cannot define an accessor for a row column");
+
+    return -1;
+  }
+
+  if (!(flags & JS_PROP_HAS_VALUE)) {
+    if (row->states[column] == ROW_COLUMN_DELETED) {
+      row->values[column] = JS_UNDEFINED;
+      row->states[column] = ROW_COLUMN_MODIFIED;
+    }
+
+    return TRUE;
+  }
+
+  if (row->states[column] == ROW_COLUMN_LOADED ||
+      row->states[column] == ROW_COLUMN_MODIFIED) {
+    JS_FreeValue(ctx, row->values[column]);
+  }
+
+  row->values[column] = JS_DupValue(ctx, val);
+  row->states[column] = ROW_COLUMN_MODIFIED;
+
+  return TRUE;
+}
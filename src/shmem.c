@@ -0,0 +1,764 @@
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "funcapi.h"
+#include "lib/dshash.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/dsa.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
+
+#include "pljs.h"
+
+PG_FUNCTION_INFO_V1(pljs_shared_cache_stats);
+PG_FUNCTION_INFO_V1(pljs_stat_functions);
+PG_FUNCTION_INFO_V1(pljs_stat_functions_reset);
+
+/**
+ * @brief Key for bytecode stored in shared memory.
+ *
+ * Bytecode is stored once per function per database, the hash of the source
+ * is kept in the entry so that a changed function replaces its bytecode
+ * instead of leaving the old bytecode behind.
+ */
+typedef struct pljs_shared_bytecode_key {
+  Oid database_id;
+  Oid fn_oid;
+} pljs_shared_bytecode_key;
+
+/**
+ * @brief Entry for bytecode stored in shared memory.
+ */
+typedef struct pljs_shared_bytecode_entry {
+  pljs_shared_bytecode_key key;
+  uint8 hash[STORAGE_HASH_LEN]; // hash of the source of the function
+  dsa_pointer bytecode;         // the bytecode itself
+  size_t length;                // length of the bytecode
+  pg_atomic_uint64 last_used;   // tick of the clock it was last used at
+} pljs_shared_bytecode_entry;
+
+/**
+ * @brief Key for the statistics of a function.
+ */
+typedef struct pljs_stats_key {
+  Oid database_id;
+  Oid fn_oid;
+} pljs_stats_key;
+
+/**
+ * @brief Entry for the statistics of a function kept for this backend.
+ */
+typedef struct pljs_stats_entry {
+  pljs_stats_key key;
+  pljs_function_stats stats;
+} pljs_stats_entry;
+
+/**
+ * @brief Entry for the statistics of a function shared between backends.
+ *
+ * The counters are atomic, so that once the entry exists calls are added to
+ * it under a shared lock, without backends calling the same function waiting
+ * on each other.  Times are in nanoseconds.
+ */
+typedef struct pljs_shared_stats_entry {
+  pljs_stats_key key;
+  pg_atomic_uint64 calls;
+  pg_atomic_uint64 total_time;
+  pg_atomic_uint64 compile_time;
+  pg_atomic_uint64 arguments_time;
+  pg_atomic_uint64 js_time;
+  pg_atomic_uint64 spi_time;
+  pg_atomic_uint64 result_time;
+  pg_atomic_uint64 peak_bytes;
+} pljs_shared_stats_entry;
+
+/**
+ * @brief Converts milliseconds to the nanoseconds kept in shared entries.
+ */
+#define STATS_NSECS(msecs) ((uint64)((msecs) * 1000000.0))
+
+/**
+ * @brief Converts nanoseconds kept in shared entries to milliseconds.
+ */
+#define STATS_MSECS(nsecs) ((double)(nsecs) / 1000000.0)
+
+/**
+ * @brief State shared between all backends.
+ */
+typedef struct pljs_shared_state {
+  LWLock *lock;    // protects creating and attaching to the area
+  int tranche_id;  // tranche for the area and the hash table
+  bool created;    // whether the area and hash table have been created
+  dsa_handle area; // area holding the hash table and bytecode
+  dshash_table_handle bytecode_table;
+  dshash_table_handle stats_table; // statistics of functions
+  pg_atomic_uint64 hits;
+  pg_atomic_uint64 misses;
+  pg_atomic_uint64 entries;
+  pg_atomic_uint64 bytes;
+  pg_atomic_uint64 clock; // ticks every time bytecode is used
+} pljs_shared_state;
+
+/**
+ * @brief Shared state, `NULL` unless pljs is in `shared_preload_libraries`.
+ */
+static pljs_shared_state *shared_state = NULL;
+
+// This backend's mapping of the shared area and its hash tables.
+static dsa_area *shared_area = NULL;
+static dshash_table *shared_bytecode_table = NULL;
+static dshash_table *shared_stats_table = NULL;
+
+// Statistics of functions when they can not be shared, only kept for this
+// backend.
+static HTAB *local_stats_table = NULL;
+
+static dshash_parameters shared_bytecode_params = {
+    .key_size = sizeof(pljs_shared_bytecode_key),
+    .entry_size = sizeof(pljs_shared_bytecode_entry),
+    .compare_function = dshash_memcmp,
+    .hash_function = dshash_memhash,
+#if PG_VERSION_NUM >= 170000
+    .copy_function = dshash_memcpy,
+#endif
+};
+
+static dshash_parameters shared_stats_params = {
+    .key_size = sizeof(pljs_stats_key),
+    .entry_size = sizeof(pljs_shared_stats_entry),
+    .compare_function = dshash_memcmp,
+    .hash_function = dshash_memhash,
+#if PG_VERSION_NUM >= 170000
+    .copy_function = dshash_memcpy,
+#endif
+};
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+
+static Size shared_memory_size(void) {
+  return MAXALIGN(sizeof(pljs_shared_state));
+}
+
+/**
+ * @brief Requests the shared memory and locks needed by pljs.
+ */
+static void shared_memory_request(void) {
+#if PG_VERSION_NUM >= 150000
+  if (prev_shmem_request_hook) {
+    prev_shmem_request_hook();
+  }
+#endif
+
+  RequestAddinShmemSpace(shared_memory_size());
+  RequestNamedLWLockTranche("pljs", 1);
+}
+
+/**
+ * @brief Creates or attaches to the shared state.
+ */
+static void shared_memory_startup(void) {
+  bool found;
+
+  if (prev_shmem_startup_hook) {
+    prev_shmem_startup_hook();
+  }
+
+  LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+  shared_state = ShmemInitStruct("pljs", shared_memory_size(), &found);
+
+  if (!found) {
+    shared_state->lock = &(GetNamedLWLockTranche("pljs"))->lock;
+    shared_state->tranche_id = LWLockNewTrancheId();
+    shared_state->created = false;
+
+    pg_atomic_init_u64(&shared_state->hits, 0);
+    pg_atomic_init_u64(&shared_state->misses, 0);
+    pg_atomic_init_u64(&shared_state->entries, 0);
+    pg_atomic_init_u64(&shared_state->bytes, 0);
+    pg_atomic_init_u64(&shared_state->clock, 0);
+  }
+
+  LWLockRelease(AddinShmemInitLock);
+}
+
+/**
+ * @brief Sets up shared memory.
+ *
+ * Shared memory can only be requested while being loaded through
+ * `shared_preload_libraries`, otherwise anything shared is disabled and
+ * every backend keeps to itself.
+ */
+void pljs_shmem_init(void) {
+  if (!process_shared_preload_libraries_in_progress) {
+    return;
+  }
+
+#if PG_VERSION_NUM >= 150000
+  prev_shmem_request_hook = shmem_request_hook;
+  shmem_request_hook = shared_memory_request;
+#else
+  shared_memory_request();
+#endif
+
+  prev_shmem_startup_hook = shmem_startup_hook;
+  shmem_startup_hook = shared_memory_startup;
+}
+
+/**
+ * @brief Attaches this backend to the shared area, creating it if needed.
+ *
+ * @returns @c bool of whether the shared cache is available.
+ */
+static bool shared_attach(void) {
+  if (shared_state == NULL) {
+    return false;
+  }
+
+  if (shared_bytecode_table != NULL) {
+    return true;
+  }
+
+  // The mappings live as long as the backend does.
+  MemoryContext old_context = MemoryContextSwitchTo(TopMemoryContext);
+
+  LWLockRegisterTranche(shared_state->tranche_id, "pljs");
+  shared_bytecode_params.tranche_id = shared_state->tranche_id;
+  shared_stats_params.tranche_id = shared_state->tranche_id;
+
+  LWLockAcquire(shared_state->lock, LW_EXCLUSIVE);
+
+  if (!shared_state->created) {
+    shared_area = dsa_create(shared_state->tranche_id);
+
+    // Keep the area around even when no backend is attached.
+    dsa_pin(shared_area);
+
+    shared_bytecode_table =
+        dshash_create(shared_area, &shared_bytecode_params, NULL);
+    shared_stats_table = dshash_create(shared_area, &shared_stats_params, NULL);
+
+    shared_state->area = dsa_get_handle(shared_area);
+    shared_state->bytecode_table =
+        dshash_get_hash_table_handle(shared_bytecode_table);
+    shared_state->stats_table =
+        dshash_get_hash_table_handle(shared_stats_table);
+    shared_state->created = true;
+  } else {
+    shared_area = dsa_attach(shared_state->area);
+    shared_bytecode_table =
+        dshash_attach(shared_area, &shared_bytecode_params,
+                      shared_state->bytecode_table, NULL);
+    shared_stats_table = dshash_attach(shared_area, &shared_stats_params,
+                                       shared_state->stats_table, NULL);
+  }
+
+  dsa_pin_mapping(shared_area);
+
+  LWLockRelease(shared_state->lock);
+
+  MemoryContextSwitchTo(old_context);
+
+  return true;
+}
+
+/**
+ * @brief Whether the shared bytecode cache is available.
+ */
+bool pljs_shared_cache_enabled(void) {
+  return shared_state != NULL && configuration.shared_cache_size > 0;
+}
+
+/**
+ * @brief Removes an entry from the shared cache.
+ *
+ * @param entry #pljs_shared_bytecode_entry - the entry, locked exclusively,
+ * the lock is released along with the entry
+ */
+static void shared_cache_remove(pljs_shared_bytecode_entry *entry) {
+  dsa_free(shared_area, entry->bytecode);
+
+  pg_atomic_fetch_sub_u64(&shared_state->bytes, entry->length);
+  pg_atomic_fetch_sub_u64(&shared_state->entries, 1);
+
+  dshash_delete_entry(shared_bytecode_table, entry);
+}
+
+/**
+ * @brief Evicts the least recently used bytecode from the shared cache.
+ *
+ * Walking through a shared hash table needs postgres 15, before that the
+ * cache only drops bytecode of older versions of functions.
+ * @returns @c bool of whether anything was evicted.
+ */
+static bool shared_cache_evict(void) {
+#if PG_VERSION_NUM >= 150000
+  dshash_seq_status status;
+  pljs_shared_bytecode_entry *entry;
+  pljs_shared_bytecode_key oldest_key;
+  uint64 oldest = PG_UINT64_MAX;
+  bool found = false;
+
+  dshash_seq_init(&status, shared_bytecode_table, false);
+
+  while ((entry = dshash_seq_next(&status)) != NULL) {
+    uint64 last_used = pg_atomic_read_u64(&entry->last_used);
+
+    if (last_used < oldest) {
+      oldest = last_used;
+      oldest_key = entry->key;
+      found = true;
+    }
+  }
+
+  dshash_seq_term(&status);
+
+  if (!found) {
+    return false;
+  }
+
+  // Another backend may have removed the entry in the meantime, which has
+  // made room all the same.
+  entry = dshash_find(shared_bytecode_table, &oldest_key, true);
+
+  if (entry != NULL) {
+    shared_cache_remove(entry);
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief Finds the bytecode of a function in the shared cache.
+ *
+ * Bytecode of an older version of the function is removed, the new version
+ * is added once it has been compiled.
+ * @param fn_oid #Oid - the function
+ * @param hash @c uint8 * - hash of the source of the function
+ * @param length #size_t - filled with the length of the bytecode
+ * @returns @c uint8 * of a copy of the bytecode, or `NULL` if the function is
+ * not in the shared cache.
+ */
+uint8 *pljs_shared_cache_find(Oid fn_oid, const uint8 *hash, size_t *length) {
+  pljs_shared_bytecode_key key = {0};
+  uint8 *bytecode = NULL;
+  bool stale = false;
+
+  if (!pljs_shared_cache_enabled() || !shared_attach()) {
+    return NULL;
+  }
+
+  key.database_id = MyDatabaseId;
+  key.fn_oid = fn_oid;
+
+  pljs_shared_bytecode_entry *entry =
+      dshash_find(shared_bytecode_table, &key, false);
+
+  if (entry != NULL) {
+    if (memcmp(entry->hash, hash, STORAGE_HASH_LEN) == 0) {
+      *length = entry->length;
+      bytecode = palloc(entry->length);
+      memcpy(bytecode, dsa_get_address(shared_area, entry->bytecode),
+             entry->length);
+
+      pg_atomic_write_u64(&entry->last_used,
+                          pg_atomic_fetch_add_u64(&shared_state->clock, 1));
+    } else {
+      stale = true;
+    }
+
+    dshash_release_lock(shared_bytecode_table, entry);
+  }
+
+  // The lookup only holds a shared lock, the stale entry is looked up again
+  // to be removed, unless another backend has replaced it by then.
+  if (stale) {
+    entry = dshash_find(shared_bytecode_table, &key, true);
+
+    if (entry != NULL) {
+      if (memcmp(entry->hash, hash, STORAGE_HASH_LEN) != 0) {
+        shared_cache_remove(entry);
+      } else {
+        dshash_release_lock(shared_bytecode_table, entry);
+      }
+    }
+  }
+
+  pg_atomic_fetch_add_u64(bytecode ? &shared_state->hits
+                                   : &shared_state->misses,
+                          1);
+
+  return bytecode;
+}
+
+/**
+ * @brief Adds the bytecode of a function to the shared cache.
+ *
+ * Replaces any bytecode stored for an older version of the function, and
+ * evicts the least recently used bytecode while `pljs.shared_cache_size`
+ * would be exceeded.
+ * @param fn_oid #Oid - the function
+ * @param hash @c uint8 * - hash of the source of the function
+ * @param bytecode @c uint8 * - the bytecode
+ * @param length #size_t - the length of the bytecode
+ */
+void pljs_shared_cache_add(Oid fn_oid, const uint8 *hash,
+                           const uint8 *bytecode, size_t length) {
+  pljs_shared_bytecode_key key = {0};
+  uint64 budget = (uint64)configuration.shared_cache_size * 1024 * 1024;
+  bool found;
+
+  if (!pljs_shared_cache_enabled() || !shared_attach() || length > budget) {
+    return;
+  }
+
+  while (pg_atomic_read_u64(&shared_state->bytes) + length > budget) {
+    if (!shared_cache_evict()) {
+      return;
+    }
+  }
+
+  dsa_pointer pointer =
+      dsa_allocate_extended(shared_area, length, DSA_ALLOC_NO_OOM);
+
+  if (!DsaPointerIsValid(pointer)) {
+    return;
+  }
+
+  memcpy(dsa_get_address(shared_area, pointer), bytecode, length);
+
+  key.database_id = MyDatabaseId;
+  key.fn_oid = fn_oid;
+
+  pljs_shared_bytecode_entry *entry =
+      dshash_find_or_insert(shared_bytecode_table, &key, &found);
+
+  if (found) {
+    // Another backend already added this version of the function.
+    if (memcmp(entry->hash, hash, STORAGE_HASH_LEN) == 0) {
+      dshash_release_lock(shared_bytecode_table, entry);
+      dsa_free(shared_area, pointer);
+
+      return;
+    }
+
+    // Replace the bytecode of an older version of the function.
+    dsa_free(shared_area, entry->bytecode);
+    pg_atomic_fetch_sub_u64(&shared_state->bytes, entry->length);
+  } else {
+    pg_atomic_fetch_add_u64(&shared_state->entries, 1);
+    pg_atomic_init_u64(&entry->last_used, 0);
+  }
+
+  memcpy(entry->hash, hash, STORAGE_HASH_LEN);
+  entry->bytecode = pointer;
+  entry->length = length;
+
+  pg_atomic_write_u64(&entry->last_used,
+                      pg_atomic_fetch_add_u64(&shared_state->clock, 1));
+  pg_atomic_fetch_add_u64(&shared_state->bytes, length);
+
+  dshash_release_lock(shared_bytecode_table, entry);
+}
+
+/**
+ * @brief Reports statistics of the shared bytecode cache.
+ *
+ * Returns the number of hits and misses, along with the number of functions
+ * and bytes of bytecode stored.  Everything is zero when the shared cache is
+ * not available.
+ */
+Datum pljs_shared_cache_stats(PG_FUNCTION_ARGS) {
+  TupleDesc tupdesc;
+  Datum values[4] = {0};
+  bool nulls[4] = {0};
+
+  if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+    elog(ERROR, "return type must be a row type");
+  }
+
+  if (pljs_shared_cache_enabled()) {
+    values[0] = Int64GetDatum(pg_atomic_read_u64(&shared_state->hits));
+    values[1] = Int64GetDatum(pg_atomic_read_u64(&shared_state->misses));
+    values[2] = Int64GetDatum(pg_atomic_read_u64(&shared_state->entries));
+    values[3] = Int64GetDatum(pg_atomic_read_u64(&shared_state->bytes));
+  } else {
+    for (int i = 0; i < 4; i++) {
+      values[i] = Int64GetDatum(0);
+    }
+  }
+
+  PG_RETURN_DATUM(
+      HeapTupleGetDatum(heap_form_tuple(BlessTupleDesc(tupdesc), values,
+                                        nulls)));
+}
+
+/**
+ * @brief Whether the statistics of functions are shared between backends.
+ *
+ * Walking through a shared hash table needs postgres 15, before that the
+ * statistics are kept for each backend.
+ */
+static bool stats_shared(void) {
+#if PG_VERSION_NUM >= 150000
+  return shared_attach();
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief Adds the statistics of a call to those of its function.
+ */
+static void stats_accumulate(pljs_function_stats *stats,
+                             const pljs_function_stats *call) {
+  stats->calls += call->calls;
+  stats->total_time += call->total_time;
+  stats->compile_time += call->compile_time;
+  stats->arguments_time += call->arguments_time;
+  stats->js_time += call->js_time;
+  stats->spi_time += call->spi_time;
+  stats->result_time += call->result_time;
+  stats->peak_bytes = Max(stats->peak_bytes, call->peak_bytes);
+}
+
+/**
+ * @brief Adds the statistics of a call to the shared entry of its function.
+ *
+ * @param entry #pljs_shared_stats_entry - the entry, locked shared at least
+ * @param call #pljs_function_stats - the statistics of the call
+ */
+static void shared_stats_accumulate(pljs_shared_stats_entry *entry,
+                                    const pljs_function_stats *call) {
+  uint64 peak_bytes = pg_atomic_read_u64(&entry->peak_bytes);
+
+  pg_atomic_fetch_add_u64(&entry->calls, call->calls);
+  pg_atomic_fetch_add_u64(&entry->total_time, STATS_NSECS(call->total_time));
+  pg_atomic_fetch_add_u64(&entry->compile_time,
+                          STATS_NSECS(call->compile_time));
+  pg_atomic_fetch_add_u64(&entry->arguments_time,
+                          STATS_NSECS(call->arguments_time));
+  pg_atomic_fetch_add_u64(&entry->js_time, STATS_NSECS(call->js_time));
+  pg_atomic_fetch_add_u64(&entry->spi_time, STATS_NSECS(call->spi_time));
+  pg_atomic_fetch_add_u64(&entry->result_time,
+                          STATS_NSECS(call->result_time));
+
+  // A failed exchange reads the peak again, until it is at least as high.
+  while (peak_bytes < (uint64)call->peak_bytes &&
+         !pg_atomic_compare_exchange_u64(&entry->peak_bytes, &peak_bytes,
+                                         call->peak_bytes)) {
+  }
+}
+
+/**
+ * @brief Reads the statistics of a shared entry.
+ */
+static void shared_stats_read(pljs_shared_stats_entry *entry,
+                              pljs_function_stats *stats) {
+  stats->calls = pg_atomic_read_u64(&entry->calls);
+  stats->total_time = STATS_MSECS(pg_atomic_read_u64(&entry->total_time));
+  stats->compile_time = STATS_MSECS(pg_atomic_read_u64(&entry->compile_time));
+  stats->arguments_time =
+      STATS_MSECS(pg_atomic_read_u64(&entry->arguments_time));
+  stats->js_time = STATS_MSECS(pg_atomic_read_u64(&entry->js_time));
+  stats->spi_time = STATS_MSECS(pg_atomic_read_u64(&entry->spi_time));
+  stats->result_time = STATS_MSECS(pg_atomic_read_u64(&entry->result_time));
+  stats->peak_bytes = pg_atomic_read_u64(&entry->peak_bytes);
+}
+
+/**
+ * @brief Finds the backend local statistics of a function.
+ */
+static pljs_stats_entry *local_stats_find(pljs_stats_key *key) {
+  bool found;
+
+  if (local_stats_table == NULL) {
+    HASHCTL ctl = {0};
+
+    ctl.keysize = sizeof(pljs_stats_key);
+    ctl.entrysize = sizeof(pljs_stats_entry);
+    ctl.hcxt = TopMemoryContext;
+
+    local_stats_table = hash_create("PLJS Function Statistics", 64, &ctl,
+                                    HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+  }
+
+  pljs_stats_entry *entry = (pljs_stats_entry *)hash_search(
+      local_stats_table, key, HASH_ENTER, &found);
+
+  if (!found) {
+    memset(&entry->stats, 0, sizeof(entry->stats));
+  }
+
+  return entry;
+}
+
+/**
+ * @brief Adds the statistics of a call of a function.
+ *
+ * @param fn_oid #Oid - the function
+ * @param call #pljs_function_stats - the statistics of the call
+ */
+void pljs_stats_report(Oid fn_oid, const pljs_function_stats *call) {
+  pljs_stats_key key = {0};
+
+  key.database_id = MyDatabaseId;
+  key.fn_oid = fn_oid;
+
+  if (stats_shared()) {
+    // Only the first call of a function inserts its entry under an exclusive
+    // lock, later calls find it under a shared one.
+    pljs_shared_stats_entry *entry =
+        dshash_find(shared_stats_table, &key, false);
+
+    if (entry == NULL) {
+      bool found;
+
+      entry = dshash_find_or_insert(shared_stats_table, &key, &found);
+
+      if (!found) {
+        pg_atomic_init_u64(&entry->calls, 0);
+        pg_atomic_init_u64(&entry->total_time, 0);
+        pg_atomic_init_u64(&entry->compile_time, 0);
+        pg_atomic_init_u64(&entry->arguments_time, 0);
+        pg_atomic_init_u64(&entry->js_time, 0);
+        pg_atomic_init_u64(&entry->spi_time, 0);
+        pg_atomic_init_u64(&entry->result_time, 0);
+        pg_atomic_init_u64(&entry->peak_bytes, 0);
+      }
+    }
+
+    shared_stats_accumulate(entry, call);
+
+    dshash_release_lock(shared_stats_table, entry);
+  } else {
+    stats_accumulate(&local_stats_find(&key)->stats, call);
+  }
+}
+
+/**
+ * @brief Adds a row for the statistics of a function.
+ */
+static void stats_store(Tuplestorestate *tuplestore, TupleDesc tupdesc,
+                        Oid fn_oid, const pljs_function_stats *stats) {
+  Datum values[9];
+  bool nulls[9] = {0};
+
+  values[0] = ObjectIdGetDatum(fn_oid);
+  values[1] = Int64GetDatum(stats->calls);
+  values[2] = Float8GetDatum(stats->total_time);
+  values[3] = Float8GetDatum(stats->compile_time);
+  values[4] = Float8GetDatum(stats->arguments_time);
+  values[5] = Float8GetDatum(stats->js_time);
+  values[6] = Float8GetDatum(stats->spi_time);
+  values[7] = Float8GetDatum(stats->result_time);
+  values[8] = Int64GetDatum(stats->peak_bytes);
+
+  tuplestore_putvalues(tuplestore, tupdesc, values, nulls);
+}
+
+/**
+ * @brief Reports the statistics of the functions of the current database.
+ *
+ * Statistics are kept for calls made while `pljs.track_functions` is on,
+ * and are shared between backends when pljs is in
+ * `shared_preload_libraries`.
+ */
+Datum pljs_stat_functions(PG_FUNCTION_ARGS) {
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+  TupleDesc tupdesc;
+
+  if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo) ||
+      !(rsinfo->allowedModes & SFRM_Materialize)) {
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                    errmsg("set-valued function called in context that "
+                           "cannot accept a set")));
+  }
+
+  if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+    elog(ERROR, "return type must be a row type");
+  }
+
+  MemoryContext old_context =
+      MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+  tupdesc = CreateTupleDescCopy(tupdesc);
+
+  Tuplestorestate *tuplestore = tuplestore_begin_heap(
+      (rsinfo->allowedModes & SFRM_Materialize_Random) != 0, false, work_mem);
+
+  MemoryContextSwitchTo(old_context);
+
+  if (stats_shared()) {
+#if PG_VERSION_NUM >= 150000
+    dshash_seq_status status;
+    pljs_shared_stats_entry *entry;
+
+    dshash_seq_init(&status, shared_stats_table, false);
+
+    while ((entry = dshash_seq_next(&status)) != NULL) {
+      if (entry->key.database_id == MyDatabaseId) {
+        pljs_function_stats stats;
+
+        shared_stats_read(entry, &stats);
+        stats_store(tuplestore, tupdesc, entry->key.fn_oid, &stats);
+      }
+    }
+
+    dshash_seq_term(&status);
+#endif
+  } else if (local_stats_table != NULL) {
+    HASH_SEQ_STATUS status;
+    pljs_stats_entry *entry;
+
+    hash_seq_init(&status, local_stats_table);
+
+    while ((entry = (pljs_stats_entry *)hash_seq_search(&status)) != NULL) {
+      stats_store(tuplestore, tupdesc, entry->key.fn_oid, &entry->stats);
+    }
+  }
+
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult = tuplestore;
+  rsinfo->setDesc = tupdesc;
+
+  PG_RETURN_NULL();
+}
+
+/**
+ * @brief Resets the statistics of the functions of the current database.
+ */
+Datum pljs_stat_functions_reset(PG_FUNCTION_ARGS) {
+  if (stats_shared()) {
+#if PG_VERSION_NUM >= 150000
+    dshash_seq_status status;
+    pljs_shared_stats_entry *entry;
+
+    dshash_seq_init(&status, shared_stats_table, true);
+
+    while ((entry = dshash_seq_next(&status)) != NULL) {
+      if (entry->key.database_id == MyDatabaseId) {
+        dshash_delete_current(&status);
+      }
+    }
+
+    dshash_seq_term(&status);
+#endif
+  } else if (local_stats_table != NULL) {
+    hash_destroy(local_stats_table);
+    local_stats_table = NULL;
+  }
+
+  PG_RETURN_VOID();
+}
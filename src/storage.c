@@ -0,0 +1,264 @@
+#include "postgres.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/cryptohash.h"
+#include "miscadmin.h"
+#include "storage/fd.h"
+#include "utils/syscache.h"
+
+#include "pljs.h"
+
+#ifndef QUICKJS_VERSION
+#define QUICKJS_VERSION ""
+#endif
+
+/**
+ * @brief Directory, relative to the data directory, where compiled bytecode
+ * is stored.
+ */
+#define STORAGE_DIRECTORY "pljs_bytecode"
+
+/**
+ * @brief Magic number identifying a pljs bytecode file.
+ */
+#define STORAGE_MAGIC 0x504c4a53
+
+/**
+ * @brief Header written in front of the bytecode of every stored function.
+ */
+typedef struct pljs_storage_header {
+  uint32 magic;
+  uint8 hash[STORAGE_HASH_LEN];
+  uint64 length;
+} pljs_storage_header;
+
+/**
+ * @brief Builds the path of the file storing the bytecode for a function.
+ *
+ * Functions are stored one file per function per database, a changed
+ * function simply overwrites its previous bytecode.
+ */
+static void storage_path(char *path, size_t length, Oid fn_oid) {
+  snprintf(path, length, "%s/%u_%u.bc", STORAGE_DIRECTORY, MyDatabaseId,
+           fn_oid);
+}
+
+/**
+ * @brief Hashes the source of a function.
+ *
+ * Creates a SHA-256 hash of the generated source of a function, along with
+ * the versions of pljs and quickjs, for use as a key to its compiled
+ * bytecode.  Bytecode written by another version of quickjs is not read.
+ * @param source @c char * - the source to hash
+ * @param length #size_t - length of the source
+ * @param hash @c uint8 * - buffer of #STORAGE_HASH_LEN bytes to fill
+ */
+void pljs_storage_hash(const char *source, size_t length, uint8 *hash) {
+  pg_cryptohash_ctx *ctx = pg_cryptohash_create(PG_SHA256);
+
+  if (ctx == NULL || pg_cryptohash_init(ctx) < 0 ||
+      pg_cryptohash_update(ctx, (const uint8 *)PLJS_VERSION,
+                           strlen(PLJS_VERSION)) < 0 ||
+      pg_cryptohash_update(ctx, (const uint8 *)QUICKJS_VERSION,
+                           strlen(QUICKJS_VERSION)) < 0 ||
+      pg_cryptohash_update(ctx, (const uint8 *)source, length) < 0 ||
+      pg_cryptohash_final(ctx, hash, STORAGE_HASH_LEN) < 0) {
+    pg_cryptohash_free(ctx);
+
+    ereport(ERROR, errcode(ERRCODE_INTERNAL_ERROR),
+            errmsg("unable to hash function source"));
+  }
+
+  pg_cryptohash_free(ctx);
+}
+
+/**
+ * @brief Loads the stored bytecode of a function.
+ *
+ * Looks for stored bytecode of a function whose source matches `hash`.  The
+ * bytecode still needs to be read with `JS_ReadObject` and evaluated with
+ * `JS_EvalFunction`.
+ * @param fn_oid #Oid - the function
+ * @param hash @c uint8 * - hash of the source of the function
+ * @param length #size_t - filled with the length of the bytecode
+ * @returns @c uint8 * of the bytecode, or `NULL` if there is no usable
+ * bytecode stored.
+ */
+uint8 *pljs_storage_load(Oid fn_oid, const uint8 *hash, size_t *length) {
+  char path[MAXPGPATH];
+  pljs_storage_header header;
+  struct stat st;
+  uint8 *buffer;
+  int fd;
+
+  storage_path(path, sizeof(path), fn_oid);
+
+  fd = OpenTransientFile(path, O_RDONLY | PG_BINARY);
+
+  if (fd < 0) {
+    if (errno != ENOENT) {
+      ereport(WARNING, errcode_for_file_access(),
+              errmsg("could not open file \"%s\": %m", path));
+    }
+
+    return NULL;
+  }
+
+  // Anything that does not look exactly right is treated as a miss, and will
+  // be overwritten once the function has been compiled again.
+  if (fstat(fd, &st) < 0 ||
+      read(fd, &header, sizeof(header)) != sizeof(header) ||
+      header.magic != STORAGE_MAGIC ||
+      memcmp(header.hash, hash, STORAGE_HASH_LEN) != 0 ||
+      header.length != (uint64)st.st_size - sizeof(header)) {
+    CloseTransientFile(fd);
+
+    return NULL;
+  }
+
+  buffer = palloc(header.length);
+
+  if (read(fd, buffer, header.length) != (ssize_t)header.length) {
+    CloseTransientFile(fd);
+    pfree(buffer);
+
+    return NULL;
+  }
+
+  CloseTransientFile(fd);
+
+  *length = header.length;
+
+  return buffer;
+}
+
+/**
+ * @brief Removes the stored bytecode of a function.
+ *
+ * Called once a function has been changed or dropped, its bytecode would
+ * never be read again otherwise.
+ * @param fn_oid #Oid - the function
+ */
+void pljs_storage_remove(Oid fn_oid) {
+  char path[MAXPGPATH];
+
+  storage_path(path, sizeof(path), fn_oid);
+
+  if (unlink(path) != 0 && errno != ENOENT) {
+    ereport(WARNING, errcode_for_file_access(),
+            errmsg("could not remove file \"%s\": %m", path));
+  }
+}
+
+/**
+ * @brief Removes the stored bytecode of functions that no longer exist.
+ *
+ * Functions dropped while no backend had them cached leave their bytecode
+ * behind, those of the current database are found by going through the
+ * stored files whenever a function is stored.  Bytecode is only a cache, so
+ * removing that of a function created by a transaction still in progress
+ * merely compiles it again.
+ */
+static void storage_prune(void) {
+  char prefix[32];
+  size_t prefix_length;
+  DIR *dir;
+  struct dirent *de;
+
+  prefix_length = snprintf(prefix, sizeof(prefix), "%u_", MyDatabaseId);
+
+  dir = AllocateDir(STORAGE_DIRECTORY);
+
+  while ((de = ReadDirExtended(dir, STORAGE_DIRECTORY, WARNING)) != NULL) {
+    char *end;
+    Oid fn_oid;
+
+    if (strncmp(de->d_name, prefix, prefix_length) != 0) {
+      continue;
+    }
+
+    fn_oid = strtoul(de->d_name + prefix_length, &end, 10);
+
+    if (strcmp(end, ".bc") != 0 ||
+        SearchSysCacheExists1(PROCOID, ObjectIdGetDatum(fn_oid))) {
+      continue;
+    }
+
+    pljs_storage_remove(fn_oid);
+  }
+
+  FreeDir(dir);
+}
+
+/**
+ * @brief Stores the bytecode of a compiled function.
+ *
+ * Writes the bytecode of a function compiled with
+ * `JS_EVAL_FLAG_COMPILE_ONLY` so that other backends can load it instead of
+ * compiling the function again.  Failure to store the bytecode is not an
+ * error, the function simply gets compiled again next time.  Bytecode of
+ * functions that no longer exist is removed along the way.
+ * @param fn_oid #Oid - the function
+ * @param hash @c uint8 * - hash of the source of the function
+ * @param bytecode @c uint8 * - the bytecode from `JS_WriteObject`
+ * @param length #size_t - the length of the bytecode
+ */
+void pljs_storage_save(Oid fn_oid, const uint8 *hash, const uint8 *bytecode,
+                       size_t length) {
+  char path[MAXPGPATH];
+  char temp_path[MAXPGPATH];
+  pljs_storage_header header = {0};
+  int fd;
+
+  header.magic = STORAGE_MAGIC;
+  memcpy(header.hash, hash, STORAGE_HASH_LEN);
+  header.length = length;
+
+  if (MakePGDirectory(STORAGE_DIRECTORY) < 0 && errno != EEXIST) {
+    ereport(WARNING, errcode_for_file_access(),
+            errmsg("could not create directory \"%s\": %m",
+                   STORAGE_DIRECTORY));
+
+    return;
+  }
+
+  storage_path(path, sizeof(path), fn_oid);
+
+  // Write to a temporary file first, so that other backends never see a
+  // partially written file.
+  snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", path, MyProcPid);
+
+  fd = OpenTransientFile(temp_path, O_WRONLY | O_CREAT | O_TRUNC | PG_BINARY);
+
+  if (fd < 0) {
+    ereport(WARNING, errcode_for_file_access(),
+            errmsg("could not create file \"%s\": %m", temp_path));
+
+    return;
+  }
+
+  bool written = write(fd, &header, sizeof(header)) == sizeof(header) &&
+                 write(fd, bytecode, length) == (ssize_t)length;
+
+  if (CloseTransientFile(fd) != 0 || !written) {
+    ereport(WARNING, errcode_for_file_access(),
+            errmsg("could not write file \"%s\": %m", temp_path));
+    unlink(temp_path);
+
+    return;
+  }
+
+  if (rename(temp_path, path) != 0) {
+    ereport(WARNING, errcode_for_file_access(),
+            errmsg("could not rename file \"%s\" to \"%s\": %m", temp_path,
+                   path));
+    unlink(temp_path);
+
+    return;
+  }
+
+  storage_prune();
+}
@@ -0,0 +1,268 @@
+#include "postgres.h"
+
+#include "executor/executor.h"
+#include "executor/tuptable.h"
+#include "utils/tuplestore.h"
+
+#include "deps/quickjs/quickjs.h"
+
+#include "pljs.h"
+
+/**
+ * @brief Class of transition table objects.
+ */
+static JSClassID pljs_transition_class_id = 0;
+
+/**
+ * @brief Opaque data of a transition table object.
+ *
+ * The tuplestore belongs to the trigger, so the table can only be read until
+ * the trigger returns, after which #pljs_transition_table_close has let go of
+ * everything but the structure itself.
+ */
+typedef struct pljs_transition_table {
+  Tuplestorestate *store; // rows of the table, NULL once closed
+  int read_pointer;       // read pointer of the table in the tuplestore
+  TupleTableSlot *slot;   // slot the rows are read into
+  pljs_row_shape *shape;  // shape of the rows
+} pljs_transition_table;
+
+static JSValue transition_table_next(JSContext *, JSValueConst, int,
+                                     JSValueConst *);
+static JSValue transition_table_fetch(JSContext *, JSValueConst, int,
+                                      JSValueConst *);
+static JSValue transition_table_rewind(JSContext *, JSValueConst, int,
+                                       JSValueConst *);
+static JSValue transition_table_iterator(JSContext *, JSValueConst, int,
+                                         JSValueConst *);
+
+static void transition_table_finalizer(JSRuntime *runtime, JSValue val) {
+  pljs_transition_table *table = JS_GetOpaque(val, pljs_transition_class_id);
+
+  if (table == NULL) {
+    return;
+  }
+
+  if (table->store != NULL) {
+    pljs_row_shape_release(runtime, table->shape);
+  }
+
+  js_free_rt(runtime, table);
+}
+
+static JSClassDef transition_table_class = {
+    .class_name = "TransitionTable",
+    .finalizer = transition_table_finalizer,
+};
+
+static const JSCFunctionListEntry transition_table_funcs[] = {
+    JS_CFUNC_DEF("next", 0, transition_table_next),
+    JS_CFUNC_DEF("fetch", 1, transition_table_fetch),
+    JS_CFUNC_DEF("rewind", 0, transition_table_rewind),
+    JS_CFUNC_DEF("[Symbol.iterator]", 0, transition_table_iterator),
+};
+
+/**
+ * @brief Finds the table of an object, throwing if it has been closed.
+ */
+static pljs_transition_table *transition_table_get(JSContext *ctx,
+                                                   JSValueConst obj) {
+  pljs_transition_table *table = JS_GetOpaque(obj, pljs_transition_class_id);
+
+  if (table == NULL || table->store == NULL) {
+    js_throw(ctx, "transition table is only available while its trigger runs");
+
+    return NULL;
+  }
+
+  return table;
+}
+
+/**
+ * @brief Reads the next row of a table.
+ *
+ * Rows are converted the same way as rows returned by queries, lazily when
+ * `pljs.lazy_rows` is on.
+ * @returns #JSValue of the row, or `JS_UNDEFINED` once there are no more
+ * rows.
+ */
+static JSValue transition_table_read(JSContext *ctx,
+                                     pljs_transition_table *table) {
+  tuplestore_select_read_pointer(table->store, table->read_pointer);
+
+  if (!tuplestore_gettupleslot(table->store, true, false, table->slot)) {
+    return JS_UNDEFINED;
+  }
+
+  bool should_free;
+  HeapTuple tuple = ExecFetchSlotHeapTuple(table->slot, false, &should_free);
+  JSValue row = configuration.lazy_rows
+                    ? pljs_row_new(ctx, table->shape, tuple)
+                    : pljs_row_to_object(ctx, table->shape, tuple);
+
+  if (should_free) {
+    heap_freetuple(tuple);
+  }
+
+  return row;
+}
+
+static JSValue transition_table_next(JSContext *ctx, JSValueConst this_val,
+                                     int argc, JSValueConst *argv) {
+  pljs_transition_table *table = transition_table_get(ctx, this_val);
+
+  if (table == NULL) {
+    return JS_EXCEPTION;
+  }
+
+  JSValue value = transition_table_read(ctx, table);
+  JSValue result = JS_NewObject(ctx);
+
+  JS_SetPropertyStr(ctx, result, "value", value);
+  JS_SetPropertyStr(ctx, result, "done",
+                    JS_NewBool(ctx, JS_IsUndefined(value)));
+
+  return result;
+}
+
+/**
+ * @brief Reads a batch of rows of a table.
+ *
+ * Reads up to the number of rows asked for, or `pljs.cursor_batch_size` rows
+ * without an argument, returning an empty array once there are no more rows.
+ */
+static JSValue transition_table_fetch(JSContext *ctx, JSValueConst this_val,
+                                      int argc, JSValueConst *argv) {
+  pljs_transition_table *table = transition_table_get(ctx, this_val);
+  int32_t count = configuration.cursor_batch_size;
+
+  if (table == NULL) {
+    return JS_EXCEPTION;
+  }
+
+  if (argc > 0 && !JS_IsUndefined(argv[0])) {
+    JS_ToInt32(ctx, &count, argv[0]);
+  }
+
+  JSValue rows = JS_NewArray(ctx);
+
+  for (int32_t i = 0; i < count; i++) {
+    JSValue row = transition_table_read(ctx, table);
+
+    if (JS_IsUndefined(row)) {
+      break;
+    }
+
+    JS_SetPropertyUint32(ctx, rows, i, row);
+  }
+
+  return rows;
+}
+
+static JSValue transition_table_rewind(JSContext *ctx, JSValueConst this_val,
+                                       int argc, JSValueConst *argv) {
+  pljs_transition_table *table = transition_table_get(ctx, this_val);
+
+  if (table == NULL) {
+    return JS_EXCEPTION;
+  }
+
+  tuplestore_select_read_pointer(table->store, table->read_pointer);
+  tuplestore_rescan(table->store);
+
+  return JS_UNDEFINED;
+}
+
+/**
+ * @brief Starts iterating over a table from its first row.
+ */
+static JSValue transition_table_iterator(JSContext *ctx, JSValueConst this_val,
+                                         int argc, JSValueConst *argv) {
+  JSValue result = transition_table_rewind(ctx, this_val, 0, NULL);
+
+  if (JS_IsException(result)) {
+    return result;
+  }
+
+  return JS_DupValue(ctx, this_val);
+}
+
+/**
+ * @brief Creates an object reading the rows of a transition table.
+ *
+ * The table gets a read pointer of its own, so that it does not disturb any
+ * other trigger or query reading the same tuplestore.  It can be iterated
+ * over, read a row at a time with `next()`, or in batches with `fetch()`,
+ * and has the number of rows as `length`.
+ * @param ctx #JSContext - the context to create the table in
+ * @param store #Tuplestorestate - the rows of the transition table
+ * @param tupdesc #TupleDesc - the descriptor of the rows
+ * @returns #JSValue of the table.
+ */
+JSValue pljs_transition_table_new(JSContext *ctx, Tuplestorestate *store,
+                                  TupleDesc tupdesc) {
+  JSRuntime *runtime = JS_GetRuntime(ctx);
+
+  if (pljs_transition_class_id == 0) {
+    JS_NewClassID(&pljs_transition_class_id);
+  }
+
+  if (!JS_IsRegisteredClass(runtime, pljs_transition_class_id)) {
+    JS_NewClass(runtime, pljs_transition_class_id, &transition_table_class);
+  }
+
+  // The methods live in the prototype, set up the first time a context
+  // creates a table.
+  JSValue proto = JS_GetClassProto(ctx, pljs_transition_class_id);
+
+  if (JS_IsNull(proto)) {
+    proto = JS_NewObject(ctx);
+    JS_SetPropertyFunctionList(ctx, proto, transition_table_funcs,
+                               lengthof(transition_table_funcs));
+    JS_SetClassProto(ctx, pljs_transition_class_id, JS_DupValue(ctx, proto));
+  }
+
+  JS_FreeValue(ctx, proto);
+
+  pljs_transition_table *table = js_mallocz(ctx, sizeof(*table));
+
+  table->store = store;
+  table->read_pointer = tuplestore_alloc_read_pointer(store, EXEC_FLAG_REWIND);
+  table->slot = MakeSingleTupleTableSlot(tupdesc, &TTSOpsMinimalTuple);
+  table->shape = pljs_row_shape_new(ctx, tupdesc);
+
+  tuplestore_select_read_pointer(store, table->read_pointer);
+  tuplestore_rescan(store);
+
+  JSValue obj = JS_NewObjectClass(ctx, pljs_transition_class_id);
+
+  JS_SetOpaque(obj, table);
+  JS_DefinePropertyValueStr(ctx, obj, "length",
+                            JS_NewInt64(ctx, tuplestore_tuple_count(store)),
+                            JS_PROP_CONFIGURABLE);
+
+  return obj;
+}
+
+/**
+ * @brief Closes a transition table once its trigger has returned.
+ *
+ * The object itself can outlive the trigger, but reading it from then on
+ * throws.
+ * @param ctx #JSContext - the context of the table
+ * @param obj #JSValueConst - the table, may be `JS_UNDEFINED`
+ */
+void pljs_transition_table_close(JSContext *ctx, JSValueConst obj) {
+  pljs_transition_table *table = JS_GetOpaque(obj, pljs_transition_class_id);
+
+  if (table == NULL || table->store == NULL) {
+    return;
+  }
+
+  ExecDropSingleTupleTableSlot(table->slot);
+  pljs_row_shape_release(JS_GetRuntime(ctx), table->shape);
+
+  table->store = NULL;
+  table->slot = NULL;
+  table->shape = NULL;
+}
@@ -1,16 +1,24 @@
 #include "postgres.h"
 
+#include <math.h>
+
 #include "catalog/pg_type_d.h"
+#include "datatype/timestamp.h"
 #include "executor/spi.h"
 #include "fmgr.h"
 #include "funcapi.h"
+#include "miscadmin.h"
 #include "parser/parse_coerce.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/date.h"
 #include "utils/jsonb.h"
 #include "utils/lsyscache.h"
+#include "utils/numeric.h"
 #include "utils/palloc.h"
+#include "utils/timestamp.h"
 #include "utils/typcache.h"
+#include "utils/uuid.h"
 
 #include "deps/quickjs/quickjs.h"
 
@@ -27,6 +35,10 @@ static JSClassID JS_CLASS_INT16_ARRAY = 24;
 static JSClassID JS_CLASS_UINT16_ARRAY = 25;
 static JSClassID JS_CLASS_INT32_ARRAY = 26;
 static JSClassID JS_CLASS_UINT32_ARRAY = 27;
+static JSClassID JS_CLASS_BIG_INT64_ARRAY = 28;
+static JSClassID JS_CLASS_BIG_UINT64_ARRAY = 29;
+static JSClassID JS_CLASS_FLOAT32_ARRAY = 30;
+static JSClassID JS_CLASS_FLOAT64_ARRAY = 31;
 
 inline static bool Is_ArrayType(JSValueConst obj, JSClassID class_id) {
   return NULL != JS_GetOpaque(obj, class_id);
@@ -47,6 +59,361 @@ inline static bool Is_Object(JSValueConst obj) {
   return NULL != JS_GetOpaque(obj, JS_CLASS_OBJECT);
 }
 
+// if given object is a typed array of any sort.
+static bool Is_TypedArray(JSValueConst obj) {
+  for (JSClassID class_id = JS_CLASS_UINT8C_ARRAY;
+       class_id <= JS_CLASS_FLOAT64_ARRAY; class_id++) {
+    if (Is_ArrayType(obj, class_id)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// the typed array class and kind matching the in-memory layout of a postgres
+// type, only types that can be copied as they are have one.
+static JSClassID typed_array_class(Oid typid, JSTypedArrayEnum *array_type) {
+  switch (typid) {
+  case INT2OID:
+    *array_type = JS_TYPED_ARRAY_INT16;
+    return JS_CLASS_INT16_ARRAY;
+
+  case INT4OID:
+    *array_type = JS_TYPED_ARRAY_INT32;
+    return JS_CLASS_INT32_ARRAY;
+
+  case INT8OID:
+    *array_type = JS_TYPED_ARRAY_BIG_INT64;
+    return JS_CLASS_BIG_INT64_ARRAY;
+
+  case FLOAT4OID:
+    *array_type = JS_TYPED_ARRAY_FLOAT32;
+    return JS_CLASS_FLOAT32_ARRAY;
+
+  case FLOAT8OID:
+    *array_type = JS_TYPED_ARRAY_FLOAT64;
+    return JS_CLASS_FLOAT64_ARRAY;
+
+  default:
+    return 0;
+  }
+}
+
+// create a typed array holding a copy of `length` bytes of data.  the
+// intrinsic constructor is used, so user code replacing the global one
+// cannot change what arguments turn into.
+static JSValue new_typed_array(JSContext *ctx, JSTypedArrayEnum array_type,
+                               const void *data, size_t length) {
+  // postgres memory does not live as long as javascript values can, so the
+  // data is copied once instead of being shared.
+  JSValue buffer = JS_NewArrayBufferCopy(ctx, data, length);
+
+  if (JS_IsException(buffer)) {
+    return buffer;
+  }
+
+  JSValue array = JS_NewTypedArray(ctx, 1, &buffer, array_type);
+
+  JS_FreeValue(ctx, buffer);
+
+  return array;
+}
+
+// replacer for JSON.stringify writing typed arrays as arrays, like jsonb
+// does, instead of as objects keyed by index.
+static JSValue json_typed_array_replacer(JSContext *ctx, JSValueConst this_val,
+                                         int argc, JSValueConst *argv) {
+  JSValueConst value = argc > 1 ? argv[1] : JS_UNDEFINED;
+
+  if (!Is_TypedArray(value)) {
+    return JS_DupValue(ctx, value);
+  }
+
+  uint32_t length = js_array_length(ctx, value);
+  JSValue array = JS_NewArray(ctx);
+
+  for (uint32_t i = 0; i < length; i++) {
+    JS_SetPropertyUint32(ctx, array, i, JS_GetPropertyUint32(ctx, value, i));
+  }
+
+  return array;
+}
+
+// days between the unix epoch javascript counts from and the postgres epoch.
+#define EPOCH_OFFSET_DAYS ((int64)(POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE))
+
+// milliseconds in a day.
+#define MSECS_PER_DAY ((int64)SECS_PER_DAY * 1000)
+
+// largest number of milliseconds from the unix epoch a Date can hold.
+#define DATE_MAX_MSECS 8.64e15
+
+// keep the Date constructor of a new context, before any user code runs and
+// can replace the global one.
+void pljs_types_init(JSContext *ctx) {
+  JSValue global_obj = JS_GetGlobalObject(ctx);
+  JSValue *date_ctor = MemoryContextAlloc(TopMemoryContext, sizeof(JSValue));
+
+  *date_ctor = JS_GetPropertyStr(ctx, global_obj, "Date");
+  JS_SetContextOpaque(ctx, date_ctor);
+
+  JS_FreeValue(ctx, global_obj);
+}
+
+// release what pljs_types_init() kept, before the context is freed.
+void pljs_types_free(JSContext *ctx) {
+  JSValue *date_ctor = JS_GetContextOpaque(ctx);
+
+  if (date_ctor == NULL) {
+    return;
+  }
+
+  JS_FreeValue(ctx, *date_ctor);
+  JS_SetContextOpaque(ctx, NULL);
+  pfree(date_ctor);
+}
+
+// create a Date for a number of milliseconds since the unix epoch.
+static JSValue new_date(JSContext *ctx, int64 msecs) {
+  JSValue *date_ctor = JS_GetContextOpaque(ctx);
+  JSValue time = JS_NewInt64(ctx, msecs);
+  JSValue date = JS_CallConstructor(ctx, *date_ctor, 1, &time);
+
+  JS_FreeValue(ctx, time);
+
+  return date;
+}
+
+// convert a timestamp to a Date, timestamps without a time zone are taken to
+// be in UTC.  infinite timestamps have no Date and become infinite numbers.
+static JSValue timestamp_to_jsvalue(JSContext *ctx, Timestamp timestamp) {
+  if (TIMESTAMP_IS_NOBEGIN(timestamp)) {
+    return JS_NewFloat64(ctx, -INFINITY);
+  }
+
+  if (TIMESTAMP_IS_NOEND(timestamp)) {
+    return JS_NewFloat64(ctx, INFINITY);
+  }
+
+  int64 usecs = timestamp + EPOCH_OFFSET_DAYS * USECS_PER_DAY;
+
+  // round towards negative infinity, Dates only hold milliseconds.
+  int64 msecs = usecs / 1000 - (usecs % 1000 < 0 ? 1 : 0);
+
+  return new_date(ctx, msecs);
+}
+
+// convert a date to a Date at midnight UTC.
+static JSValue date_to_jsvalue(JSContext *ctx, DateADT date) {
+  if (DATE_IS_NOBEGIN(date)) {
+    return JS_NewFloat64(ctx, -INFINITY);
+  }
+
+  if (DATE_IS_NOEND(date)) {
+    return JS_NewFloat64(ctx, INFINITY);
+  }
+
+  return new_date(ctx, (date + EPOCH_OFFSET_DAYS) * MSECS_PER_DAY);
+}
+
+// find the milliseconds since the unix epoch of a Date or number, raising an
+// error when there are none.
+static double jsvalue_to_msecs(JSContext *ctx, JSValueConst val,
+                               const char *type_name) {
+  double msecs;
+
+  // a Date converts to its time value.
+  JS_ToFloat64(ctx, &msecs, val);
+
+  if (isnan(msecs) || (!isinf(msecs) && fabs(msecs) > DATE_MAX_MSECS)) {
+    ereport(ERROR, errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+            errmsg("%s out of range", type_name));
+  }
+
+  return msecs;
+}
+
+// convert a Date, a number of milliseconds since the unix epoch or a string
+// to a timestamp.
+static Datum jsvalue_to_timestamp(JSContext *ctx, JSValueConst val,
+                                  Oid typid) {
+  if (JS_IsString(val)) {
+    const char *str = JS_ToCString(ctx, val);
+    char *in = pstrdup(str);
+
+    JS_FreeCString(ctx, str);
+
+    return DirectFunctionCall3(
+        typid == TIMESTAMPOID ? timestamp_in : timestamptz_in,
+        CStringGetDatum(in), ObjectIdGetDatum(InvalidOid), Int32GetDatum(-1));
+  }
+
+  double msecs = jsvalue_to_msecs(ctx, val, "timestamp");
+  Timestamp timestamp;
+
+  if (isinf(msecs)) {
+    if (msecs < 0) {
+      TIMESTAMP_NOBEGIN(timestamp);
+    } else {
+      TIMESTAMP_NOEND(timestamp);
+    }
+
+    return TimestampGetDatum(timestamp);
+  }
+
+  timestamp = (Timestamp)rint(msecs * 1000) - EPOCH_OFFSET_DAYS * USECS_PER_DAY;
+
+  if (!IS_VALID_TIMESTAMP(timestamp)) {
+    ereport(ERROR, errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+            errmsg("timestamp out of range"));
+  }
+
+  return TimestampGetDatum(timestamp);
+}
+
+// convert a Date, a number of milliseconds since the unix epoch or a string
+// to a date, dropping the time of day in UTC.
+static Datum jsvalue_to_date(JSContext *ctx, JSValueConst val) {
+  if (JS_IsString(val)) {
+    const char *str = JS_ToCString(ctx, val);
+    char *in = pstrdup(str);
+
+    JS_FreeCString(ctx, str);
+
+    return DirectFunctionCall1(date_in, CStringGetDatum(in));
+  }
+
+  double msecs = jsvalue_to_msecs(ctx, val, "date");
+  DateADT date;
+
+  if (isinf(msecs)) {
+    if (msecs < 0) {
+      DATE_NOBEGIN(date);
+    } else {
+      DATE_NOEND(date);
+    }
+
+    return DateADTGetDatum(date);
+  }
+
+  int64 days = (int64)floor(msecs / MSECS_PER_DAY) - EPOCH_OFFSET_DAYS;
+
+  if (!IS_VALID_DATE(days)) {
+    ereport(ERROR, errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+            errmsg("date out of range"));
+  }
+
+  date = (DateADT)days;
+
+  return DateADTGetDatum(date);
+}
+
+// convert a uuid to its string form, the same as uuid_out produces.
+static JSValue uuid_to_jsvalue(JSContext *ctx, pg_uuid_t *uuid) {
+  static const char hex[] = "0123456789abcdef";
+  char buffer[UUID_LEN * 2 + 4];
+  char *p = buffer;
+
+  for (int i = 0; i < UUID_LEN; i++) {
+    if (i == 4 || i == 6 || i == 8 || i == 10) {
+      *p++ = '-';
+    }
+
+    *p++ = hex[uuid->data[i] >> 4];
+    *p++ = hex[uuid->data[i] & 0x0f];
+  }
+
+  return JS_NewStringLen(ctx, buffer, p - buffer);
+}
+
+// whether the output of numeric_out is an integral value, cutting off a
+// fraction of zeroes if it is.
+static bool numeric_string_integral(char *str) {
+  char *digits = str + (str[0] == '-' ? 1 : 0);
+  size_t length = strspn(digits, "0123456789");
+
+  // NaN and infinity have no digits.
+  if (length == 0) {
+    return false;
+  }
+
+  if (digits[length] == '.') {
+    char *fraction = digits + length + 1;
+
+    if (fraction[strspn(fraction, "0")] != '\0') {
+      return false;
+    }
+
+    digits[length] = '\0';
+  }
+
+  return digits[length] == '\0';
+}
+
+// convert a numeric as set by pljs.numeric_conversion.
+static JSValue numeric_to_jsvalue(JSContext *ctx, Datum arg) {
+  if (configuration.numeric_conversion == PLJS_NUMERIC_NUMBER) {
+    return JS_NewFloat64(
+        ctx, DatumGetFloat8(DirectFunctionCall1(numeric_float8, arg)));
+  }
+
+  char *str = DatumGetCString(DirectFunctionCall1(numeric_out, arg));
+  JSValue result;
+
+  if (configuration.numeric_conversion == PLJS_NUMERIC_STRING) {
+    result = JS_NewString(ctx, str);
+  } else if (!numeric_string_integral(str)) {
+    result = JS_NewFloat64(
+        ctx, DatumGetFloat8(DirectFunctionCall1(numeric_float8, arg)));
+  } else if (strlen(str) <= 18) {
+    // up to 18 digits always fit in an int64.
+    result = JS_NewBigInt64(ctx, strtoi64(str, NULL, 10));
+  } else {
+    JSValue global_obj = JS_GetGlobalObject(ctx);
+    JSValue bigint = JS_GetPropertyStr(ctx, global_obj, "BigInt");
+    JSValue digits = JS_NewString(ctx, str);
+
+    result = JS_Call(ctx, bigint, JS_UNDEFINED, 1, &digits);
+
+    JS_FreeValue(ctx, digits);
+    JS_FreeValue(ctx, bigint);
+    JS_FreeValue(ctx, global_obj);
+  }
+
+  pfree(str);
+
+  return result;
+}
+
+// find the bytes viewed by a typed array, the data belongs to the array.
+static uint8_t *typed_array_data(JSContext *ctx, JSValueConst array,
+                                 size_t *length) {
+  size_t offset;
+  size_t bytes_per_element;
+  size_t size;
+
+  JSValue buffer = JS_GetTypedArrayBuffer(ctx, array, &offset, length,
+                                          &bytes_per_element);
+
+  if (JS_IsException(buffer)) {
+    return NULL;
+  }
+
+  uint8_t *data = JS_GetArrayBuffer(ctx, &size, buffer);
+
+  // the array buffer is still referenced by the typed array.
+  JS_FreeValue(ctx, buffer);
+
+  // a detached buffer has no data left.
+  if (data == NULL) {
+    *length = 0;
+    return NULL;
+  }
+
+  return data + offset;
+}
+
 // allocate memory and copy data from the varlena text representation.
 static char *dup_pgtext(text *what) {
   size_t len = VARSIZE(what) - VARHDRSZ;
@@ -111,6 +478,7 @@ void pljs_type_fill(pljs_type *type, Oid typid) {
   get_type_category_preferred(typid, &type->category, &is_preferred);
 
   type->is_composite = (type->category == TYPCATEGORY_COMPOSITE);
+  type->element_category = type->category;
 
   get_typlenbyvalalign(typid, &type->len, &type->byval, &type->align);
 
@@ -123,13 +491,28 @@ void pljs_type_fill(pljs_type *type, Oid typid) {
     }
 
     type->typid = elemid;
-    type->is_composite = (TypeCategory(elemid) == TYPCATEGORY_COMPOSITE);
+    type->element_category = TypeCategory(elemid);
+    type->is_composite = (type->element_category == TYPCATEGORY_COMPOSITE ||
+                          type->element_category == TYPCATEGORY_PSEUDOTYPE);
     get_typlenbyvalalign(type->typid, &type->len, &type->byval, &type->align);
   } else if (type->category == TYPCATEGORY_PSEUDOTYPE) {
     type->is_composite = true;
   }
 }
 
+// convert the tuple of a composite value to an object of the given shape.
+static JSValue composite_to_object(JSContext *ctx, pljs_row_shape *shape,
+                                   HeapTupleHeader rec) {
+  HeapTupleData tuple;
+
+  tuple.t_len = HeapTupleHeaderGetDatumLength(rec);
+  ItemPointerSetInvalid(&(tuple.t_self));
+  tuple.t_tableOid = InvalidOid;
+  tuple.t_data = rec;
+
+  return pljs_row_to_object(ctx, shape, &tuple);
+}
+
 JSValue pljs_datum_to_object(Datum arg, pljs_type *type, JSContext *ctx) {
   JSValue obj;
 
@@ -137,7 +520,6 @@ JSValue pljs_datum_to_object(Datum arg, pljs_type *type, JSContext *ctx) {
   Oid tupType;
   int32 tupTypmod;
   TupleDesc tupdesc = NULL;
-  HeapTupleData tuple;
 
   PG_TRY();
   {
@@ -150,57 +532,97 @@ JSValue pljs_datum_to_object(Datum arg, pljs_type *type, JSContext *ctx) {
   { elog(WARNING, "caught error"); }
   PG_END_TRY();
 
-  obj = JS_NewObject(ctx);
-
   if (tupdesc) {
-    for (int16 i = 0; i < tupdesc->natts; i++) {
-      Datum datum;
-      bool isnull = false;
-
-      if (TupleDescAttr(tupdesc, i)->attisdropped) {
-        continue;
-      }
+    // the shape of a row type is cached, along with its column names.
+    pljs_row_shape *shape = pljs_row_shape_new(ctx, tupdesc);
 
-      char *colname = NameStr(TupleDescAttr(tupdesc, i)->attname);
-      tuple.t_len = HeapTupleHeaderGetDatumLength(rec);
-      ItemPointerSetInvalid(&(tuple.t_self));
-      tuple.t_tableOid = InvalidOid;
-      tuple.t_data = rec;
-
-      datum = heap_getattr(&tuple, i + 1, tupdesc, &isnull);
-
-      if (isnull) {
-        JS_SetPropertyStr(ctx, obj, colname, JS_NULL);
-      } else {
-        JS_SetPropertyStr(
-            ctx, obj, colname,
-            pljs_datum_to_jsvalue(datum, tupdesc->attrs[i].atttypid, ctx));
-      }
-    }
+    obj = composite_to_object(ctx, shape, rec);
 
+    pljs_row_shape_release(JS_GetRuntime(ctx), shape);
     ReleaseTupleDesc(tupdesc);
+  } else {
+    obj = JS_NewObject(ctx);
   }
 
   return obj;
 }
 
+// derive the type of the elements of an array type, an array type already
+// carries everything needed about its elements, so there is no need to look
+// them up again.
+static void pljs_type_element(pljs_type *element, pljs_type *array) {
+  *element = *array;
+  element->category = array->element_category;
+}
+
 // convert a datum to a quickjs array.
 JSValue pljs_datum_to_array(Datum arg, pljs_type *type, JSContext *ctx) {
-  JSValue array = JS_NewArray(ctx);
+  ArrayType *arr = DatumGetArrayTypeP(arg);
   Datum *values;
   bool *nulls;
   int nelems;
+  pljs_type element_type;
+  JSTypedArrayEnum array_type;
 
-  deconstruct_array(DatumGetArrayTypeP(arg), type->typid, type->len,
-                    type->byval, type->align, &values, &nulls, &nelems);
+  // arrays of numbers without nulls are stored exactly like a typed array
+  // stores them, so they are copied over all at once when asked to.
+  if (configuration.typed_arrays && !ARR_HASNULL(arr) &&
+      typed_array_class(type->typid, &array_type)) {
+    nelems = ArrayGetNItems(ARR_NDIM(arr), ARR_DIMS(arr));
+
+    return new_typed_array(ctx, array_type, ARR_DATA_PTR(arr),
+                           (size_t)nelems * type->len);
+  }
+
+  JSValue array = JS_NewArray(ctx);
+
+  pljs_type_element(&element_type, type);
+
+  deconstruct_array(arr, type->typid, type->len, type->byval, type->align,
+                    &values, &nulls, &nelems);
+
+  // the row type of composite elements is looked up once, and again only
+  // when an element of another type shows up, as records can.
+  pljs_row_shape *shape = NULL;
+  Oid shape_typid = InvalidOid;
+  int32 shape_typmod = -1;
 
   for (int i = 0; i < nelems; i++) {
-    JSValue value =
-        nulls[i] ? JS_NULL : pljs_datum_to_jsvalue(values[i], type->typid, ctx);
+    JSValue value;
+
+    if (nulls[i]) {
+      value = JS_NULL;
+    } else if (element_type.is_composite) {
+      HeapTupleHeader rec = DatumGetHeapTupleHeader(values[i]);
+      Oid typid = HeapTupleHeaderGetTypeId(rec);
+      int32 typmod = HeapTupleHeaderGetTypMod(rec);
+
+      if (shape == NULL || typid != shape_typid || typmod != shape_typmod) {
+        TupleDesc tupdesc = lookup_rowtype_tupdesc(typid, typmod);
+
+        if (shape != NULL) {
+          pljs_row_shape_release(JS_GetRuntime(ctx), shape);
+        }
+
+        shape = pljs_row_shape_new(ctx, tupdesc);
+        shape_typid = typid;
+        shape_typmod = typmod;
+
+        ReleaseTupleDesc(tupdesc);
+      }
+
+      value = composite_to_object(ctx, shape, rec);
+    } else {
+      value = pljs_datum_to_jsvalue_typed(values[i], &element_type, ctx);
+    }
 
     JS_SetPropertyUint32(ctx, array, i, value);
   }
 
+  if (shape != NULL) {
+    pljs_row_shape_release(JS_GetRuntime(ctx), shape);
+  }
+
   JSValue length = JS_NewInt32(ctx, nelems);
   JS_SetPropertyStr(ctx, array, "length", length);
 
@@ -210,24 +632,352 @@ JSValue pljs_datum_to_array(Datum arg, pljs_type *type, JSContext *ctx) {
   return array;
 }
 
+// convert a scalar jsonb value to a quickjs value.
+static JSValue jsonb_scalar_to_jsvalue(JsonbValue *v, JSContext *ctx) {
+  switch (v->type) {
+  case jbvNull:
+    return JS_NULL;
+
+  case jbvBool:
+    return JS_NewBool(ctx, v->val.boolean);
+
+  case jbvString:
+    return JS_NewStringLen(ctx, v->val.string.val, v->val.string.len);
+
+  case jbvNumeric:
+    // overflows to Infinity, just as JSON.parse does.
+    return JS_NewFloat64(ctx, DatumGetFloat8(DirectFunctionCall1(
+                                  numeric_float8_no_overflow,
+                                  NumericGetDatum(v->val.numeric))));
+
+  default:
+    elog(ERROR, "unexpected jsonb value type: %d", v->type);
+  }
+
+  return JS_NULL;
+}
+
+// an object or array being built while walking a jsonb container.
+typedef struct jsonb_frame {
+  JSValue value;
+  bool is_array;
+  uint32 index;   // next index when building an array
+  JsonbValue key; // pending key when building an object
+} jsonb_frame;
+
+// convert a jsonb value to a quickjs value by walking the container
+// directly, rather than serializing to text and parsing it again.
+static JSValue jsonb_to_jsvalue(Jsonb *jb, JSContext *ctx) {
+  JsonbValue v;
+
+  if (JB_ROOT_IS_SCALAR(jb)) {
+    JsonbExtractScalar(&jb->root, &v);
+
+    return jsonb_scalar_to_jsvalue(&v, ctx);
+  }
+
+  int size = 8;
+  int depth = -1;
+  jsonb_frame *frames = palloc(sizeof(jsonb_frame) * size);
+  JsonbIterator *it = JsonbIteratorInit(&jb->root);
+  JsonbIteratorToken token;
+  JSValue result = JS_NULL;
+
+  while ((token = JsonbIteratorNext(&it, &v, false)) != WJB_DONE) {
+    JSValue value;
+
+    switch (token) {
+    case WJB_BEGIN_ARRAY:
+    case WJB_BEGIN_OBJECT:
+      if (++depth == size) {
+        size *= 2;
+        frames = repalloc(frames, sizeof(jsonb_frame) * size);
+      }
+
+      frames[depth].is_array = (token == WJB_BEGIN_ARRAY);
+      frames[depth].value =
+          frames[depth].is_array ? JS_NewArray(ctx) : JS_NewObject(ctx);
+      frames[depth].index = 0;
+      continue;
+
+    case WJB_KEY:
+      frames[depth].key = v;
+      continue;
+
+    case WJB_END_ARRAY:
+    case WJB_END_OBJECT:
+      value = frames[depth--].value;
+      break;
+
+    default:
+      // WJB_ELEM and WJB_VALUE, nested containers arrive as WJB_BEGIN_*.
+      value = jsonb_scalar_to_jsvalue(&v, ctx);
+      break;
+    }
+
+    // the root container is complete.
+    if (depth < 0) {
+      result = value;
+      continue;
+    }
+
+    jsonb_frame *frame = &frames[depth];
+
+    if (frame->is_array) {
+      JS_DefinePropertyValueUint32(ctx, frame->value, frame->index++, value,
+                                   JS_PROP_C_W_E);
+    } else {
+      JSAtom atom = JS_NewAtomLen(ctx, frame->key.val.string.val,
+                                  frame->key.val.string.len);
+
+      JS_DefinePropertyValue(ctx, frame->value, atom, value, JS_PROP_C_W_E);
+      JS_FreeAtom(ctx, atom);
+    }
+  }
+
+  pfree(frames);
+
+  return result;
+}
+
+// whether JSON.stringify would leave the value out.
+static bool jsonb_skipped(JSContext *ctx, JSValueConst val) {
+  return JS_IsUndefined(val) || JS_IsFunction(ctx, val) || JS_IsSymbol(val);
+}
+
+// apply toJSON to a value if it has one, as JSON.stringify does.  Returns a
+// new reference that needs to be freed.
+static JSValue jsonb_prepare(JSContext *ctx, JSValueConst val, JSAtom key) {
+  if (!JS_IsObject(val)) {
+    return JS_DupValue(ctx, val);
+  }
+
+  JSValue to_json = JS_GetPropertyStr(ctx, val, "toJSON");
+
+  if (!JS_IsFunction(ctx, to_json)) {
+    JS_FreeValue(ctx, to_json);
+
+    return JS_DupValue(ctx, val);
+  }
+
+  JSValue key_value =
+      key == JS_ATOM_NULL ? JS_NewString(ctx, "") : JS_AtomToString(ctx, key);
+  JSValue result = JS_Call(ctx, to_json, val, 1, &key_value);
+
+  JS_FreeValue(ctx, key_value);
+  JS_FreeValue(ctx, to_json);
+
+  if (JS_IsException(result)) {
+    JSValue exception = JS_GetException(ctx);
+    const char *message = JS_ToCString(ctx, exception);
+    char *copy = pstrdup(message ? message : "unknown exception");
+
+    JS_FreeCString(ctx, message);
+    JS_FreeValue(ctx, exception);
+
+    ereport(ERROR, (errmsg("execution error"), errdetail("%s", copy)));
+  }
+
+  return result;
+}
+
+// convert a javascript number or bigint to a numeric.
+static Numeric jsvalue_to_numeric(JSContext *ctx, JSValueConst val) {
+  if (JS_VALUE_GET_TAG(val) == JS_TAG_INT) {
+    return int64_to_numeric(JS_VALUE_GET_INT(val));
+  }
+
+  if (!JS_IsBigInt(ctx, val)) {
+    double in;
+
+    JS_ToFloat64(ctx, &in, val);
+
+    // integral values skip formatting and parsing entirely.
+    if (in == trunc(in) && fabs(in) < 9007199254740992.0) {
+      return int64_to_numeric((int64)in);
+    }
+  }
+
+  // use the shortest representation that round trips, which is what
+  // JSON.stringify would have produced.
+  const char *str = JS_ToCString(ctx, val);
+  Numeric result = DatumGetNumeric(
+      DirectFunctionCall3(numeric_in, CStringGetDatum(str),
+                          ObjectIdGetDatum(InvalidOid), Int32GetDatum(-1)));
+
+  JS_FreeCString(ctx, str);
+
+  return result;
+}
+
+// convert a javascript primitive to a scalar jsonb value.
+static void jsvalue_to_jsonb_scalar(JSContext *ctx, JSValueConst val,
+                                    JsonbValue *out) {
+  if (JS_IsBool(val)) {
+    out->type = jbvBool;
+    out->val.boolean = JS_ToBool(ctx, val);
+  } else if (JS_IsString(val)) {
+    size_t length;
+    const char *str = JS_ToCStringLen(ctx, &length, val);
+
+    out->type = jbvString;
+    out->val.string.val = pnstrdup(str, length);
+    out->val.string.len = length;
+
+    JS_FreeCString(ctx, str);
+  } else if (JS_IsBigInt(ctx, val)) {
+    out->type = jbvNumeric;
+    out->val.numeric = jsvalue_to_numeric(ctx, val);
+  } else if (JS_IsNumber(val)) {
+    double in;
+
+    JS_ToFloat64(ctx, &in, val);
+
+    // JSON.stringify turns NaN and Infinity into null.
+    if (isfinite(in)) {
+      out->type = jbvNumeric;
+      out->val.numeric = jsvalue_to_numeric(ctx, val);
+    } else {
+      out->type = jbvNull;
+    }
+  } else {
+    out->type = jbvNull;
+  }
+}
+
+// push a javascript value into a jsonb parse state, returning the result of
+// the last push.  The value must already have been through jsonb_prepare.
+static JsonbValue *jsvalue_push_jsonb(JSContext *ctx, JSValueConst val,
+                                      JsonbParseState **state,
+                                      JsonbIteratorToken token) {
+  check_stack_depth();
+
+  if (!JS_IsObject(val)) {
+    JsonbValue scalar;
+
+    jsvalue_to_jsonb_scalar(ctx, val, &scalar);
+
+    return pushJsonbValue(state, token, &scalar);
+  }
+
+  // typed arrays are written as arrays, not as objects keyed by index.
+  if (JS_IsArray(ctx, val) || Is_TypedArray(val)) {
+    uint32_t length = js_array_length(ctx, val);
+
+    pushJsonbValue(state, WJB_BEGIN_ARRAY, NULL);
+
+    for (uint32_t i = 0; i < length; i++) {
+      JSValue element = JS_GetPropertyUint32(ctx, val, i);
+      JSAtom atom = JS_NewAtomUInt32(ctx, i);
+      JSValue prepared = jsonb_prepare(ctx, element, atom);
+
+      JS_FreeAtom(ctx, atom);
+      JS_FreeValue(ctx, element);
+
+      // arrays keep their length, leaving null in place of skipped values.
+      if (jsonb_skipped(ctx, prepared)) {
+        JsonbValue null_value = {.type = jbvNull};
+
+        pushJsonbValue(state, WJB_ELEM, &null_value);
+      } else {
+        jsvalue_push_jsonb(ctx, prepared, state, WJB_ELEM);
+      }
+
+      JS_FreeValue(ctx, prepared);
+    }
+
+    return pushJsonbValue(state, WJB_END_ARRAY, NULL);
+  }
+
+  JSPropertyEnum *properties;
+  uint32_t count;
+
+  if (JS_GetOwnPropertyNames(ctx, &properties, &count, val,
+                             JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY) < 0) {
+    elog(ERROR, "unable to read object properties");
+  }
+
+  pushJsonbValue(state, WJB_BEGIN_OBJECT, NULL);
+
+  for (uint32_t i = 0; i < count; i++) {
+    JSValue property = JS_GetProperty(ctx, val, properties[i].atom);
+    JSValue prepared = jsonb_prepare(ctx, property, properties[i].atom);
+
+    JS_FreeValue(ctx, property);
+
+    if (!jsonb_skipped(ctx, prepared)) {
+      JsonbValue key;
+      size_t length;
+      JSValue name = JS_AtomToString(ctx, properties[i].atom);
+      const char *str = JS_ToCStringLen(ctx, &length, name);
+
+      key.type = jbvString;
+      key.val.string.val = pnstrdup(str, length);
+      key.val.string.len = length;
+
+      JS_FreeCString(ctx, str);
+      JS_FreeValue(ctx, name);
+
+      pushJsonbValue(state, WJB_KEY, &key);
+      jsvalue_push_jsonb(ctx, prepared, state, WJB_VALUE);
+    }
+
+    JS_FreeValue(ctx, prepared);
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    JS_FreeAtom(ctx, properties[i].atom);
+  }
+
+  js_free(ctx, properties);
+
+  return pushJsonbValue(state, WJB_END_OBJECT, NULL);
+}
+
+// convert a quickjs value to jsonb by building the jsonb value directly,
+// rather than stringifying it and parsing the text again.
+static Jsonb *jsvalue_to_jsonb(JSValueConst val, JSContext *ctx) {
+  JSValue prepared = jsonb_prepare(ctx, val, JS_ATOM_NULL);
+  JsonbValue *result;
+  JsonbValue scalar;
+
+  if (JS_IsObject(prepared) && !JS_IsFunction(ctx, prepared)) {
+    JsonbParseState *state = NULL;
+
+    result = jsvalue_push_jsonb(ctx, prepared, &state, WJB_VALUE);
+  } else {
+    jsvalue_to_jsonb_scalar(ctx, prepared, &scalar);
+    result = &scalar;
+  }
+
+  JS_FreeValue(ctx, prepared);
+
+  return JsonbValueToJsonb(result);
+}
+
 // convert a value to a quickjs value.
 JSValue pljs_datum_to_jsvalue(Datum arg, Oid argtype, JSContext *ctx) {
-  JSValue return_result;
-  char *str;
-  Jsonb *jb;
-
   pljs_type type;
   pljs_type_fill(&type, argtype);
 
-  if (type.category == TYPCATEGORY_ARRAY) {
-    return pljs_datum_to_array(arg, &type, ctx);
+  return pljs_datum_to_jsvalue_typed(arg, &type, ctx);
+}
+
+// convert a value to a quickjs value, using an already filled pljs_type.
+JSValue pljs_datum_to_jsvalue_typed(Datum arg, pljs_type *type,
+                                    JSContext *ctx) {
+  JSValue return_result;
+  char *str;
+
+  if (type->category == TYPCATEGORY_ARRAY) {
+    return pljs_datum_to_array(arg, type, ctx);
   }
 
-  if (type.is_composite) {
-    return pljs_datum_to_object(arg, &type, ctx);
+  if (type->is_composite) {
+    return pljs_datum_to_object(arg, type, ctx);
   }
 
-  switch (type.typid) {
+  switch (type->typid) {
   case OIDOID:
     return_result = JS_NewInt64(ctx, arg);
     break;
@@ -257,8 +1007,20 @@ JSValue pljs_datum_to_jsvalue(Datum arg, Oid argtype, JSContext *ctx) {
     break;
 
   case NUMERICOID:
-    return_result = JS_NewFloat64(
-        ctx, DatumGetFloat8(DirectFunctionCall1(numeric_float8, arg)));
+    return_result = numeric_to_jsvalue(ctx, arg);
+    break;
+
+  case TIMESTAMPOID:
+  case TIMESTAMPTZOID:
+    return_result = timestamp_to_jsvalue(ctx, DatumGetTimestamp(arg));
+    break;
+
+  case DATEOID:
+    return_result = date_to_jsvalue(ctx, DatumGetDateADT(arg));
+    break;
+
+  case UUIDOID:
+    return_result = uuid_to_jsvalue(ctx, DatumGetUUIDP(arg));
     break;
 
   case TEXTOID:
@@ -289,31 +1051,23 @@ JSValue pljs_datum_to_jsvalue(Datum arg, Oid argtype, JSContext *ctx) {
     break;
 
   case JSONBOID:
-    // get the datum
-    jb = DatumGetJsonbP(arg);
-
-    // convert it to a string (takes some casting, but JsonbContainer is also
-    // a varlena).
-    str = JsonbToCString(NULL, (JsonbContainer *)VARDATA(jb), VARSIZE(jb));
-
-    return_result = JS_ParseJSON(ctx, str, strlen(str), NULL);
-
-    // free the memory allocated.
-    pfree(str);
+    return_result = jsonb_to_jsvalue(DatumGetJsonbP(arg), ctx);
     break;
 
   case BYTEAOID: {
-    void *p = PG_DETOAST_DATUM_COPY(arg);
-    char *buf = palloc(VARSIZE_ANY_EXHDR(p) + 1);
-    memcpy(buf, VARDATA(p), VARSIZE_ANY_EXHDR(p));
+    bytea *p = DatumGetByteaPP(arg);
 
-    return_result = JS_NewStringLen(ctx, buf, VARSIZE_ANY_EXHDR(p));
-    pfree(buf);
+    return_result = new_typed_array(ctx, JS_TYPED_ARRAY_UINT8, VARDATA_ANY(p),
+                                    VARSIZE_ANY_EXHDR(p));
+
+    if ((Pointer)p != DatumGetPointer(arg)) {
+      pfree(p);
+    }
     break;
   }
 
   default:
-    elog(DEBUG3, "Unknown type: %d", argtype);
+    elog(DEBUG3, "Unknown type: %d", type->typid);
     return_result = JS_NULL;
   }
 
@@ -329,7 +1083,38 @@ Datum pljs_jsvalue_to_array(JSValue val, pljs_type *type, JSContext *ctx,
   int ndims[1];
   int lbs[] = {[0] = 1};
 
+  JSTypedArrayEnum array_type;
+  JSClassID class_id = typed_array_class(type->typid, &array_type);
+
+  // a typed array that matches the element type is copied over all at once.
+  if (class_id && Is_ArrayType(val, class_id)) {
+    size_t length;
+    uint8_t *data = typed_array_data(ctx, val, &length);
+    int nelems = length / type->len;
+    Size nbytes = ARR_OVERHEAD_NONULLS(1) + length;
+
+    // an empty array has no dimensions at all.
+    if (nelems == 0) {
+      return PointerGetDatum(construct_empty_array(type->typid));
+    }
+
+    result = (ArrayType *)palloc0(nbytes);
+    SET_VARSIZE(result, nbytes);
+    result->ndim = 1;
+    result->dataoffset = 0;
+    result->elemtype = type->typid;
+    *ARR_DIMS(result) = nelems;
+    *ARR_LBOUND(result) = 1;
+
+    memcpy(ARR_DATA_PTR(result), data, length);
+
+    return PointerGetDatum(result);
+  }
+
   int32_t array_length = js_array_length(ctx, val);
+  pljs_type element_type;
+
+  pljs_type_element(&element_type, type);
 
   values = (Datum *)palloc(sizeof(Datum) * array_length);
   nulls = (bool *)palloc(sizeof(bool) * array_length);
@@ -343,8 +1128,8 @@ Datum pljs_jsvalue_to_array(JSValue val, pljs_type *type, JSContext *ctx,
     if (JS_IsNull(elem)) {
       nulls[i] = true;
     } else {
-      values[i] =
-          pljs_jsvalue_to_datum(elem, type->typid, ctx, fcinfo, &nulls[i]);
+      values[i] = pljs_jsvalue_to_datum_typed(elem, &element_type, ctx, fcinfo,
+                                              &nulls[i]);
     }
   }
 
@@ -419,16 +1204,27 @@ Datum pljs_jsvalue_to_datum(JSValue val, Oid rettype, JSContext *ctx,
 
   pljs_type_fill(&type, rettype);
 
-  if (type.typid != JSONOID && type.typid != JSONBOID && JS_IsArray(ctx, val)) {
-    return pljs_jsvalue_to_array(val, &type, ctx, fcinfo);
+  return pljs_jsvalue_to_datum_typed(val, &type, ctx, fcinfo, isnull);
+}
+
+// Convert a quickjs value to a datum, using an already filled pljs_type.
+Datum pljs_jsvalue_to_datum_typed(JSValue val, pljs_type *type, JSContext *ctx,
+                                  FunctionCallInfo fcinfo, bool *isnull) {
+  if (type->typid != JSONOID && type->typid != JSONBOID &&
+      JS_IsArray(ctx, val)) {
+    return pljs_jsvalue_to_array(val, type, ctx, fcinfo);
   }
 
-  if (type.category == TYPCATEGORY_ARRAY && !JS_IsArray(ctx, val)) {
+  if (type->category == TYPCATEGORY_ARRAY) {
+    if (Is_TypedArray(val)) {
+      return pljs_jsvalue_to_array(val, type, ctx, fcinfo);
+    }
+
     elog(ERROR, "value is not an Array");
   }
 
-  if (type.is_composite) {
-    return pljs_jsvalue_to_record(val, &type, ctx, isnull, NULL);
+  if (type->is_composite) {
+    return pljs_jsvalue_to_record(val, type, ctx, isnull, NULL);
   }
 
   if (JS_VALUE_GET_TAG(val) == JS_TAG_NULL) {
@@ -443,7 +1239,7 @@ Datum pljs_jsvalue_to_datum(JSValue val, Oid rettype, JSContext *ctx,
     }
   }
 
-  switch (rettype) {
+  switch (type->typid) {
   case VOIDOID:
     PG_RETURN_VOID();
     break;
@@ -523,13 +1319,14 @@ Datum pljs_jsvalue_to_datum(JSValue val, Oid rettype, JSContext *ctx,
   }
 
   case NUMERICOID: {
-    if (JS_IsBigInt(ctx, val)) {
-      // Convert the value to a string then convert it to NUMERIC
-      JSValue str = JS_ToString(ctx, val);
+    if (JS_IsBigInt(ctx, val) || JS_IsString(val)) {
+      // BigInts and strings hold the exact value, so they are parsed.
+      const char *str = JS_ToCString(ctx, val);
+      char *in = pstrdup(str);
 
-      const char *in = JS_ToCString(ctx, str);
+      JS_FreeCString(ctx, str);
 
-      return DirectFunctionCall3(numeric_in, (Datum)in,
+      return DirectFunctionCall3(numeric_in, CStringGetDatum(in),
                                  ObjectIdGetDatum(InvalidOid),
                                  Int32GetDatum((int32)-1));
 
@@ -543,6 +1340,22 @@ Datum pljs_jsvalue_to_datum(JSValue val, Oid rettype, JSContext *ctx,
     break;
   }
 
+  case TIMESTAMPOID:
+  case TIMESTAMPTZOID:
+    return jsvalue_to_timestamp(ctx, val, type->typid);
+
+  case DATEOID:
+    return jsvalue_to_date(ctx, val);
+
+  case UUIDOID: {
+    const char *str = JS_ToCString(ctx, val);
+    char *in = pstrdup(str);
+
+    JS_FreeCString(ctx, str);
+
+    return DirectFunctionCall1(uuid_in, CStringGetDatum(in));
+  }
+
   case TEXTOID:
   case VARCHAROID:
   case BPCHAROID:
@@ -560,7 +1373,11 @@ Datum pljs_jsvalue_to_datum(JSValue val, Oid rettype, JSContext *ctx,
 
   case JSONOID: {
     JSValueConst *argv = &val;
-    JSValue js = JS_JSONStringify(ctx, argv[0], JS_UNDEFINED, JS_UNDEFINED);
+    JSValue replacer =
+        JS_NewCFunction(ctx, json_typed_array_replacer, "replacer", 2);
+    JSValue js = JS_JSONStringify(ctx, argv[0], replacer, JS_UNDEFINED);
+
+    JS_FreeValue(ctx, replacer);
     size_t plen;
     const char *str = JS_ToCStringLen(ctx, &plen, js);
 
@@ -573,96 +1390,27 @@ Datum pljs_jsvalue_to_datum(JSValue val, Oid rettype, JSContext *ctx,
     break;
   }
 
-  case JSONBOID: {
-    JSValueConst *argv = &val;
-    JSValue js = JS_JSONStringify(ctx, argv[0], JS_UNDEFINED, JS_UNDEFINED);
-    size_t plen;
-    const char *str = JS_ToCStringLen(ctx, &plen, js);
-    // return it as a Datum, since there is no direct CStringGetJsonb exposed.
-    Datum ret = (Datum)DatumGetJsonbP(
-        DirectFunctionCall1(jsonb_in, (Datum)(char *)str));
-
-    JS_FreeCString(ctx, str);
-
-    return ret;
+  case JSONBOID:
+    return JsonbPGetDatum(jsvalue_to_jsonb(val, ctx));
     break;
-  }
 
   case BYTEAOID: {
     size_t psize;
-    size_t pbytes_per_element = 0;
-
     uint8_t *buffer;
 
-    uint32_t length = js_array_length(ctx, val);
-
-    if (Is_ArrayType(val, JS_CLASS_UINT8_ARRAY) ||
-        Is_ArrayType(val, JS_CLASS_INT8_ARRAY)) {
-      pbytes_per_element = 1;
-      psize = pbytes_per_element * length;
-      uint8_t *array_copy = palloc(pbytes_per_element * length);
-
-      for (size_t i = 0; i < length; i++) {
-        int32_t in;
-
-        JSValue jsval = JS_GetPropertyUint32(ctx, val, i);
-        JS_ToInt32(ctx, &in, jsval);
-        array_copy[i] = (uint8_t)in;
-      }
-
-      buffer = palloc(VARHDRSZ + psize);
-
-      SET_VARSIZE(buffer, psize + VARHDRSZ);
-      memcpy(VARDATA(buffer), array_copy, psize);
-
-      pfree(array_copy);
-
-      return PointerGetDatum(buffer);
-    } else if (Is_ArrayType(val, JS_CLASS_UINT16_ARRAY) ||
-               Is_ArrayType(val, JS_CLASS_INT16_ARRAY)) {
-      pbytes_per_element = 2;
-      psize = pbytes_per_element * length;
-      uint16_t *array_copy = palloc(pbytes_per_element * length);
-
-      for (size_t i = 0; i < length; i++) {
-        int32_t in;
-
-        JSValue jsval = JS_GetPropertyUint32(ctx, val, i);
-        JS_ToInt32(ctx, &in, jsval);
-        array_copy[i] = (uint16_t)in;
-      }
+    // every typed array is stored as the bytes it holds.
+    if (Is_TypedArray(val)) {
+      uint8_t *data = typed_array_data(ctx, val, &psize);
 
       buffer = palloc(VARHDRSZ + psize);
 
       SET_VARSIZE(buffer, psize + VARHDRSZ);
-      memcpy(VARDATA(buffer), array_copy, psize);
-
-      pfree(array_copy);
 
-      return PointerGetDatum(buffer);
-    } else if (Is_ArrayType(val, JS_CLASS_UINT32_ARRAY) ||
-               Is_ArrayType(val, JS_CLASS_INT32_ARRAY)) {
-      pbytes_per_element = 4;
-      psize = pbytes_per_element * length;
-      uint32_t *array_copy = palloc(pbytes_per_element * length);
-
-      for (size_t i = 0; i < pbytes_per_element * length; i++) {
-        int32_t in;
-
-        JSValue jsval = JS_GetPropertyUint32(ctx, val, i);
-        JS_ToInt32(ctx, &in, jsval);
-        array_copy[i] = (uint32_t)in;
+      if (psize > 0) {
+        memcpy(VARDATA(buffer), data, psize);
       }
 
-      buffer = palloc(VARHDRSZ + psize);
-
-      SET_VARSIZE(buffer, psize + VARHDRSZ);
-      memcpy(VARDATA(buffer), array_copy, psize);
-
-      pfree(array_copy);
-
       return PointerGetDatum(buffer);
-
     } else if (Is_ArrayBuffer(val)) {
       uint8_t *array_copy = JS_GetArrayBuffer(ctx, &psize, val);
       buffer = palloc(VARHDRSZ + psize);
@@ -695,7 +1443,7 @@ Datum pljs_jsvalue_to_datum(JSValue val, Oid rettype, JSContext *ctx,
   }
 
   default:
-    elog(DEBUG3, "Unknown type: %d", rettype);
+    elog(DEBUG3, "Unknown type: %d", type->typid);
     if (fcinfo) {
       PG_RETURN_NULL();
     } else {
@@ -724,29 +1472,14 @@ JSValue values_to_array(JSContext *ctx, JSValue *array, int argc, int start) {
 
 JSValue tuple_to_jsvalue(JSContext *ctx, TupleDesc tuple,
                          HeapTuple heap_tuple) {
-  JSValue obj = JS_NewObject(ctx);
-
-  for (int i = 0; i < tuple->natts; i++) {
-    FormData_pg_attribute *tuple_attrs = TupleDescAttr(tuple, i);
-    if (tuple_attrs->attisdropped) {
-      continue;
-    }
-
-    bool isnull;
-    Datum datum = heap_getattr(heap_tuple, i + 1, tuple, &isnull);
-
-    char *name = NameStr(tuple_attrs->attname);
+  pljs_row_shape *shape = pljs_row_shape_new(ctx, tuple);
+  JSValue row = configuration.lazy_rows
+                    ? pljs_row_new(ctx, shape, heap_tuple)
+                    : pljs_row_to_object(ctx, shape, heap_tuple);
 
-    if (isnull) {
-      JS_SetPropertyStr(ctx, obj, name, JS_NULL);
-    } else {
-      JS_SetPropertyStr(
-          ctx, obj, name,
-          pljs_datum_to_jsvalue(datum, tuple_attrs->atttypid, ctx));
-    }
-  }
+  pljs_row_shape_release(JS_GetRuntime(ctx), shape);
 
-  return obj;
+  return row;
 }
 
 JSValue spi_result_to_jsvalue(JSContext *ctx, int status) {
@@ -774,12 +1507,21 @@ JSValue spi_result_to_jsvalue(JSContext *ctx, int status) {
 
     JSValue obj = JS_NewArray(ctx);
 
+    // All rows of a result share a single shape, so the column names are
+    // only turned into atoms once.
+    pljs_row_shape *shape = pljs_row_shape_new(ctx, tupdesc);
+
     for (int r = 0; r < nrows; r++) {
-      JSValue value = tuple_to_jsvalue(ctx, tupdesc, SPI_tuptable->vals[r]);
+      JSValue value =
+          configuration.lazy_rows
+              ? pljs_row_new(ctx, shape, SPI_tuptable->vals[r])
+              : pljs_row_to_object(ctx, shape, SPI_tuptable->vals[r]);
 
       JS_SetPropertyUint32(ctx, obj, r, value);
     }
 
+    pljs_row_shape_release(JS_GetRuntime(ctx), shape);
+
     result = obj;
     break;
   }
@@ -0,0 +1,422 @@
+#include "postgres.h"
+
+#include "utils/memutils.h"
+#include "windowapi.h"
+
+#include "deps/quickjs/quickjs.h"
+
+#include "pljs.h"
+
+/**
+ * @brief The window function being called, `winobj` is NULL outside of one.
+ */
+static pljs_window current_window = {0};
+
+/**
+ * @brief The partition local state of a window function.
+ *
+ * Lives in the partition local memory of the window, which is reset at the
+ * end of every partition, releasing the value along with it.  The value pins
+ * its context until then.
+ */
+typedef struct pljs_window_local {
+  JSContext *ctx; // NULL until a value has been set
+  JSValue value;
+  MemoryContextCallback callback;
+} pljs_window_local;
+
+static JSValue window_get_current_position(JSContext *, JSValueConst, int,
+                                           JSValueConst *);
+static JSValue window_get_partition_row_count(JSContext *, JSValueConst, int,
+                                              JSValueConst *);
+static JSValue window_set_mark_position(JSContext *, JSValueConst, int,
+                                        JSValueConst *);
+static JSValue window_rows_are_peers(JSContext *, JSValueConst, int,
+                                     JSValueConst *);
+static JSValue window_get_arg_in_partition(JSContext *, JSValueConst, int,
+                                           JSValueConst *);
+static JSValue window_get_arg_in_frame(JSContext *, JSValueConst, int,
+                                       JSValueConst *);
+static JSValue window_get_arg_current(JSContext *, JSValueConst, int,
+                                      JSValueConst *);
+static JSValue window_get_partition_local(JSContext *, JSValueConst, int,
+                                          JSValueConst *);
+static JSValue window_set_partition_local(JSContext *, JSValueConst, int,
+                                          JSValueConst *);
+
+/**
+ * @brief Functions and constants of `pljs.window`.
+ */
+static const JSCFunctionListEntry window_functions[] = {
+    JS_CFUNC_DEF("getCurrentPosition", 0, window_get_current_position),
+    JS_CFUNC_DEF("getPartitionRowCount", 0, window_get_partition_row_count),
+    JS_CFUNC_DEF("setMarkPosition", 1, window_set_mark_position),
+    JS_CFUNC_DEF("rowsArePeers", 2, window_rows_are_peers),
+    JS_CFUNC_DEF("getArgInPartition", 4, window_get_arg_in_partition),
+    JS_CFUNC_DEF("getArgInFrame", 4, window_get_arg_in_frame),
+    JS_CFUNC_DEF("getArgCurrent", 1, window_get_arg_current),
+    JS_CFUNC_DEF("getPartitionLocal", 0, window_get_partition_local),
+    JS_CFUNC_DEF("setPartitionLocal", 1, window_set_partition_local),
+    JS_PROP_INT32_DEF("SEEK_CURRENT", WINDOW_SEEK_CURRENT, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("SEEK_HEAD", WINDOW_SEEK_HEAD, JS_PROP_ENUMERABLE),
+    JS_PROP_INT32_DEF("SEEK_TAIL", WINDOW_SEEK_TAIL, JS_PROP_ENUMERABLE),
+};
+
+/**
+ * @brief Sets up `pljs.window` in a context.
+ *
+ * @param ctx #JSContext - the context, with the `pljs` namespace set up
+ */
+void pljs_window_init(JSContext *ctx) {
+  JSValue global_obj = JS_GetGlobalObject(ctx);
+  JSValue pljs = JS_GetPropertyStr(ctx, global_obj, "pljs");
+  JSValue window = JS_NewObject(ctx);
+
+  JS_SetPropertyFunctionList(ctx, window, window_functions,
+                             lengthof(window_functions));
+  JS_SetPropertyStr(ctx, pljs, "window", window);
+
+  JS_FreeValue(ctx, pljs);
+  JS_FreeValue(ctx, global_obj);
+}
+
+/**
+ * @brief Makes a window function the one `pljs.window` works on.
+ *
+ * @param winobj #WindowObject - the window of the call
+ * @param state #pljs_call_state - the call state of the window function
+ * @returns #pljs_window of the window function called before, to restore
+ * with #pljs_window_leave.
+ */
+pljs_window pljs_window_enter(WindowObject winobj, pljs_call_state *state) {
+  pljs_window previous = current_window;
+
+  current_window.winobj = winobj;
+  current_window.state = state;
+
+  return previous;
+}
+
+/**
+ * @brief Restores the window function called before.
+ */
+void pljs_window_leave(pljs_window previous) { current_window = previous; }
+
+/**
+ * @brief Finds the window of the window function being called, throwing if
+ * none is.
+ */
+static WindowObject window_get(JSContext *ctx) {
+  if (current_window.winobj == NULL ||
+      current_window.state->context.ctx != ctx) {
+    js_throw(ctx, "pljs.window can only be used in a window function");
+
+    return NULL;
+  }
+
+  return current_window.winobj;
+}
+
+/**
+ * @brief Finds the number of an argument of the window function, throwing if
+ * there is no such argument.
+ */
+static bool window_argument(JSContext *ctx, JSValueConst value, int *argno) {
+  int32_t in;
+
+  JS_ToInt32(ctx, &in, value);
+
+  if (in < 0 || in >= current_window.state->context.function->inargs) {
+    js_throw(ctx, "window function argument number is out of range");
+
+    return false;
+  }
+
+  *argno = in;
+
+  return true;
+}
+
+/**
+ * @brief Converts an argument value read from the window.
+ *
+ * @returns #JSValue of the value, `undefined` when the row is outside of the
+ * partition or frame.
+ */
+static JSValue window_argument_value(JSContext *ctx, int argno, Datum datum,
+                                     bool isnull, bool isout) {
+  if (isout) {
+    return JS_UNDEFINED;
+  }
+
+  if (isnull) {
+    return JS_NULL;
+  }
+
+  return pljs_datum_to_jsvalue_typed(
+      datum, &current_window.state->argument_types[argno], ctx);
+}
+
+static JSValue window_get_current_position(JSContext *ctx,
+                                           JSValueConst this_val, int argc,
+                                           JSValueConst *argv) {
+  WindowObject winobj = window_get(ctx);
+
+  if (winobj == NULL) {
+    return JS_EXCEPTION;
+  }
+
+  return JS_NewInt64(ctx, WinGetCurrentPosition(winobj));
+}
+
+static JSValue window_get_partition_row_count(JSContext *ctx,
+                                              JSValueConst this_val, int argc,
+                                              JSValueConst *argv) {
+  WindowObject winobj = window_get(ctx);
+  MemoryContext mcontext = CurrentMemoryContext;
+  int64 count;
+
+  if (winobj == NULL) {
+    return JS_EXCEPTION;
+  }
+
+  // Counting the rows reads the whole partition.
+  PG_TRY();
+  { count = WinGetPartitionRowCount(winobj); }
+  PG_CATCH();
+  { return pljs_throw_pending_error(ctx, mcontext); }
+  PG_END_TRY();
+
+  return JS_NewInt64(ctx, count);
+}
+
+/**
+ * @brief Lets the window forget the rows before a position.
+ *
+ * Throws when the mark is moved backward.
+ */
+static JSValue window_set_mark_position(JSContext *ctx, JSValueConst this_val,
+                                        int argc, JSValueConst *argv) {
+  WindowObject winobj = window_get(ctx);
+  MemoryContext mcontext = CurrentMemoryContext;
+  int64_t position = 0;
+
+  if (winobj == NULL) {
+    return JS_EXCEPTION;
+  }
+
+  if (argc > 0) {
+    JS_ToInt64(ctx, &position, argv[0]);
+  }
+
+  PG_TRY();
+  { WinSetMarkPosition(winobj, position); }
+  PG_CATCH();
+  { return pljs_throw_pending_error(ctx, mcontext); }
+  PG_END_TRY();
+
+  return JS_UNDEFINED;
+}
+
+static JSValue window_rows_are_peers(JSContext *ctx, JSValueConst this_val,
+                                     int argc, JSValueConst *argv) {
+  WindowObject winobj = window_get(ctx);
+  MemoryContext mcontext = CurrentMemoryContext;
+  int64_t position1 = 0;
+  int64_t position2 = 0;
+  bool peers;
+
+  if (winobj == NULL) {
+    return JS_EXCEPTION;
+  }
+
+  if (argc > 1) {
+    JS_ToInt64(ctx, &position1, argv[0]);
+    JS_ToInt64(ctx, &position2, argv[1]);
+  }
+
+  PG_TRY();
+  { peers = WinRowsArePeers(winobj, position1, position2); }
+  PG_CATCH();
+  { return pljs_throw_pending_error(ctx, mcontext); }
+  PG_END_TRY();
+
+  return JS_NewBool(ctx, peers);
+}
+
+/**
+ * @brief Reads an argument in a row of the partition or of the frame.
+ *
+ * Takes the argument number, the position relative to `seektype`, one of
+ * `SEEK_CURRENT`, the default, `SEEK_HEAD` or `SEEK_TAIL`, and whether to
+ * set the mark at the row read.
+ */
+static JSValue window_get_arg_in(JSContext *ctx, int argc, JSValueConst *argv,
+                                 bool in_frame) {
+  WindowObject winobj = window_get(ctx);
+  MemoryContext mcontext = CurrentMemoryContext;
+  int argno;
+  int32_t relpos = 0;
+  int32_t seektype = WINDOW_SEEK_CURRENT;
+  bool set_mark = false;
+  bool isnull;
+  bool isout;
+  JSValue value;
+
+  if (winobj == NULL) {
+    return JS_EXCEPTION;
+  }
+
+  if (!window_argument(ctx, argc > 0 ? argv[0] : JS_UNDEFINED, &argno)) {
+    return JS_EXCEPTION;
+  }
+
+  if (argc > 1) {
+    JS_ToInt32(ctx, &relpos, argv[1]);
+  }
+
+  if (argc > 2) {
+    JS_ToInt32(ctx, &seektype, argv[2]);
+  }
+
+  if (argc > 3) {
+    set_mark = JS_ToBool(ctx, argv[3]);
+  }
+
+  if (seektype != WINDOW_SEEK_CURRENT && seektype != WINDOW_SEEK_HEAD &&
+      seektype != WINDOW_SEEK_TAIL) {
+    return js_throw(ctx, "invalid window seek type");
+  }
+
+  // Reading before the mark, or a value that does not convert, raises an
+  // error.
+  PG_TRY();
+  {
+    Datum datum = in_frame ? WinGetFuncArgInFrame(winobj, argno, relpos,
+                                                  seektype, set_mark, &isnull,
+                                                  &isout)
+                           : WinGetFuncArgInPartition(winobj, argno, relpos,
+                                                      seektype, set_mark,
+                                                      &isnull, &isout);
+
+    value = window_argument_value(ctx, argno, datum, isnull, isout);
+  }
+  PG_CATCH();
+  { return pljs_throw_pending_error(ctx, mcontext); }
+  PG_END_TRY();
+
+  return value;
+}
+
+static JSValue window_get_arg_in_partition(JSContext *ctx,
+                                           JSValueConst this_val, int argc,
+                                           JSValueConst *argv) {
+  return window_get_arg_in(ctx, argc, argv, false);
+}
+
+static JSValue window_get_arg_in_frame(JSContext *ctx, JSValueConst this_val,
+                                       int argc, JSValueConst *argv) {
+  return window_get_arg_in(ctx, argc, argv, true);
+}
+
+static JSValue window_get_arg_current(JSContext *ctx, JSValueConst this_val,
+                                      int argc, JSValueConst *argv) {
+  WindowObject winobj = window_get(ctx);
+  MemoryContext mcontext = CurrentMemoryContext;
+  int argno;
+  bool isnull;
+  JSValue value;
+
+  if (winobj == NULL) {
+    return JS_EXCEPTION;
+  }
+
+  if (!window_argument(ctx, argc > 0 ? argv[0] : JS_UNDEFINED, &argno)) {
+    return JS_EXCEPTION;
+  }
+
+  PG_TRY();
+  {
+    Datum datum = WinGetFuncArgCurrent(winobj, argno, &isnull);
+
+    value = window_argument_value(ctx, argno, datum, isnull, false);
+  }
+  PG_CATCH();
+  { return pljs_throw_pending_error(ctx, mcontext); }
+  PG_END_TRY();
+
+  return value;
+}
+
+/**
+ * @brief Releases the partition local value once its partition ends.
+ */
+static void window_local_release(void *arg) {
+  pljs_window_local *local = (pljs_window_local *)arg;
+
+  JS_FreeValue(local->ctx, local->value);
+  pljs_context_unpin(local->ctx);
+  local->ctx = NULL;
+}
+
+/**
+ * @brief Returns the value set for the current partition, `undefined` until
+ * one is set.
+ */
+static JSValue window_get_partition_local(JSContext *ctx,
+                                          JSValueConst this_val, int argc,
+                                          JSValueConst *argv) {
+  WindowObject winobj = window_get(ctx);
+
+  if (winobj == NULL) {
+    return JS_EXCEPTION;
+  }
+
+  pljs_window_local *local =
+      WinGetPartitionLocalMemory(winobj, sizeof(pljs_window_local));
+
+  if (local->ctx != ctx) {
+    return JS_UNDEFINED;
+  }
+
+  return JS_DupValue(ctx, local->value);
+}
+
+/**
+ * @brief Keeps a value for the rest of the current partition.
+ *
+ * The value stays a javascript value, and is released at the end of the
+ * partition.
+ */
+static JSValue window_set_partition_local(JSContext *ctx,
+                                          JSValueConst this_val, int argc,
+                                          JSValueConst *argv) {
+  WindowObject winobj = window_get(ctx);
+
+  if (winobj == NULL) {
+    return JS_EXCEPTION;
+  }
+
+  pljs_window_local *local =
+      WinGetPartitionLocalMemory(winobj, sizeof(pljs_window_local));
+  JSValue value = argc > 0 ? JS_DupValue(ctx, argv[0]) : JS_UNDEFINED;
+
+  if (local->ctx == NULL) {
+    // The partition local memory is zeroed for every partition, so the
+    // callback is registered once per partition.
+    local->callback.func = window_local_release;
+    local->callback.arg = local;
+
+    MemoryContextRegisterResetCallback(GetMemoryChunkContext(local),
+                                       &local->callback);
+  } else {
+    JS_FreeValue(local->ctx, local->value);
+    pljs_context_unpin(local->ctx);
+  }
+
+  pljs_context_pin(ctx);
+  local->ctx = ctx;
+  local->value = value;
+
+  return JS_UNDEFINED;
+}